@@ -0,0 +1,1395 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <stdlib.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <memory>
+#include <string>
+#include <vector>
+#include <omp.h>
+
+#include <raytracing/raytracing.h>
+#include <raytracing/utils.h>
+#include <raytracing/color.h>
+#include <raytracing/hitable_list.h>
+#include <raytracing/bvh.h>
+#include <raytracing/bvh_cache.h>
+#include <raytracing/wide_bvh.h>
+#include <raytracing/grid.h>
+#include <raytracing/instance.h>
+#include <raytracing/transform.h>
+#include <raytracing/sphere.h>
+#include <raytracing/sphere_set.h>
+#include <raytracing/triangle_mesh.h>
+#include <raytracing/out_of_core_mesh.h>
+#include <raytracing/mesh_loader.h>
+#include <raytracing/camera.h>
+#include <raytracing/dispatch.h>
+#include <raytracing/scene_builder.h>
+#include <raytracing/sampler.h>
+#include <raytracing/scene_arena.h>
+#include <raytracing/wavefront.h>
+#include <raytracing/material.h>
+#include <raytracing/texture.h>
+#include <raytracing/warp.h>
+#include <raytracing/adaptive.h>
+
+// The scene of the book, with the small spheres on a grid of 2 extent x 2 extent
+// cells, allocated from arena if given.
+HitableList random_scene(const int extent = 11, SceneArena *arena = NULL)
+{
+    HitableList world;
+
+    auto checker = make_in<CheckerTexture>(arena, make_in<SolidColor>(arena, Color{0.2, 0.3, 0.1}),
+                                           make_in<SolidColor>(arena, Color{0.9, 0.9, 0.9}));
+    world.add(make_in<Sphere>(arena, Point3{0, -1000, 0}, 1000, make_in<Lambertian>(arena, checker)));
+
+    for (int a = -extent; a < extent; ++a)
+    {
+        for (int b = -extent; b < extent; ++b)
+        {
+            auto choose_mat = random_number_t();
+            Point3 center{a + (number_t)0.9 * random_number_t(), (number_t)0.2, b + (number_t)0.9 * random_number_t()};
+
+            if ((center - Point3(4, 0.2, 0)).length() > 0.9)
+            {
+                std::shared_ptr<Material> sphere_material;
+
+                if (choose_mat < 0.8)
+                {
+                    // diffuse
+                    auto albedo = random_Vector3() * random_Vector3();
+                    sphere_material = make_in<Lambertian>(arena, make_in<SolidColor>(arena, albedo));
+                    world.add(make_in<Sphere>(arena, center, 0.2, sphere_material));
+                }
+                else if (choose_mat < 0.95)
+                {
+                    // Metal
+                    auto albedo = random_Vector3(0.5, 1);
+                    auto fuzz = random_number_t(0, 0.5);
+                    sphere_material = make_in<Metal>(arena, albedo, fuzz);
+                    world.add(make_in<Sphere>(arena, center, 0.2, sphere_material));
+                }
+                else
+                {
+                    // glass
+                    sphere_material = make_in<Dielectric>(arena, 1.5);
+                    world.add(make_in<Sphere>(arena, center, 0.2, sphere_material));
+                }
+            }
+        }
+    }
+
+    auto material1 = make_in<Dielectric>(arena, 1.5);
+    world.add(make_in<Sphere>(arena, Point3{0, 1, 0}, 1.0, material1));
+
+    auto material2 = make_in<Lambertian>(arena, make_in<SolidColor>(arena, Color(0.4, 0.2, 0.1)));
+    world.add(make_in<Sphere>(arena, Point3{-4, 1, 0}, 1.0, material2));
+
+    auto material3 = make_in<Metal>(arena, Color(0.7, 0.6, 0.5), 0.0);
+    world.add(make_in<Sphere>(arena, Point3{4, 1, 0}, 1.0, material3));
+
+    return world;
+}
+
+std::vector<Ray> primary_rays(const Camera &cam, const int image_width, const int image_height)
+{
+    std::vector<Ray> rays;
+    rays.reserve(image_width * image_height);
+
+    for (int j = image_height - 1; j >= 0; --j)
+        for (int i = 0; i < image_width; ++i)
+            rays.push_back(cam.get_ray(
+                (i + random_number_t()) / (image_width - 1), (j + random_number_t()) / (image_height - 1)));
+
+    return rays;
+}
+
+std::vector<Ray> secondary_rays(const std::vector<Ray> &primary, const Hitable &world)
+{
+    // Diffuse bounces off the primary hit points, much less coherent than primary rays.
+    std::vector<Ray> rays;
+    rays.reserve(primary.size());
+
+    for (const auto &r : primary)
+    {
+        HitRecord rec;
+        if (world.hit(r, spawn_t_min, infinity, rec))
+            rays.push_back(rec.spawn_ray(rec.normal + norm_random_in_unit_sphere()));
+    }
+
+    return rays;
+}
+
+double trace_time(const Hitable &world, const std::vector<Ray> &rays, int &hits, const bool any_hit = false)
+{
+    const int count = static_cast<int>(rays.size());
+    int hit_count = 0;
+    double start = omp_get_wtime();
+
+#pragma omp parallel for schedule(dynamic, 64) reduction(+ : hit_count)
+    for (int i = 0; i < count; ++i)
+    {
+        HitRecord rec;
+        if (any_hit ? world.occluded(rays[i], spawn_t_min, infinity) : world.hit(rays[i], spawn_t_min, infinity, rec))
+            ++hit_count;
+    }
+
+    hits = hit_count;
+    return omp_get_wtime() - start;
+}
+
+void report(const std::string &name, const double build_time, const Hitable &world,
+            const std::vector<Ray> &primary, const std::vector<Ray> &secondary)
+{
+    int primary_hits, secondary_hits, occluded_hits;
+    double primary_time = trace_time(world, primary, primary_hits);
+    double secondary_time = trace_time(world, secondary, secondary_hits);
+    double occluded_time = trace_time(world, secondary, occluded_hits, true);
+
+    std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(12) << 1e3 * build_time
+              << std::setw(14) << 1e-6 * primary.size() / primary_time
+              << std::setw(14) << 1e-6 * secondary.size() / secondary_time
+              << std::setw(14) << 1e-6 * secondary.size() / occluded_time
+              << std::setw(10) << primary_hits
+              << std::setw(10) << secondary_hits
+              << std::setw(10) << occluded_hits << "\n";
+}
+
+Color ray_color(const Ray &r, const Hitable &world, const int depth, Sampler &sampler)
+{
+    HitRecord rec;
+
+    if (depth <= 0)
+        return Color{0};
+
+    if (world.hit(r, spawn_t_min, infinity, rec))
+    {
+        Ray scattered;
+        Color attenuation;
+        sampler.next_bounce();
+        if (dispatch_scatter(*rec.material, r, rec, attenuation, scattered, sampler))
+            return attenuation * ray_color(scattered, world, depth - 1, sampler);
+        return Color{0};
+    }
+
+    return WavefrontIntegrator::background(r);
+}
+
+void render_recursive(const Hitable &world, const Camera &cam, const int image_width, const int image_height,
+                      const int samples_per_pixel, const int max_depth, Color *pixel, const uint64_t seed = 0,
+                      const SamplePattern pattern = SamplePattern::Independent)
+{
+#pragma omp parallel for schedule(dynamic)
+    for (int j = 0; j < image_height; ++j)
+    {
+        Sampler sampler{seed, pattern, static_cast<uint32_t>(image_width)};
+        for (int i = 0; i < image_width; ++i)
+        {
+            pixel[j * image_width + i] = Color{0, 0, 0};
+            for (int s = 0; s < samples_per_pixel; ++s)
+            {
+                sampler.start(j * image_width + i, s);
+                auto u = (i + random_number_t(sampler)) / (image_width - 1);
+                auto v = (j + random_number_t(sampler)) / (image_height - 1);
+                pixel[j * image_width + i] += ray_color(cam.get_ray(u, v, sampler), world, max_depth, sampler);
+            }
+        }
+    }
+}
+
+number_t image_rmse(const std::vector<Color> &a, const std::vector<Color> &b, const int samples_per_pixel)
+{
+    number_t sum = 0;
+    for (size_t i = 0; i < a.size(); ++i)
+    {
+        Vector3 d = (a[i] - b[i]) / samples_per_pixel;
+        sum += d.length_squared() / 3;
+    }
+    return sqrt(sum / a.size());
+}
+
+void integrator_benchmark(const Hitable &world, const Camera &cam)
+{
+    // Two recursive renders with different seeds give the Monte Carlo noise
+    // level the wavefront render has to match. With the same seed as the
+    // second one, the wavefront render traces the same paths.
+    const int image_width = 160;
+    const int image_height = static_cast<int>(image_width / (ASPECT_RATIO));
+    const int samples_per_pixel = 16;
+    const int max_depth = 50;
+
+    std::vector<Color> reference(image_width * image_height), recursive(reference.size()), wavefront(reference.size());
+    render_recursive(world, cam, image_width, image_height, samples_per_pixel, max_depth, reference.data(), 1);
+
+    double start = omp_get_wtime();
+    render_recursive(world, cam, image_width, image_height, samples_per_pixel, max_depth, recursive.data());
+    double recursive_time = omp_get_wtime() - start;
+
+    WavefrontIntegrator integrator;
+    start = omp_get_wtime();
+    integrator.render(world, cam, image_width, image_height, samples_per_pixel, max_depth, wavefront.data());
+    double wavefront_time = omp_get_wtime() - start;
+
+    std::cout << "\nIntegrators (" << image_width << "x" << image_height << ", " << samples_per_pixel << " spp)\n"
+              << std::fixed << std::setprecision(4)
+              << "recursive: " << 1e3 * recursive_time << " ms, RMSE to reference "
+              << image_rmse(reference, recursive, samples_per_pixel) << "\n"
+              << "wavefront: " << 1e3 * wavefront_time << " ms, RMSE to reference "
+              << image_rmse(reference, wavefront, samples_per_pixel) << ", to recursive "
+              << image_rmse(recursive, wavefront, samples_per_pixel) << "\n";
+}
+
+// random_number_t() before samplers, on the shared state of rand()
+number_t rand_number_t()
+{
+    return std::fmin(static_cast<number_t>(rand() / (RAND_MAX + 1.0)), one_minus_epsilon);
+}
+
+template <int Generator>
+double random_rate(const long count, number_t &sum)
+{
+    number_t total = 0;
+    double start = omp_get_wtime();
+#pragma omp parallel reduction(+ : total)
+    {
+        Sampler sampler{static_cast<uint64_t>(omp_get_thread_num())};
+#pragma omp for schedule(static)
+        for (long n = 0; n < count; ++n)
+            total += Generator == 0 ? rand_number_t() : Generator == 1 ? random_number_t() : random_number_t(sampler);
+    }
+    sum = total;
+    return 1e-6 * count / (omp_get_wtime() - start);
+}
+
+void sampler_benchmark(const Hitable &world, const Camera &cam)
+{
+    const long count = 20000000;
+    number_t sums[3];
+    double rates[3] = {random_rate<0>(count, sums[0]), random_rate<1>(count, sums[1]),
+                       random_rate<2>(count, sums[2])};
+
+    std::cout << "\nRandom numbers (" << omp_get_max_threads() << " threads, mean of " << count << ")\n"
+              << std::fixed << std::setprecision(2);
+    const char *names[] = {"rand()", "thread_sampler()", "Sampler"};
+    for (int k = 0; k < 3; ++k)
+        std::cout << std::left << std::setw(18) << names[k] << std::right << std::setw(10) << rates[k] << " M/s"
+                  << std::setprecision(4) << std::setw(10) << sums[k] / count << std::setprecision(2) << "\n";
+
+    // Each sample of a pixel draws from its own stream, so the image does
+    // not depend on the number of threads or their schedule
+    const int image_width = 160;
+    const int image_height = static_cast<int>(image_width / (ASPECT_RATIO));
+    const int threads[] = {1, 4};
+    std::vector<Color> images[2];
+    double times[2];
+    const int max_threads = omp_get_max_threads();
+    for (int k = 0; k < 2; ++k)
+    {
+        images[k].resize(image_width * image_height);
+        omp_set_num_threads(threads[k]);
+        double start = omp_get_wtime();
+        render_recursive(world, cam, image_width, image_height, 8, 50, images[k].data());
+        times[k] = omp_get_wtime() - start;
+    }
+    omp_set_num_threads(max_threads);
+
+    bool identical = true;
+    for (size_t i = 0; i < images[0].size(); ++i)
+        for (int a = 0; a < 3; ++a)
+            identical = identical && images[0][i][a] == images[1][i][a];
+
+    std::cout << "render " << image_width << "x" << image_height << " at 8 spp: 1 thread " << 1e3 * times[0]
+              << " ms, 4 threads " << 1e3 * times[1] << " ms, images " << (identical ? "identical" : "differ") << "\n";
+}
+
+// Converged image for the sampling benchmarks, the mean of 1024 Sobol samples
+// per pixel
+const int converged_width = 80;
+const int converged_height = static_cast<int>(converged_width / (ASPECT_RATIO));
+const int converged_samples = 1024;
+
+std::vector<Color> converged_image(const Hitable &world, const Camera &cam)
+{
+    std::vector<Color> image(converged_width * converged_height);
+    render_recursive(world, cam, converged_width, converged_height, converged_samples, 50, image.data(), 1,
+                     SamplePattern::Sobol);
+    for (Color &c : image)
+        c /= converged_samples;
+    return image;
+}
+
+// Samples per pixel each pattern needs for the RMSE of independent samples
+// at the highest count, interpolated on the log-log convergence curves
+void pattern_benchmark(const Hitable &world, const Camera &cam, const std::vector<Color> &reference)
+{
+    const int image_width = converged_width;
+    const int image_height = converged_height;
+    const int max_depth = 50;
+    const int counts[] = {1, 2, 4, 8, 16, 32, 64};
+    const int count_number = sizeof(counts) / sizeof(counts[0]);
+    const SamplePattern patterns[] = {SamplePattern::Independent, SamplePattern::Sobol, SamplePattern::Halton,
+                                      SamplePattern::BlueNoise};
+    const char *names[] = {"Independent", "Sobol", "Halton", "BlueNoise"};
+
+    std::vector<Color> image(reference.size());
+
+    std::cout << "\nSample patterns (" << image_width << "x" << image_height << ", RMSE to " << converged_samples
+              << " spp Sobol)\n"
+              << std::left << std::setw(12) << "pattern" << std::right;
+    for (int n = 0; n < count_number; ++n)
+        std::cout << std::setw(7) << counts[n] << " spp";
+    std::cout << std::setw(12) << "time [ms]" << std::setw(12) << "equal spp" << "\n";
+
+    number_t target = 0;
+    for (int p = 0; p < 4; ++p)
+    {
+        number_t rmse[count_number];
+        double time = 0;
+        for (int n = 0; n < count_number; ++n)
+        {
+            double start = omp_get_wtime();
+            render_recursive(world, cam, image_width, image_height, counts[n], max_depth, image.data(), 0,
+                             patterns[p]);
+            time = omp_get_wtime() - start;
+            number_t sum = 0;
+            for (size_t i = 0; i < image.size(); ++i)
+                sum += (image[i] / counts[n] - reference[i]).length_squared() / 3;
+            rmse[n] = sqrt(sum / image.size());
+        }
+        if (p == 0)
+            target = rmse[count_number - 1];
+
+        // First count below the target, or the highest with slope extrapolated
+        int n = 1;
+        while (n < count_number - 1 && rmse[n] > target)
+            ++n;
+        const number_t slope = log(rmse[n] / rmse[n - 1]) / log(static_cast<number_t>(counts[n]) / counts[n - 1]);
+        const number_t equal = counts[n] * exp(log(target / rmse[n]) / slope);
+
+        std::cout << std::left << std::setw(12) << names[p] << std::right << std::fixed << std::setprecision(4);
+        for (int k = 0; k < count_number; ++k)
+            std::cout << std::setw(11) << rmse[k];
+        std::cout << std::setprecision(1) << std::setw(12) << 1e3 * time << std::setw(12) << equal << "\n";
+    }
+}
+
+// RMSE of the mean colors of an image to the reference, linear and after
+// encoding with gamma 2 like write_color()
+void image_errors(const std::vector<Color> &image, const std::vector<Color> &reference, number_t &linear,
+                  number_t &display)
+{
+    number_t linear_sum = 0, display_sum = 0;
+    for (size_t i = 0; i < image.size(); ++i)
+        for (int a = 0; a < 3; ++a)
+        {
+            const number_t d = image[i][a] - reference[i][a];
+            const number_t e = sqrt(std::min<number_t>(image[i][a], 1)) - sqrt(std::min<number_t>(reference[i][a], 1));
+            linear_sum += d * d;
+            display_sum += e * e;
+        }
+    linear = sqrt(linear_sum / (3 * image.size()));
+    display = sqrt(display_sum / (3 * image.size()));
+}
+
+// Uniform and adaptive sampling at the same average samples per pixel, both
+// with the Sobol pattern
+void adaptive_benchmark(const Hitable &world, const Camera &cam, const std::vector<Color> &reference)
+{
+    const int image_width = converged_width;
+    const int image_height = converged_height;
+    const int max_depth = 50;
+    const int budgets[] = {32, 64, 128};
+
+    std::cout << "\nAdaptive sampling (" << image_width << "x" << image_height << ", RMSE to " << converged_samples
+              << " spp Sobol)\n"
+              << std::left << std::setw(10) << "spp" << std::right
+              << std::setw(16) << "uniform lin."
+              << std::setw(16) << "adaptive lin."
+              << std::setw(16) << "uniform disp."
+              << std::setw(16) << "adaptive disp."
+              << std::setw(12) << "min spp"
+              << std::setw(12) << "max spp"
+              << std::setw(14) << "converged" << "\n";
+
+    std::vector<Color> uniform(reference.size()), adaptive(reference.size());
+    std::vector<PixelEstimate> estimates;
+    const AdaptiveOptions options;
+    for (int budget : budgets)
+    {
+        render_recursive(world, cam, image_width, image_height, budget, max_depth, uniform.data(), 0,
+                         SamplePattern::Sobol);
+        for (Color &c : uniform)
+            c /= budget;
+
+        render_adaptive(
+            image_width * image_height, budget, options,
+            [&](int p, int s) {
+                Sampler sampler{0, SamplePattern::Sobol, image_width};
+                sampler.start(p, s);
+                auto u = (p % image_width + random_number_t(sampler)) / (image_width - 1);
+                auto v = (p / image_width + random_number_t(sampler)) / (image_height - 1);
+                return ray_color(cam.get_ray(u, v, sampler), world, max_depth, sampler);
+            },
+            estimates);
+
+        int min_count = estimates[0].count(), max_count = min_count, converged = 0;
+        for (size_t p = 0; p < estimates.size(); ++p)
+        {
+            adaptive[p] = estimates[p].sum() / estimates[p].count();
+            min_count = std::min(min_count, estimates[p].count());
+            max_count = std::max(max_count, estimates[p].count());
+            converged += estimates[p].error() <= options.threshold;
+        }
+
+        number_t uniform_linear, uniform_display, adaptive_linear, adaptive_display;
+        image_errors(uniform, reference, uniform_linear, uniform_display);
+        image_errors(adaptive, reference, adaptive_linear, adaptive_display);
+        std::cout << std::left << std::setw(10) << budget << std::right << std::fixed << std::setprecision(4)
+                  << std::setw(16) << uniform_linear
+                  << std::setw(16) << adaptive_linear
+                  << std::setw(16) << uniform_display
+                  << std::setw(16) << adaptive_display
+                  << std::setw(12) << min_count
+                  << std::setw(12) << max_count
+                  << std::setprecision(1) << std::setw(13) << 100.0 * converged / estimates.size() << "%\n";
+    }
+}
+
+// The rejection sampling the warps replaced
+Vector3 rejection_disk(Sampler &sampler)
+{
+    while (true)
+    {
+        Vector3 p{sampler.next(-1, 1), sampler.next(-1, 1), 0};
+        if (p.length_squared() < 1)
+            return p;
+    }
+}
+
+Vector3 rejection_sphere(Sampler &sampler)
+{
+    while (true)
+    {
+        Vector3 p = random_Vector3(sampler, -1, 1);
+        if (p.length_squared() < 1)
+            return normalize_Vector3(p);
+    }
+}
+
+Vector3 rejection_lambertian(Sampler &sampler, const Vector3 &normal)
+{
+    Vector3 direction = normal + rejection_sphere(sampler);
+    return direction.is_near_zero() ? normal : direction;
+}
+
+// Directions per second for a warp: Kind 0 disk, 1 sphere, 2 Lambertian
+// bounce around a normal, including drawing the uniform numbers
+template <int Kind>
+double warp_rate(const int method, const int count, number_t &sum)
+{
+    const int batch = 256;
+    const Vector3 normal = normalize_Vector3(Vector3{1, 2, 3});
+    number_t u[batch], v[batch], x[batch], y[batch], z[batch];
+    Sampler sampler;
+    Vector3 total;
+
+    double start = omp_get_wtime();
+    for (int n = 0; n < count; n += batch)
+    {
+        if (method == 2)
+        {
+            for (int i = 0; i < batch; ++i)
+            {
+                u[i] = sampler.next();
+                v[i] = sampler.next();
+            }
+            if (Kind == 0)
+                concentric_disk(batch, u, v, x, y);
+            else if (Kind == 1)
+                uniform_sphere(batch, u, v, x, y, z);
+            else
+                cosine_hemisphere(batch, u, v, x, y, z);
+            for (int i = 0; i < batch; ++i)
+                total += Kind == 0 ? Vector3{x[i], y[i], 0} : Kind == 1 ? Vector3{x[i], y[i], z[i]}
+                                                             : local_to_world(Vector3{x[i], y[i], z[i]}, normal);
+            continue;
+        }
+
+        for (int i = 0; i < batch; ++i)
+        {
+            if (method == 0)
+                total += Kind == 0 ? rejection_disk(sampler) : Kind == 1 ? rejection_sphere(sampler)
+                                                                        : rejection_lambertian(sampler, normal);
+            else
+            {
+                const number_t a = sampler.next();
+                const number_t b = sampler.next();
+                total += Kind == 0 ? concentric_disk(a, b) : Kind == 1 ? uniform_sphere(a, b)
+                                                                      : local_to_world(cosine_hemisphere(a, b), normal);
+            }
+        }
+    }
+    sum = total.sum();
+    return 1e-6 * count / (omp_get_wtime() - start);
+}
+
+void warp_benchmark()
+{
+    const int count = 1 << 22;
+    const char *names[] = {"disk", "sphere", "Lambertian"};
+    number_t sum, checksum = 0;
+
+    std::cout << "\nSample warps (" << count << " directions, uniform numbers included)\n"
+              << std::left << std::setw(12) << "warp" << std::right
+              << std::setw(18) << "rejection [M/s]"
+              << std::setw(18) << "closed form [M/s]"
+              << std::setw(14) << "batch [M/s]" << "\n";
+    for (int kind = 0; kind < 3; ++kind)
+    {
+        std::cout << std::left << std::setw(12) << names[kind] << std::right << std::fixed << std::setprecision(2);
+        for (int method = 0; method < 3; ++method)
+        {
+            double rate = kind == 0 ? warp_rate<0>(method, count, sum)
+                        : kind == 1 ? warp_rate<1>(method, count, sum)
+                                    : warp_rate<2>(method, count, sum);
+            checksum += sum;
+            std::cout << std::setw(method == 2 ? 14 : 18) << rate;
+        }
+        std::cout << "\n";
+    }
+    std::cout << "checksum " << checksum << "\n";
+}
+
+// Lane-wise Vector3 operations as ray_color() and the materials use them,
+// each applied to every element of vectors that stay in the L1 cache.
+struct VectorAdd
+{
+    Vector3 operator()(const Vector3 &a, const Vector3 &b) const { return a + b; }
+};
+
+struct VectorScale
+{
+    Vector3 operator()(const Vector3 &a, const Vector3 &b) const { return a * b.x(); }
+};
+
+struct VectorMultiply
+{
+    Vector3 operator()(const Vector3 &a, const Vector3 &b) const { return a * b; }
+};
+
+struct VectorCross
+{
+    Vector3 operator()(const Vector3 &a, const Vector3 &b) const { return cross_Vector3(a, b); }
+};
+
+struct VectorNormalize
+{
+    Vector3 operator()(const Vector3 &a, const Vector3 &) const { return normalize_Vector3(a); }
+};
+
+struct VectorBounce
+{
+    // Lambertian scatter direction, attenuation and sky blend of one bounce
+    Vector3 operator()(const Vector3 &a, const Vector3 &b) const
+    {
+        const Vector3 direction = normalize_Vector3(a + b);
+        const number_t t = 0.5 * (direction.y() + 1);
+        return a * ((1 - t) * Color{1, 1, 1} + t * Color{0.5, 0.7, 1.0});
+    }
+};
+
+template <typename Op>
+double vector_op_time(const std::vector<Vector3> &a, const std::vector<Vector3> &b, std::vector<Vector3> &out,
+                      const Op &op)
+{
+    const int rounds = 4000;
+    const int count = static_cast<int>(a.size());
+
+    // Best of a few trials, timings on a loaded machine only ever get worse
+    double best = infinity;
+    for (int trial = 0; trial < 5; ++trial)
+    {
+        double start = omp_get_wtime();
+        for (int round = 0; round < rounds; ++round)
+        {
+            for (int i = 0; i < count; ++i)
+                out[i] = op(a[i], b[i]);
+            // The next round depends on this one, so no round is skipped
+            out[round % count] += a[0];
+        }
+        best = std::min(best, omp_get_wtime() - start);
+    }
+    return 1e9 * best / (static_cast<double>(rounds) * count);
+}
+
+void vector_benchmark()
+{
+    const int count = 256;
+    std::vector<Vector3> a(count), b(count), out(count);
+    for (int i = 0; i < count; ++i)
+    {
+        a[i] = random_Vector3(-1, 1);
+        b[i] = random_Vector3(-1, 1);
+    }
+
+    const char *names[] = {"add", "scale", "multiply", "cross", "normalize", "bounce"};
+    double times[] = {vector_op_time(a, b, out, VectorAdd()), vector_op_time(a, b, out, VectorScale()),
+                      vector_op_time(a, b, out, VectorMultiply()), vector_op_time(a, b, out, VectorCross()),
+                      vector_op_time(a, b, out, VectorNormalize()), vector_op_time(a, b, out, VectorBounce())};
+
+    Vector3 sum;
+    for (int i = 0; i < count; ++i)
+        sum += out[i];
+
+    std::cout << "\nVector3 operations (sizeof(Vector3) = " << sizeof(Vector3) << ", checksum "
+              << std::setprecision(3) << sum.sum() << ")\n";
+    for (int k = 0; k < 6; ++k)
+        std::cout << std::left << std::setw(12) << names[k] << std::right << std::fixed << std::setprecision(2)
+                  << std::setw(8) << times[k] << " ns/op\n";
+}
+
+// Closest hit in bvh, with the primitives reached either through virtual calls
+// or through the closed-world dispatch that BVH::intersect uses.
+template <bool Closed>
+bool intersect_leaves(const BVH &bvh, const Ray &r, HitRecord &rec)
+{
+    const std::vector<BVHNode> &nodes = bvh.nodes();
+    const std::vector<HitablePtr> &objects = bvh.objects();
+    Vector3 inv_direction = 1 / r.direction();
+    number_t t_max = infinity;
+    bool hit_anything = false;
+
+    int stack[BVH_MAX_DEPTH];
+    int stack_size = 0;
+    int current = 0;
+
+    while (true)
+    {
+        const BVHNode &node = nodes[current];
+        if (node.bounds.hit(r.origin(), inv_direction, spawn_t_min, t_max))
+        {
+            if (node.is_leaf())
+            {
+                for (int i = node.offset; i < node.offset + node.count; ++i)
+                {
+                    const Hitable &object = *objects[i];
+                    if (Closed ? dispatch_intersect(object, r, spawn_t_min, t_max, rec)
+                               : object.intersect(r, spawn_t_min, t_max, rec))
+                    {
+                        hit_anything = true;
+                        t_max = rec.t;
+                    }
+                }
+            }
+            else
+            {
+                bool negative = inv_direction[node.axis] < 0;
+                stack[stack_size++] = negative ? current + 1 : node.offset;
+                current = negative ? node.offset : current + 1;
+                continue;
+            }
+        }
+
+        if (stack_size == 0)
+            break;
+        current = stack[--stack_size];
+    }
+
+    if (hit_anything)
+        Hitable::complete(r, rec);
+    return hit_anything;
+}
+
+template <bool Closed>
+Color dispatch_ray_color(const BVH &bvh, const Ray &r, const int depth, Sampler &sampler)
+{
+    HitRecord rec;
+
+    if (depth <= 0)
+        return Color{0};
+
+    if (intersect_leaves<Closed>(bvh, r, rec))
+    {
+        Ray scattered;
+        Color attenuation;
+        sampler.next_bounce();
+        if (Closed ? dispatch_scatter(*rec.material, r, rec, attenuation, scattered, sampler)
+                   : rec.material->scatter(r, rec, attenuation, scattered, sampler))
+            return attenuation * dispatch_ray_color<Closed>(bvh, scattered, depth - 1, sampler);
+        return Color{0};
+    }
+
+    return WavefrontIntegrator::background(r);
+}
+
+template <bool Closed>
+void dispatch_report(const char *name, const BVH &bvh, const Camera &cam,
+                     const std::vector<Ray> &primary, const std::vector<Ray> &secondary)
+{
+    const std::vector<Ray> *rays[2] = {&primary, &secondary};
+    double rate[2];
+    int hits[2];
+    for (int k = 0; k < 2; ++k)
+    {
+        const int count = static_cast<int>(rays[k]->size());
+        int hit_count = 0;
+        double start = omp_get_wtime();
+#pragma omp parallel for schedule(dynamic, 64) reduction(+ : hit_count)
+        for (int i = 0; i < count; ++i)
+        {
+            HitRecord rec;
+            if (intersect_leaves<Closed>(bvh, (*rays[k])[i], rec))
+                ++hit_count;
+        }
+        rate[k] = 1e-6 * count / (omp_get_wtime() - start);
+        hits[k] = hit_count;
+    }
+
+    const int image_width = 160;
+    const int image_height = static_cast<int>(image_width / (ASPECT_RATIO));
+    const int samples_per_pixel = 8;
+    const int max_depth = 50;
+    double start = omp_get_wtime();
+#pragma omp parallel for schedule(dynamic)
+    for (int j = 0; j < image_height; ++j)
+    {
+        Sampler sampler;
+        for (int i = 0; i < image_width; ++i)
+            for (int s = 0; s < samples_per_pixel; ++s)
+            {
+                sampler.start(j * image_width + i, s);
+                auto u = (i + random_number_t(sampler)) / (image_width - 1);
+                auto v = (j + random_number_t(sampler)) / (image_height - 1);
+                dispatch_ray_color<Closed>(bvh, cam.get_ray(u, v, sampler), max_depth, sampler);
+            }
+    }
+    double render_time = omp_get_wtime() - start;
+
+    std::cout << std::left << std::setw(10) << name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(14) << rate[0] << std::setw(14) << rate[1] << std::setw(14) << 1e3 * render_time
+              << std::setw(10) << hits[0] << std::setw(10) << hits[1] << "\n";
+}
+
+void dispatch_benchmark(const BVH &bvh, const Camera &cam,
+                        const std::vector<Ray> &primary, const std::vector<Ray> &secondary)
+{
+    std::cout << "\nDispatch (BVH (SAH) leaves and materials, render 160 px wide at 8 spp)\n"
+              << std::left << std::setw(10) << "path" << std::right
+              << std::setw(14) << "primary [M/s]"
+              << std::setw(14) << "second. [M/s]"
+              << std::setw(14) << "render [ms]"
+              << std::setw(10) << "hits (p)"
+              << std::setw(10) << "hits (s)" << "\n";
+    dispatch_report<false>("virtual", bvh, cam, primary, secondary);
+    dispatch_report<true>("closed", bvh, cam, primary, secondary);
+}
+
+void instancing_benchmark()
+{
+    // One cluster of spheres, repeated on a field with random rotations and
+    // scales, once as instances of a shared BVH and once flattened into copies.
+    const int cluster_size = 64;
+    const int field_size = 48;
+
+    HitableList cluster;
+    for (int i = 0; i < cluster_size; ++i)
+        cluster.add(std::make_shared<Sphere>(random_Vector3(-0.4, 0.4), random_number_t(0.05, 0.15)));
+    auto blas = std::make_shared<BVH>(cluster);
+
+    HitableList instances, copies;
+    for (int a = 0; a < field_size; ++a)
+    {
+        for (int b = 0; b < field_size; ++b)
+        {
+            auto scale = random_number_t(0.5, 1.5);
+            Transform transform = translate_Transform(Vector3(a - field_size / 2.0, scale / 2, b - field_size / 2.0)) *
+                                  rotate_Transform(Vector3{0, 1, 0}, random_number_t(0, 360)) *
+                                  scale_Transform(scale);
+            instances.add(std::make_shared<Instance>(blas, transform));
+
+            for (const auto &object : cluster.objects())
+            {
+                auto sphere = std::static_pointer_cast<Sphere>(object);
+                copies.add(std::make_shared<Sphere>(transform.point(sphere->center()), scale * sphere->radius()));
+            }
+        }
+    }
+
+    std::vector<Ray> primary, secondary;
+    for (int i = 0; i < 100000; ++i)
+    {
+        Point3 from{random_number_t(-30, 30), 20, random_number_t(-30, 30)};
+        Point3 to{random_number_t(-field_size / 2.0, field_size / 2.0), 0, random_number_t(-field_size / 2.0, field_size / 2.0)};
+        primary.push_back(Ray(from, to - from));
+        secondary.push_back(Ray(to + Vector3{0, 0.5, 0}, random_Vector3(-1, 1)));
+    }
+
+    std::cout << "\nInstancing (" << instances.objects().size() << " instances of "
+              << cluster_size << " spheres)\n";
+
+    double start = omp_get_wtime();
+    BVH tlas{instances};
+    report("BVH over instances", omp_get_wtime() - start, tlas, primary, secondary);
+
+    start = omp_get_wtime();
+    BVH flat{copies};
+    report("BVH over copies", omp_get_wtime() - start, flat, primary, secondary);
+
+    std::cout << "memory: instances "
+              << (sizeof(BVHNode) * (blas->nodes().size() + tlas.nodes().size()) +
+                  sizeof(Sphere) * cluster_size + sizeof(Instance) * instances.objects().size()) / 1024
+              << " KiB, copies "
+              << (sizeof(BVHNode) * flat.nodes().size() + sizeof(Sphere) * copies.objects().size()) / 1024
+              << " KiB\n";
+}
+
+void refit_benchmark()
+{
+    // Spheres drifting a little every frame, as in a turntable or animation job.
+    const int sphere_count = 100000;
+    const int frames = 5;
+
+    HitableList scene;
+    std::vector<std::shared_ptr<Sphere>> spheres;
+    for (int i = 0; i < sphere_count; ++i)
+    {
+        auto sphere = std::make_shared<Sphere>(random_Vector3(-50, 50), random_number_t(0.05, 0.5));
+        spheres.push_back(sphere);
+        scene.add(sphere);
+    }
+
+    double start = omp_get_wtime();
+    BVH bvh{scene};
+    std::cout << "\nRefit (" << sphere_count << " moving spheres)\n"
+              << "build " << 1e3 * (omp_get_wtime() - start) << " ms, SAH cost " << bvh.sah_cost() << "\n";
+
+    for (int frame = 0; frame < frames; ++frame)
+    {
+        for (auto &sphere : spheres)
+            sphere->set_center(sphere->center() + random_Vector3(-0.5, 0.5));
+
+        start = omp_get_wtime();
+        bvh.refit();
+        double refit_time = omp_get_wtime() - start;
+        number_t refit_cost = bvh.sah_cost();
+
+        start = omp_get_wtime();
+        int rebuilt = bvh.update();
+        double update_time = omp_get_wtime() - start;
+
+        std::cout << "frame " << frame << ": refit " << 1e3 * refit_time << " ms (SAH cost " << refit_cost
+                  << "), update " << 1e3 * update_time << " ms (" << rebuilt << " subtrees rebuilt, SAH cost "
+                  << bvh.sah_cost() << ")\n";
+    }
+}
+
+void packet_benchmark(const HitableList &scene, const int image_width, const int image_height)
+{
+    // Primary rays of a pinhole camera, traced one by one and as square tiles.
+    Camera cam(Point3{13, 2, 3}, Point3{0, 0, 0}, Vector3{0, 1, 0}, 20, ASPECT_RATIO, 0, 10);
+    BVH bvh{scene};
+
+    std::cout << "\nPacket traversal (pinhole primary rays)\n";
+
+    for (int tile_size = 1; tile_size <= 8; tile_size *= 2)
+    {
+        if (tile_size == 2)
+            continue;
+
+        const int tiles_x = (image_width + tile_size - 1) / tile_size;
+        const int tiles_y = (image_height + tile_size - 1) / tile_size;
+        int hit_count = 0;
+        double start = omp_get_wtime();
+
+#pragma omp parallel for schedule(dynamic) reduction(+ : hit_count)
+        for (int t = 0; t < tiles_x * tiles_y; ++t)
+        {
+            const int i0 = (t % tiles_x) * tile_size, i1 = std::min(i0 + tile_size, image_width);
+            const int j0 = (t / tiles_x) * tile_size, j1 = std::min(j0 + tile_size, image_height);
+
+            if (tile_size == 1)
+            {
+                HitRecord rec;
+                hit_count += bvh.hit(cam.get_ray(static_cast<number_t>(i0) / (image_width - 1),
+                                                 static_cast<number_t>(j0) / (image_height - 1)),
+                                     spawn_t_min, infinity, rec);
+                continue;
+            }
+
+            RayPacket packet;
+            HitRecord recs[RAY_PACKET_SIZE];
+            bool hits[RAY_PACKET_SIZE];
+
+            packet.clear();
+            for (int j = j0; j < j1; ++j)
+                for (int i = i0; i < i1; ++i)
+                    packet.add(cam.get_ray(static_cast<number_t>(i) / (image_width - 1),
+                                           static_cast<number_t>(j) / (image_height - 1)));
+            packet.update_bounds();
+            bvh.hit_packet(packet, spawn_t_min, infinity, recs, hits);
+
+            for (int k = 0; k < packet.size; ++k)
+                hit_count += hits[k];
+        }
+
+        double time = omp_get_wtime() - start;
+        std::cout << (tile_size == 1 ? std::string("single rays") : std::to_string(tile_size) + "x" + std::to_string(tile_size) + " packets")
+                  << ": " << std::fixed << std::setprecision(2) << 1e-6 * image_width * image_height / time
+                  << " M/s, " << hit_count << " hits\n";
+    }
+}
+
+void cache_benchmark()
+{
+    // Startup of a repeated render: cold builds and stores the tree, warm
+    // finds it in the cache and only maps the file.
+    const int sphere_count = 200000;
+
+    HitableList scene;
+    for (int i = 0; i < sphere_count; ++i)
+        scene.add(std::make_shared<Sphere>(random_Vector3(-100, 100), random_number_t(0.05, 0.5)));
+
+    BVHBuildOptions options;
+    options.cache_directory = PROJECT "_cache";
+
+    std::vector<AABB> bounds(sphere_count);
+    for (int i = 0; i < sphere_count; ++i)
+        scene.objects()[i]->bounding_box(bounds[i]);
+    std::string path = bvh_cache_path(options.cache_directory, hash_bvh_input(bounds, options));
+    std::remove(path.c_str());
+
+    double start = omp_get_wtime();
+    BVH uncached{scene};
+    double uncached_time = omp_get_wtime() - start;
+
+    start = omp_get_wtime();
+    BVH cold{scene, options};
+    double cold_time = omp_get_wtime() - start;
+
+    start = omp_get_wtime();
+    BVH warm{scene, options};
+    double warm_time = omp_get_wtime() - start;
+
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    std::cout << "\nBVH cache (" << sphere_count << " spheres, " << file.tellg() / 1024 << " KiB)\n"
+              << "no cache " << 1e3 * uncached_time << " ms, cold " << 1e3 * cold_time
+              << " ms, warm " << 1e3 * warm_time << " ms, "
+              << (warm.nodes().size() == cold.nodes().size() && warm.sah_cost() == cold.sah_cost() ? "same tree" : "TREES DIFFER")
+              << "\n";
+
+    file.close();
+    std::remove(path.c_str());
+    std::remove(options.cache_directory.c_str());
+}
+
+void sphere_set_benchmark()
+{
+    // The same small spheres as separate objects under a BVH and as one SphereSet.
+    const int sphere_count = 200000;
+
+    HitableList scene;
+    SphereSet set;
+    auto material = std::make_shared<Lambertian>(Color{0.5});
+    for (int i = 0; i < sphere_count; ++i)
+    {
+        auto sphere = std::make_shared<Sphere>(random_Vector3(-100, 100), random_number_t(0.05, 0.5), material);
+        scene.add(sphere);
+        set.add(*sphere);
+    }
+
+    std::vector<Ray> primary, secondary;
+    for (int i = 0; i < 200000; ++i)
+    {
+        primary.push_back(Ray(Point3{0, 0, 300}, random_Vector3(-0.3, 0.3) + Vector3{0, 0, -1}));
+        secondary.push_back(Ray(random_Vector3(-100, 100), random_Vector3(-1, 1)));
+    }
+
+    std::cout << "\nSphereSet (" << sphere_count << " spheres, " << SPHERE_SET_WIDTH << " wide)\n";
+
+    double start = omp_get_wtime();
+    BVH bvh{scene};
+    report("BVH over Spheres", omp_get_wtime() - start, bvh, primary, secondary);
+
+    start = omp_get_wtime();
+    set.build();
+    report("SphereSet", omp_get_wtime() - start, set, primary, secondary);
+
+    // make_shared puts the control block next to the Sphere
+    std::cout << "memory: Spheres "
+              << ((sizeof(Sphere) + 2 * sizeof(long) + sizeof(HitablePtr)) * sphere_count +
+                  sizeof(BVHNode) * bvh.nodes().size()) / 1024
+              << " KiB, SphereSet "
+              << ((4 * sizeof(number_t) + sizeof(int)) * set.slots() + sizeof(BVHNode) * set.nodes().size()) / 1024
+              << " KiB\n";
+}
+
+// A finely tessellated torus with 2 * rings * sides triangles.
+void make_torus(const int rings, const int sides, std::vector<Point3> &vertices, std::vector<Vector3> &normals,
+                std::vector<int> &indices)
+{
+    const number_t major = 2, minor = 0.6;
+
+    vertices.reserve(rings * sides);
+    normals.reserve(rings * sides);
+    indices.reserve(6 * rings * sides);
+    for (int i = 0; i < rings; ++i)
+    {
+        number_t phi = 2 * pi * i / rings;
+        for (int j = 0; j < sides; ++j)
+        {
+            number_t theta = 2 * pi * j / sides;
+            Vector3 normal(cos(phi) * cos(theta), sin(theta), sin(phi) * cos(theta));
+            vertices.push_back(Point3(major * cos(phi), 0, major * sin(phi)) + minor * normal);
+            normals.push_back(normal);
+
+            int a = i * sides + j, b = i * sides + (j + 1) % sides;
+            int c = ((i + 1) % rings) * sides + j, d = ((i + 1) % rings) * sides + (j + 1) % sides;
+            indices.insert(indices.end(), {a, b, d, a, d, c});
+        }
+    }
+}
+
+void triangle_mesh_benchmark()
+{
+    std::vector<Point3> vertices;
+    std::vector<Vector3> normals;
+    std::vector<int> indices;
+    make_torus(1000, 500, vertices, normals, indices);
+
+    double start = omp_get_wtime();
+    TriangleMesh mesh(vertices, indices, std::make_shared<Lambertian>(Color{0.5}), normals);
+    double build_time = omp_get_wtime() - start;
+
+    Camera cam(Point3{0, 2.5, 3.5}, Point3{0, 0, 0}, Vector3{0, 1, 0}, 60, 16.0 / 9.0, 0, 4);
+    std::vector<Ray> primary = primary_rays(cam, 400, 225);
+    std::vector<Ray> secondary = secondary_rays(primary, mesh);
+
+    std::cout << "\nTriangleMesh (" << mesh.triangle_count() << " triangles, " << TRIANGLE_MESH_WIDTH
+              << " wide, " << std::setprecision(1) << static_cast<double>(mesh.memory()) / mesh.triangle_count()
+              << " bytes/triangle)\n";
+    report("TriangleMesh", build_time, mesh, primary, secondary);
+}
+
+double batch_time(const Hitable &world, const std::vector<Ray> &rays, int &hits)
+{
+    std::vector<HitRecord> recs(rays.size());
+    std::unique_ptr<bool[]> hit(new bool[rays.size()]);
+    double start = omp_get_wtime();
+    world.hit_batch(rays.data(), static_cast<int>(rays.size()), spawn_t_min, infinity, recs.data(), hit.get());
+    double time = omp_get_wtime() - start;
+
+    hits = static_cast<int>(std::count(hit.get(), hit.get() + rays.size(), true));
+    return time;
+}
+
+void out_of_core_benchmark()
+{
+    // The torus of triangle_mesh_benchmark() traced from a file, with all
+    // clusters allowed in memory and with an eighth of them, ray by ray and
+    // as one batch queued per cluster. Each row starts with nothing paged in.
+    const char *path = PROJECT "_mesh.ooc";
+    Camera cam(Point3{0, 2.5, 3.5}, Point3{0, 0, 0}, Vector3{0, 1, 0}, 60, 16.0 / 9.0, 0, 4);
+    std::vector<Ray> primary, secondary;
+    size_t mesh_memory;
+    double write_time;
+    {
+        std::vector<Point3> vertices;
+        std::vector<Vector3> normals;
+        std::vector<int> indices;
+        make_torus(1000, 500, vertices, normals, indices);
+        TriangleMesh mesh(vertices, indices, std::make_shared<Lambertian>(Color{0.5}), normals);
+        primary = primary_rays(cam, 400, 225);
+        secondary = secondary_rays(primary, mesh);
+        mesh_memory = mesh.memory();
+
+        double start = omp_get_wtime();
+        OutOfCoreMesh::write(path, mesh);
+        write_time = omp_get_wtime() - start;
+    }
+
+    auto material = std::make_shared<Lambertian>(Color{0.5});
+    OutOfCoreMesh info(path, material);
+    std::cout << "\nOutOfCoreMesh (" << info.triangle_count() << " triangles, " << info.cluster_count()
+              << " clusters, file " << (info.file_size() >> 20) << " MiB written in " << std::setprecision(0)
+              << 1e3 * write_time << " ms, resident " << (info.memory() >> 10) << " KiB, in memory "
+              << (mesh_memory >> 20) << " MiB)\n"
+              << std::left << std::setw(10) << "trace" << std::right
+              << std::setw(10) << "cap [MiB]"
+              << std::setw(14) << "primary [M/s]"
+              << std::setw(14) << "second. [M/s]"
+              << std::setw(10) << "hits (p)"
+              << std::setw(10) << "hits (s)"
+              << std::setw(10) << "page-ins" << "\n";
+
+    const size_t caps[] = {0, info.file_size() / 8};
+    for (const size_t cap : caps)
+    {
+        for (int batch = 0; batch < 2; ++batch)
+        {
+            OutOfCoreMesh mesh(path, material, cap);
+            int primary_hits, secondary_hits;
+            double primary_time = batch ? batch_time(mesh, primary, primary_hits)
+                                        : trace_time(mesh, primary, primary_hits);
+            double secondary_time = batch ? batch_time(mesh, secondary, secondary_hits)
+                                          : trace_time(mesh, secondary, secondary_hits);
+
+            std::cout << std::left << std::setw(10) << (batch ? "batch" : "rays") << std::right << std::fixed
+                      << std::setw(10) << (cap >> 20)
+                      << std::setprecision(2) << std::setw(14) << 1e-6 * primary.size() / primary_time
+                      << std::setw(14) << 1e-6 * secondary.size() / secondary_time
+                      << std::setw(10) << primary_hits
+                      << std::setw(10) << secondary_hits
+                      << std::setw(10) << mesh.page_ins() << "\n";
+        }
+    }
+
+    std::remove(path);
+}
+
+// Bytes allocated from the heap, zero without glibc's mallinfo2(). Unlike the
+// resident set size this does not depend on what earlier tests left behind.
+size_t heap_memory()
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+void arena_benchmark()
+{
+    // random_scene() grown to a million small spheres, each with a material
+    // of its own, allocated one by one by make_shared and from a SceneArena.
+    // Memory is the heap in use for the scene and for scene and BVH together,
+    // teardown destroys the BVH, the scene and the arena.
+    const int extent = 500;
+
+    std::cout << "\nScene allocation (random_scene with " << 4 * extent * extent << " small spheres)\n"
+              << std::left << std::setw(14) << "allocation" << std::right
+              << std::setw(12) << "scene [ms]"
+              << std::setw(12) << "BVH [ms]"
+              << std::setw(14) << "scene [MiB]"
+              << std::setw(14) << "+BVH [MiB]"
+              << std::setw(16) << "teardown [ms]" << "\n";
+
+    for (int use_arena = 0; use_arena < 2; ++use_arena)
+    {
+        const size_t before = heap_memory();
+        double start, scene_time, bvh_time, scene_memory, total_memory;
+        {
+            std::unique_ptr<SceneArena> arena(use_arena ? new SceneArena : NULL);
+
+            start = omp_get_wtime();
+            HitableList scene = random_scene(extent, arena.get());
+            scene_time = omp_get_wtime() - start;
+            scene_memory = (heap_memory() - before) / 1048576.0;
+
+            start = omp_get_wtime();
+            BVH bvh{scene};
+            bvh_time = omp_get_wtime() - start;
+            total_memory = (heap_memory() - before) / 1048576.0;
+
+            start = omp_get_wtime();
+        }
+        double teardown_time = omp_get_wtime() - start;
+
+        std::cout << std::left << std::setw(14) << (use_arena ? "SceneArena" : "make_shared") << std::right
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(12) << 1e3 * scene_time
+                  << std::setw(12) << 1e3 * bvh_time
+                  << std::setw(14) << scene_memory
+                  << std::setw(14) << total_memory
+                  << std::setw(16) << 1e3 * teardown_time << "\n";
+    }
+}
+
+void mesh_loader_benchmark()
+{
+    // The torus as a binary PLY with float positions and normals, and as OBJ
+    std::vector<Point3> vertices;
+    std::vector<Vector3> normals;
+    std::vector<int> indices;
+    make_torus(1000, 500, vertices, normals, indices);
+    const size_t triangle_count = indices.size() / 3;
+
+    std::ofstream ply(PROJECT "_mesh.ply", std::ios::binary);
+    ply << "ply\nformat binary_little_endian 1.0\n"
+        << "element vertex " << vertices.size() << "\n"
+        << "property float x\nproperty float y\nproperty float z\n"
+        << "property float nx\nproperty float ny\nproperty float nz\n"
+        << "element face " << triangle_count << "\n"
+        << "property list uchar int vertex_indices\nend_header\n";
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        float record[6] = {static_cast<float>(vertices[i].x()), static_cast<float>(vertices[i].y()),
+                           static_cast<float>(vertices[i].z()), static_cast<float>(normals[i].x()),
+                           static_cast<float>(normals[i].y()), static_cast<float>(normals[i].z())};
+        ply.write(reinterpret_cast<const char *>(record), sizeof(record));
+    }
+    for (size_t t = 0; t < triangle_count; ++t)
+    {
+        const unsigned char corners = 3;
+        ply.write(reinterpret_cast<const char *>(&corners), 1);
+        ply.write(reinterpret_cast<const char *>(&indices[3 * t]), 3 * sizeof(int));
+    }
+    ply.close();
+
+    std::ofstream obj(PROJECT "_mesh.obj");
+    obj << std::setprecision(7);
+    for (size_t i = 0; i < vertices.size(); ++i)
+        obj << "v " << vertices[i].x() << " " << vertices[i].y() << " " << vertices[i].z() << "\n"
+            << "vn " << normals[i].x() << " " << normals[i].y() << " " << normals[i].z() << "\n";
+    for (size_t t = 0; t < triangle_count; ++t)
+    {
+        int a = indices[3 * t] + 1, b = indices[3 * t + 1] + 1, c = indices[3 * t + 2] + 1;
+        obj << "f " << a << "//" << a << " " << b << "//" << b << " " << c << "//" << c << "\n";
+    }
+    obj.close();
+
+    std::cout << "\nMesh loading (" << triangle_count << " triangles, " << omp_get_max_threads() << " threads)\n"
+              << std::left << std::setw(10) << "format" << std::right
+              << std::setw(12) << "size [MB]"
+              << std::setw(12) << "parse [ms]"
+              << std::setw(12) << "[MB/s]"
+              << std::setw(12) << "build [ms]"
+              << std::setw(12) << "triangles" << "\n";
+
+    auto material = std::make_shared<Lambertian>(Color{0.5});
+    const char *paths[] = {PROJECT "_mesh.ply", PROJECT "_mesh.obj"};
+    for (const char *path : paths)
+    {
+        MeshLoadStats stats;
+        auto mesh = load_mesh(path, material, TriangleMesh::default_build_options(), &stats);
+        const double megabytes = stats.bytes / 1e6;
+        std::cout << std::left << std::setw(10) << std::string(path).substr(std::string(path).size() - 3) << std::right << std::fixed
+                  << std::setprecision(1)
+                  << std::setw(12) << megabytes
+                  << std::setw(12) << 1e3 * stats.parse_time
+                  << std::setw(12) << megabytes / stats.parse_time
+                  << std::setw(12) << 1e3 * stats.build_time
+                  << std::setw(12) << (mesh ? mesh->triangle_count() : 0) << "\n";
+        std::remove(path);
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    // Image
+    const auto aspect_ratio = ASPECT_RATIO;
+    const int image_width = IMAGE_WIDTH;
+    const int image_height = static_cast<int>(image_width / aspect_ratio);
+
+    // World
+    HitableList scene = random_scene();
+
+    // Camera
+    Point3 lookfrom{13, 2, 3};
+    Point3 lookat{0, 0, 0};
+    Vector3 vup{0, 1, 0};
+    auto dist_to_focus = 10.0;
+    auto aperture = 0.1;
+
+    Camera cam(lookfrom, lookat, vup, 20, aspect_ratio, aperture, dist_to_focus);
+
+    // Rays
+    std::vector<Ray> primary = primary_rays(cam, image_width, image_height);
+    std::vector<Ray> secondary = secondary_rays(primary, BVH{scene});
+
+    std::cout << "Acceleration structures (" << scene.objects().size() << " objects, "
+              << omp_get_max_threads() << " threads)\n"
+              << std::left << std::setw(24) << "structure" << std::right
+              << std::setw(12) << "build [ms]"
+              << std::setw(14) << "primary [M/s]"
+              << std::setw(14) << "second. [M/s]"
+              << std::setw(14) << "occl. [M/s]"
+              << std::setw(10) << "hits (p)"
+              << std::setw(10) << "hits (s)"
+              << std::setw(10) << "hits (o)" << "\n";
+
+    report("HitableList", 0, scene, primary, secondary);
+
+    BVHBuildOptions sah_options;
+    double start = omp_get_wtime();
+    BVH bvh{scene, sah_options};
+    double sah_time = omp_get_wtime() - start;
+    report("BVH (SAH)", sah_time, bvh, primary, secondary);
+
+    BVHBuildOptions lbvh_options;
+    lbvh_options.builder = BVHBuilder::LBVH;
+    start = omp_get_wtime();
+    BVH lbvh{scene, lbvh_options};
+    report("BVH (LBVH)", omp_get_wtime() - start, lbvh, primary, secondary);
+
+    lbvh_options.sah_top_levels = true;
+    start = omp_get_wtime();
+    BVH lbvh_sah{scene, lbvh_options};
+    report("BVH (LBVH + SAH top)", omp_get_wtime() - start, lbvh_sah, primary, secondary);
+
+    // Same scene with the ground sphere replaced by a plane outside the tree
+    HitableList plane_scene = scene;
+    substitute_ground_spheres(plane_scene);
+    start = omp_get_wtime();
+    BVH plane_bvh{plane_scene, sah_options};
+    report("BVH (SAH, ground plane)", omp_get_wtime() - start, plane_bvh, primary, secondary);
+
+    start = omp_get_wtime();
+    BVH4 bvh4{bvh};
+    report("BVH4 (SAH)", sah_time + omp_get_wtime() - start, bvh4, primary, secondary);
+
+    start = omp_get_wtime();
+    BVH8 bvh8{bvh};
+    report("BVH8 (SAH)", sah_time + omp_get_wtime() - start, bvh8, primary, secondary);
+
+    start = omp_get_wtime();
+    UniformGrid grid{scene};
+    report("UniformGrid", omp_get_wtime() - start, grid, primary, secondary);
+
+    packet_benchmark(scene, image_width, image_height);
+    integrator_benchmark(bvh, cam);
+    sampler_benchmark(bvh, cam);
+    std::vector<Color> converged = converged_image(bvh, cam);
+    pattern_benchmark(bvh, cam, converged);
+    adaptive_benchmark(bvh, cam, converged);
+    warp_benchmark();
+    vector_benchmark();
+    dispatch_benchmark(bvh, cam, primary, secondary);
+    instancing_benchmark();
+    refit_benchmark();
+    cache_benchmark();
+    sphere_set_benchmark();
+    triangle_mesh_benchmark();
+    out_of_core_benchmark();
+    arena_benchmark();
+    mesh_loader_benchmark();
+
+    return 0;
+}
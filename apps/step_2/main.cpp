@@ -61,9 +61,9 @@ int main(int argc, char const *argv[])
     const int image_height = static_cast<int>(image_width / aspect_ratio);
 
     // Camera
-    auto viewport_height = 2.0;
-    auto viewport_width = aspect_ratio * viewport_height;
-    auto focal_length = 1.0;
+    number_t viewport_height = 2;
+    number_t viewport_width = aspect_ratio * viewport_height;
+    number_t focal_length = 1;
 
     auto origin = Point3{0};
     auto horizontal = Vector3{viewport_width, 0, 0};
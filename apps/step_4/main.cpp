@@ -59,9 +59,9 @@ int main(int argc, char const *argv[])
     world.add(std::make_shared<Sphere>(Point3{0, -100.5, -1}, 100));
 
     // Camera
-    auto viewport_height = 2.0;
-    auto viewport_width = aspect_ratio * viewport_height;
-    auto focal_length = 1.0;
+    number_t viewport_height = 2;
+    number_t viewport_width = aspect_ratio * viewport_height;
+    number_t focal_length = 1;
 
     auto origin = Point3{0};
     auto horizontal = Vector3{viewport_width, 0, 0};
@@ -51,12 +51,12 @@ Color ray_color(const Ray &r, const Hitable &world, const int depth)
         return Color{0};
 
     // if (world.hit(r, 0, infinity, rec))
-    if (world.hit(r, 1e-3, infinity, rec))
+    if (world.hit(r, spawn_t_min, infinity, rec))
     {
         // Point3 target = rec.p + rec.normal + random_in_unit_sphere();
         // Point3 target = rec.p + rec.normal + norm_random_in_unit_sphere();
         Point3 target = rec.p + random_in_hemisphere(rec.normal);
-        return 0.5 * ray_color(Ray(rec.p, target - rec.p), world, depth - 1);
+        return 0.5 * ray_color(rec.spawn_ray(target - rec.p), world, depth - 1);
     }
 
     Vector3 unit_direction = normalize_Vector3(r.direction());
@@ -52,7 +52,7 @@ Color ray_color(const Ray &r, const Hitable &world, const int depth)
         return Color{0};
 
     // if (world.hit(r, 0, infinity, rec))
-    if (world.hit(r, 1e-3, infinity, rec))
+    if (world.hit(r, spawn_t_min, infinity, rec))
     {
         Ray scattered;
         Color attenuation;
@@ -28,8 +28,10 @@
 
 #include <raytracing/raytracing.h>
 #include <raytracing/utils.h>
+#include <raytracing/sampler.h>
 #include <raytracing/color.h>
 #include <raytracing/hitable_list.h>
+#include <raytracing/bvh.h>
 #include <raytracing/sphere.h>
 #include <raytracing/camera.h>
 #include <raytracing/material.h>
@@ -43,7 +45,7 @@ Vector3 random_in_hemisphere(const Vector3 &normal)
         return -in_unit_sphere;
 }
 
-Color ray_color(const Ray &r, const Hitable &world, const int depth)
+Color ray_color(const Ray &r, const Hitable &world, const int depth, Sampler &sampler)
 {
     HitRecord rec;
 
@@ -52,12 +54,13 @@ Color ray_color(const Ray &r, const Hitable &world, const int depth)
         return Color{0};
 
     // if (world.hit(r, 0, infinity, rec))
-    if (world.hit(r, 1e-3, infinity, rec))
+    if (world.hit(r, spawn_t_min, infinity, rec))
     {
         Ray scattered;
         Color attenuation;
-        if (rec.material->scatter(r, rec, attenuation, scattered))
-            return attenuation * ray_color(scattered, world, depth - 1);
+        sampler.next_bounce();
+        if (rec.material->scatter(r, rec, attenuation, scattered, sampler))
+            return attenuation * ray_color(scattered, world, depth - 1, sampler);
 
         return Color{0};
     }
@@ -132,7 +135,7 @@ int main(int argc, char const *argv[])
     const int max_depth = MAX_DEPTH;
 
     // World
-    HitableList world = random_scene();
+    BVH world{random_scene()};
 
     // Camera
     Point3 lookfrom{13, 2, 3};
@@ -153,16 +156,19 @@ int main(int argc, char const *argv[])
         --row_counter;
         std::cout << (ParallelStream() << "\rScanlines remaining: " << row_counter << ' ').toString() << std::flush;
 
+        // One stream per pixel sample, so the image does not depend on the threads
+        Sampler sampler{0, SamplePattern::SAMPLE_PATTERN, image_width};
         for (int i = 0; i < image_width; ++i)
         {
             pixel[j * image_width + i] = Color{0, 0, 0};
 
             for (int s = 0; s < samples_per_pixel; ++s)
             {
-                auto u = (i + random_number_t()) / (image_width - 1);
-                auto v = (j + random_number_t()) / (image_height - 1);
-                Ray r = cam.get_ray(u, v);
-                pixel[j * image_width + i] += ray_color(r, world, max_depth);
+                sampler.start(j * image_width + i, s);
+                auto u = (i + random_number_t(sampler)) / (image_width - 1);
+                auto v = (j + random_number_t(sampler)) / (image_height - 1);
+                Ray r = cam.get_ray(u, v, sampler);
+                pixel[j * image_width + i] += ray_color(r, world, max_depth, sampler);
             }
         }
     }
@@ -20,20 +20,29 @@
 // OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 // SOFTWARE.
 #include <stdlib.h>
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <omp.h>
 #define PROJECT_FILE PROJECT ".ppm"
 #define PROJECT_IMAGE "convert " PROJECT_FILE " " PROJECT ".png; rm " PROJECT_FILE
+#define SAMPLES_FILE PROJECT "_samples.ppm"
+#define SAMPLES_IMAGE "convert " SAMPLES_FILE " " PROJECT "_samples.png; rm " SAMPLES_FILE
 
 #include <raytracing/raytracing.h>
 #include <raytracing/utils.h>
+#include <raytracing/sampler.h>
 #include <raytracing/color.h>
 #include <raytracing/hitable_list.h>
+#include <raytracing/scene_arena.h>
+#include <raytracing/bvh.h>
 #include <raytracing/sphere.h>
 #include <raytracing/camera.h>
 #include <raytracing/material.h>
+#include <raytracing/dispatch.h>
 #include <raytracing/texture.h>
+#include <raytracing/adaptive.h>
+#include <raytracing/scene_builder.h>
 
 Vector3 random_in_hemisphere(const Vector3 &normal)
 {
@@ -44,7 +53,27 @@ Vector3 random_in_hemisphere(const Vector3 &normal)
         return -in_unit_sphere;
 }
 
-Color ray_color(const Ray &r, const Hitable &world, const int depth)
+Color ray_color(const Ray &r, const Hitable &world, const int depth, Sampler &sampler);
+
+Color background_color(const Ray &r)
+{
+    Vector3 unit_direction = normalize_Vector3(r.direction());
+    auto t = 0.5 * (unit_direction.y() + 1.0);
+    return (1.0 - t) * Color{1} + t * Color{0.5, 0.7, 1};
+}
+
+Color hit_color(const Ray &r, const HitRecord &rec, const Hitable &world, const int depth, Sampler &sampler)
+{
+    Ray scattered;
+    Color attenuation;
+    sampler.next_bounce();
+    if (dispatch_scatter(*rec.material, r, rec, attenuation, scattered, sampler))
+        return attenuation * ray_color(scattered, world, depth - 1, sampler);
+
+    return Color{0};
+}
+
+Color ray_color(const Ray &r, const Hitable &world, const int depth, Sampler &sampler)
 {
     HitRecord rec;
 
@@ -53,48 +82,19 @@ Color ray_color(const Ray &r, const Hitable &world, const int depth)
         return Color{0};
 
     // if (world.hit(r, 0, infinity, rec))
-    if (world.hit(r, 1e-3, infinity, rec))
-    {
-        Ray scattered;
-        Color attenuation;
-        if (rec.material->scatter(r, rec, attenuation, scattered))
-            return attenuation * ray_color(scattered, world, depth - 1);
+    if (world.hit(r, spawn_t_min, infinity, rec))
+        return hit_color(r, rec, world, depth, sampler);
 
-        return Color{0};
-    }
-
-    Vector3 unit_direction = normalize_Vector3(r.direction());
-    auto t = 0.5 * (unit_direction.y() + 1.0);
-    return (1.0 - t) * Color{1} + t * Color{0.5, 0.7, 1};
+    return background_color(r);
 }
 
-class CheckerTexture : public Texture
-{
-    std::shared_ptr<Texture> _even;
-    std::shared_ptr<Texture> _odd;
-
-public:
-    CheckerTexture(const std::shared_ptr<Texture> _even, const std::shared_ptr<Texture> _odd)
-        : _even(_even), _odd(_odd) {}
-    CheckerTexture(const Color &c1, const Color &c2)
-        : _even(std::make_shared<SolidColor>(c1)), _odd(std::make_shared<SolidColor>(c2)) {}
-
-    virtual Color value(double u, double v, const Point3 &p) const override
-    {
-        auto sines = sin(10 * p.x()) * sin(10 * p.y()) * sin(10 * p.z());
-        if (sines < 0)
-            return _odd->value(u, v, p);
-        else
-            return _even->value(u, v, p);
-    }
-};
-
-HitableList random_scene()
+HitableList random_scene(SceneArena &arena)
 {
     HitableList world;
 
-    auto checker = std::make_shared<CheckerTexture>(Color{0.2, 0.3, 0.1}, Color{0.9, 0.9, 0.9});
-    world.add(std::make_shared<Sphere>(Point3{0, -1000, 0}, 1000, std::make_shared<Lambertian>(checker)));
+    auto checker = arena.make<CheckerTexture>(arena.make<SolidColor>(Color{0.2, 0.3, 0.1}),
+                                              arena.make<SolidColor>(Color{0.9, 0.9, 0.9}));
+    world.add(arena.make<Sphere>(Point3{0, -1000, 0}, 1000, arena.make<Lambertian>(checker)));
 
     for (int a = -11; a < 11; ++a)
     {
@@ -111,35 +111,35 @@ HitableList random_scene()
                 {
                     // diffuse
                     auto albedo = random_Vector3() * random_Vector3();
-                    sphere_material = std::make_shared<Lambertian>(albedo);
-                    world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
+                    sphere_material = arena.make<Lambertian>(arena.make<SolidColor>(albedo));
+                    world.add(arena.make<Sphere>(center, 0.2, sphere_material));
                 }
                 else if (choose_mat < 0.95)
                 {
                     // Metal
                     auto albedo = random_Vector3(0.5, 1);
                     auto fuzz = random_number_t(0, 0.5);
-                    sphere_material = std::make_shared<Metal>(albedo, fuzz);
-                    world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
+                    sphere_material = arena.make<Metal>(albedo, fuzz);
+                    world.add(arena.make<Sphere>(center, 0.2, sphere_material));
                 }
                 else
                 {
                     // glass
-                    sphere_material = std::make_shared<Dielectric>(1.5);
-                    world.add(std::make_shared<Sphere>(center, 0.2, sphere_material));
+                    sphere_material = arena.make<Dielectric>(1.5);
+                    world.add(arena.make<Sphere>(center, 0.2, sphere_material));
                 }
             }
         }
     }
 
-    auto material1 = std::make_shared<Dielectric>(1.5);
-    world.add(std::make_shared<Sphere>(Point3{0, 1, 0}, 1.0, material1));
+    auto material1 = arena.make<Dielectric>(1.5);
+    world.add(arena.make<Sphere>(Point3{0, 1, 0}, 1.0, material1));
 
-    auto material2 = std::make_shared<Lambertian>(Color(0.4, 0.2, 0.1));
-    world.add(std::make_shared<Sphere>(Point3{-4, 1, 0}, 1.0, material2));
+    auto material2 = arena.make<Lambertian>(arena.make<SolidColor>(Color(0.4, 0.2, 0.1)));
+    world.add(arena.make<Sphere>(Point3{-4, 1, 0}, 1.0, material2));
 
-    auto material3 = std::make_shared<Metal>(Color(0.7, 0.6, 0.5), 0.0);
-    world.add(std::make_shared<Sphere>(Point3{4, 1, 0}, 1.0, material3));
+    auto material3 = arena.make<Metal>(Color(0.7, 0.6, 0.5), 0.0);
+    world.add(arena.make<Sphere>(Point3{4, 1, 0}, 1.0, material3));
 
     return world;
 }
@@ -153,41 +153,136 @@ int main(int argc, char const *argv[])
     const int samples_per_pixel = SAMPLES_PER_PIXEL;
     const int max_depth = MAX_DEPTH;
 
-    // World
-    HitableList world = random_scene();
+    // World, the arena outlives it. The ground sphere becomes a plane, which
+    // stays out of the tree and gives it the tight bounds of the small spheres.
+    SceneArena arena;
+    HitableList scene = random_scene(arena);
+    substitute_ground_spheres(scene);
+    BVH world{scene};
 
     // Camera
     Point3 lookfrom{13, 2, 3};
     Point3 lookat{0, 0, 0};
     Vector3 vup{0, 1, 0};
     auto dist_to_focus = 10.0;
+#if defined(RAYTRACING_PINHOLE_CAMERA)
+    auto aperture = 0.0;
+#else
     auto aperture = 0.1;
+#endif
 
     Camera cam(lookfrom, lookat, vup, 20, aspect_ratio, aperture, dist_to_focus);
 
     // Render
     Color *pixel = (Color *)malloc(sizeof(Color) * image_width * image_height);
-    int row_counter = image_height;
 
-#pragma omp parallel for
-    for (int j = image_height - 1; j >= 0; --j)
+#if defined(RAYTRACING_ADAPTIVE_SAMPLING)
+    // Samples go to the noisiest pixels; each sum is scaled to
+    // samples_per_pixel samples for the output below
+    std::vector<PixelEstimate> estimates;
+    render_adaptive(
+        image_width * image_height, samples_per_pixel, AdaptiveOptions{},
+        [&](int p, int s) {
+            Sampler sampler{0, SamplePattern::SAMPLE_PATTERN, image_width};
+            sampler.start(p, s);
+            auto u = (p % image_width + random_number_t(sampler)) / (image_width - 1);
+            auto v = (p / image_width + random_number_t(sampler)) / (image_height - 1);
+            return ray_color(cam.get_ray(u, v, sampler), world, max_depth, sampler);
+        },
+        estimates);
+
+    for (int p = 0; p < image_width * image_height; ++p)
+        pixel[p] = estimates[p].sum() * (static_cast<number_t>(samples_per_pixel) / estimates[p].count());
+
+#if defined(RAYTRACING_SAMPLE_COUNT_IMAGE)
+    std::ofstream samples_file;
+    samples_file.open(SAMPLES_FILE);
+    bool samples_written = write_sample_counts(samples_file, estimates, image_width, image_height);
+    samples_file.close();
+    if (samples_written)
+        system(SAMPLES_IMAGE);
+#endif
+#else
+    if (cam.is_pinhole())
     {
-        --row_counter;
-        std::cout << (ParallelStream() << "\rScanlines remaining: " << row_counter << ' ').toString() << std::flush;
-
-        for (int i = 0; i < image_width; ++i)
+        // Trace the primary rays of 8x8 pixel tiles as packets
+        const int tile_size = 8;
+        const int tiles_x = (image_width + tile_size - 1) / tile_size;
+        const int tiles_y = (image_height + tile_size - 1) / tile_size;
+        int tile_counter = tiles_x * tiles_y;
+
+#pragma omp parallel for schedule(dynamic)
+        for (int t = 0; t < tiles_x * tiles_y; ++t)
         {
-            pixel[j * image_width + i] = Color{0, 0, 0};
+            --tile_counter;
+            std::cout << (ParallelStream() << "\rTiles remaining: " << tile_counter << ' ').toString() << std::flush;
+
+            const int i0 = (t % tiles_x) * tile_size, i1 = std::min(i0 + tile_size, image_width);
+            const int j0 = (t / tiles_x) * tile_size, j1 = std::min(j0 + tile_size, image_height);
+
+            RayPacket packet;
+            HitRecord recs[RAY_PACKET_SIZE];
+            bool hits[RAY_PACKET_SIZE];
+            Sampler samplers[RAY_PACKET_SIZE];
+            std::fill(samplers, samplers + RAY_PACKET_SIZE, Sampler{0, SamplePattern::SAMPLE_PATTERN, image_width});
+
+            for (int j = j0; j < j1; ++j)
+                for (int i = i0; i < i1; ++i)
+                    pixel[j * image_width + i] = Color{0, 0, 0};
 
             for (int s = 0; s < samples_per_pixel; ++s)
             {
-                auto u = (i + random_number_t()) / (image_width - 1);
-                auto v = (j + random_number_t()) / (image_height - 1);
-                Ray r = cam.get_ray(u, v);
-                pixel[j * image_width + i] += ray_color(r, world, max_depth);
+                packet.clear();
+                for (int j = j0; j < j1; ++j)
+                {
+                    for (int i = i0; i < i1; ++i)
+                    {
+                        Sampler &sampler = samplers[packet.size];
+                        sampler.start(j * image_width + i, s);
+                        auto u = (i + random_number_t(sampler)) / (image_width - 1);
+                        auto v = (j + random_number_t(sampler)) / (image_height - 1);
+                        packet.add(cam.get_ray(u, v, sampler));
+                    }
+                }
+                packet.update_bounds();
+                world.hit_packet(packet, spawn_t_min, infinity, recs, hits);
+
+                int k = 0;
+                for (int j = j0; j < j1; ++j)
+                    for (int i = i0; i < i1; ++i, ++k)
+                        pixel[j * image_width + i] += hits[k] ? hit_color(packet.rays[k], recs[k], world, max_depth,
+                                                                          samplers[k])
+                                                              : background_color(packet.rays[k]);
+            }
+        }
+    }
+    else
+    {
+        int row_counter = image_height;
+
+#pragma omp parallel for
+        for (int j = image_height - 1; j >= 0; --j)
+        {
+            --row_counter;
+            std::cout << (ParallelStream() << "\rScanlines remaining: " << row_counter << ' ').toString() << std::flush;
+
+            Sampler sampler{0, SamplePattern::SAMPLE_PATTERN, image_width};
+            for (int i = 0; i < image_width; ++i)
+            {
+                pixel[j * image_width + i] = Color{0, 0, 0};
+
+                for (int s = 0; s < samples_per_pixel; ++s)
+                {
+                    sampler.start(j * image_width + i, s);
+                    auto u = (i + random_number_t(sampler)) / (image_width - 1);
+                    auto v = (j + random_number_t(sampler)) / (image_height - 1);
+                    Ray r = cam.get_ray(u, v, sampler);
+                    pixel[j * image_width + i] += ray_color(r, world, max_depth, sampler);
+                }
             }
         }
     }
+#endif
 
     // Output
     std::ofstream file;
@@ -0,0 +1,992 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <stdlib.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <raytracing/raytracing.h>
+#include <raytracing/utils.h>
+#include <raytracing/sampler.h>
+#include <raytracing/hitable_list.h>
+#include <raytracing/bvh.h>
+#include <raytracing/bvh_cache.h>
+#include <raytracing/packet.h>
+#include <raytracing/wide_bvh.h>
+#include <raytracing/grid.h>
+#include <raytracing/instance.h>
+#include <raytracing/transform.h>
+#include <raytracing/sphere.h>
+#include <raytracing/sphere_set.h>
+#include <raytracing/plane.h>
+#include <raytracing/quad.h>
+#include <raytracing/box.h>
+#include <raytracing/triangle_mesh.h>
+#include <raytracing/out_of_core_mesh.h>
+#include <raytracing/mesh_loader.h>
+#include <raytracing/scene_builder.h>
+#include <raytracing/material.h>
+#include <raytracing/material_table.h>
+#include <raytracing/adaptive.h>
+#include <raytracing/texture.h>
+
+// Consistency checks between primitives, acceleration structures and their
+// reference implementations. Every check prints its number of mismatches, the
+// exit code tells ctest whether any check failed.
+
+int failed_checks = 0;
+
+void report(const std::string &name, const long mismatches, const long total)
+{
+    std::cout << std::left << std::setw(56) << name << std::right << std::setw(8) << mismatches << " of "
+              << std::setw(8) << total << (mismatches ? "  FAILED" : "") << std::endl;
+    if (mismatches)
+        ++failed_checks;
+}
+
+Vector3 random_direction(Sampler &sampler)
+{
+    while (true)
+    {
+        Vector3 d{random_number_t(sampler, -1, 1), random_number_t(sampler, -1, 1), random_number_t(sampler, -1, 1)};
+        if (d.length_squared() > 1e-6 && d.length_squared() <= 1)
+            return normalize_Vector3(d);
+    }
+}
+
+Point3 random_point(Sampler &sampler, const Point3 &lo, const Point3 &hi)
+{
+    return Point3{random_number_t(sampler, lo.x(), hi.x()), random_number_t(sampler, lo.y(), hi.y()),
+                  random_number_t(sampler, lo.z(), hi.z())};
+}
+
+// Torus around the y axis with normals and texture coordinates
+std::shared_ptr<TriangleMesh> make_torus(const int rings, const int sides, MaterialPtr material)
+{
+    std::vector<Point3> vertices;
+    std::vector<Vector3> normals;
+    std::vector<number_t> uvs;
+    std::vector<int> indices;
+    for (int i = 0; i < rings; ++i)
+    {
+        number_t phi = 2 * pi * i / rings;
+        for (int j = 0; j < sides; ++j)
+        {
+            number_t theta = 2 * pi * j / sides;
+            Vector3 n{std::cos(phi) * std::cos(theta), std::sin(theta), std::sin(phi) * std::cos(theta)};
+            vertices.push_back(Point3{2 * std::cos(phi), 0, 2 * std::sin(phi)} + 0.6 * n);
+            normals.push_back(n);
+            uvs.push_back(static_cast<number_t>(i) / rings);
+            uvs.push_back(static_cast<number_t>(j) / sides);
+
+            int a = i * sides + j, b = i * sides + (j + 1) % sides;
+            int c = (i + 1) % rings * sides + j, d = (i + 1) % rings * sides + (j + 1) % sides;
+            indices.insert(indices.end(), {a, b, d, a, d, c});
+        }
+    }
+    return std::make_shared<TriangleMesh>(vertices, indices, material, normals, uvs);
+}
+
+// Texture coordinates as color, so that materials using it need them
+class UVTexture : public Texture
+{
+public:
+    virtual Color value(number_t u, number_t v, const Point3 & /*p*/) const override { return Color{u, v, 0}; }
+};
+
+// Results of the same computation must be bit-identical, the library and the
+// tests are built without floating point contraction for this
+bool same_vector(const Vector3 &a, const Vector3 &b)
+{
+    return a.x() == b.x() && a.y() == b.y() && a.z() == b.z();
+}
+
+bool same_record(const HitRecord &a, const HitRecord &b)
+{
+    bool uv = !a.material || !a.material->needs_uv() || (a.u == b.u && a.v == b.v);
+    return a.t == b.t && same_vector(a.p, b.p) && same_vector(a.normal, b.normal) &&
+           a.front_face == b.front_face && a.error == b.error && a.material == b.material &&
+           a.object == b.object && a.instance == b.instance && a.primitive == b.primitive && uv;
+}
+
+bool same_surface(const HitRecord &a, const HitRecord &b)
+{
+    return std::fabs(a.t - b.t) <= 1e-6 * (1 + a.t) && (a.normal - b.normal).length() <= 1e-6 &&
+           a.front_face == b.front_face;
+}
+
+// An analytic primitive against the TriangleMesh of the same surface: same
+// hits, distances and normals, occluded() agreeing with hit(), and rays
+// spawned away from a hit never hitting the surface they leave.
+void check_against_mesh(const std::string &name, const Hitable &primitive, const Hitable &mesh, const bool convex,
+                        Sampler &sampler)
+{
+    const int count = 200000;
+    long hit_mismatches = 0, occluded_mismatches = 0, self_hits = 0;
+    for (int k = 0; k < count; ++k)
+    {
+        Ray r{random_point(sampler, Point3{-3}, Point3{3}), random_direction(sampler)};
+        HitRecord a, b;
+        bool hit_a = primitive.hit(r, spawn_t_min, infinity, a);
+        bool hit_b = mesh.hit(r, spawn_t_min, infinity, b);
+        if (hit_a != hit_b || (hit_a && !same_surface(a, b)))
+            ++hit_mismatches;
+        if (primitive.occluded(r, spawn_t_min, infinity) != hit_a)
+            ++occluded_mismatches;
+        if (!hit_a || (convex && !a.front_face))
+            continue;
+
+        // The normal faces the ray origin, leaving along it is leaving the surface
+        Vector3 d = random_direction(sampler);
+        if (d.dot(a.normal) < 0)
+            d = -d;
+        HitRecord c;
+        if (primitive.hit(a.spawn_ray(d), spawn_t_min, infinity, c))
+            ++self_hits;
+    }
+    report(name + " vs TriangleMesh: hit, t, normal", hit_mismatches, count);
+    report(name + ": occluded vs hit", occluded_mismatches, count);
+    report(name + ": spawned rays hitting their surface", self_hits, count);
+}
+
+void primitive_checks(Sampler &sampler)
+{
+    auto material = std::make_shared<Lambertian>(Color{0.5});
+
+    Point3 q{-1, 0.3, -2};
+    Vector3 u{2, 0.5, 0.2}, v{-0.3, 0.1, 1.7};
+    Quad quad{q, u, v, material};
+    TriangleMesh quad_mesh{{q, q + u, q + u + v, q + v}, {0, 1, 2, 0, 2, 3}, material};
+    check_against_mesh("Quad", quad, quad_mesh, false, sampler);
+
+    Point3 lo{-0.5, -1, 0.25}, hi{0.75, 0.4, 1.5};
+    Box box{lo, hi, material};
+    std::vector<Point3> corners;
+    for (int i = 0; i < 8; ++i)
+        corners.push_back(Point3{i & 1 ? hi.x() : lo.x(), i & 2 ? hi.y() : lo.y(), i & 4 ? hi.z() : lo.z()});
+    TriangleMesh box_mesh{corners,
+                          {0, 2, 3, 0, 3, 1, 4, 5, 7, 4, 7, 6, 0, 1, 5, 0, 5, 4,
+                           2, 6, 7, 2, 7, 3, 0, 4, 6, 0, 6, 2, 1, 3, 7, 1, 7, 5},
+                          material};
+    check_against_mesh("Box", box, box_mesh, true, sampler);
+}
+
+// Every acceleration structure against a brute-force list over a ground
+// plane, spheres, quads, boxes and a rotated instance: the same closest
+// primitive at the same distance, and the same occlusion.
+void structure_checks(Sampler &sampler)
+{
+    auto material = std::make_shared<Lambertian>(Color{0.5});
+    HitableList list;
+    list.add(std::make_shared<Plane>(Point3{0}, Vector3{0, 1, 0}, material));
+    for (int i = 0; i < 300; ++i)
+    {
+        Point3 c = random_point(sampler, Point3{-10, 0, -10}, Point3{10, 3, 10});
+        if (i % 3 == 0)
+            list.add(std::make_shared<Sphere>(c, 0.3, material));
+        else if (i % 3 == 1)
+            list.add(std::make_shared<Quad>(c, 0.5 * random_direction(sampler), 0.5 * random_direction(sampler),
+                                            material));
+        else
+            list.add(std::make_shared<Box>(c, c + Vector3{0.4, 0.3, 0.5}, material));
+    }
+    list.add(std::make_shared<Instance>(std::make_shared<Box>(Point3{-1, 0, -1}, Point3{1}, material),
+                                        rotate_Transform(Vector3{0, 1, 0}, 30) *
+                                            translate_Transform(Vector3{0, 0.5, 0})));
+
+    BVH sah{list};
+    BVHBuildOptions lbvh_options;
+    lbvh_options.builder = BVHBuilder::LBVH;
+    BVH lbvh{list, lbvh_options};
+    BVH4 bvh4{sah};
+    BVH8 bvh8{sah};
+    UniformGrid grid{list};
+    UniformGrid clamped_grid{list, 0, -2, 5};
+    const Hitable *structures[] = {&sah, &lbvh, &bvh4, &bvh8, &grid, &clamped_grid};
+    const char *names[] = {"BVH (SAH)", "BVH (LBVH)", "BVH4", "BVH8", "UniformGrid", "UniformGrid (0 x -2 x 5)"};
+    const int structure_count = sizeof(structures) / sizeof(structures[0]);
+
+    const int count = 100000;
+    std::vector<long> hit_mismatches(structure_count), occluded_mismatches(structure_count);
+    for (int k = 0; k < count; ++k)
+    {
+        Ray r{random_point(sampler, Point3{-15, 0.01, -15}, Point3{15, 6, 15}), random_direction(sampler)};
+        HitRecord expected;
+        bool expected_hit = list.hit(r, spawn_t_min, infinity, expected);
+        bool expected_occluded = list.occluded(r, spawn_t_min, infinity);
+        for (int s = 0; s < structure_count; ++s)
+        {
+            HitRecord rec;
+            bool hit = structures[s]->hit(r, spawn_t_min, infinity, rec);
+            if (hit != expected_hit || (hit && (rec.t != expected.t || rec.object != expected.object)))
+                ++hit_mismatches[s];
+            if (structures[s]->occluded(r, spawn_t_min, infinity) != expected_occluded)
+                ++occluded_mismatches[s];
+        }
+    }
+    report("UniformGrid: resolution raised to one cell",
+           clamped_grid.resolution(0) != 1 || clamped_grid.resolution(1) != 1 || clamped_grid.resolution(2) != 5, 1);
+    for (int s = 0; s < structure_count; ++s)
+    {
+        report(std::string(names[s]) + " vs HitableList: closest hit", hit_mismatches[s], count);
+        report(std::string(names[s]) + " vs HitableList: occluded", occluded_mismatches[s], count);
+    }
+}
+
+// BVH::hit_packet against tracing each ray with hit(), over a ground plane
+// left out of the tree and the objects of structure_checks: tiles of a
+// pinhole camera, the same directions from spread origins, and unrelated
+// rays that take the fallback. Packets of every size up to a full tile.
+void packet_checks(Sampler &sampler)
+{
+    auto material = std::make_shared<Lambertian>(Color{0.5});
+    HitableList list;
+    list.add(std::make_shared<Plane>(Point3{0}, Vector3{0, 1, 0}, material));
+    for (int i = 0; i < 300; ++i)
+    {
+        Point3 c = random_point(sampler, Point3{-10, 0, -10}, Point3{10, 3, 10});
+        if (i % 3 == 0)
+            list.add(std::make_shared<Sphere>(c, 0.3, material));
+        else if (i % 3 == 1)
+            list.add(std::make_shared<Quad>(c, 0.5 * random_direction(sampler), 0.5 * random_direction(sampler),
+                                            material));
+        else
+            list.add(std::make_shared<Box>(c, c + Vector3{0.4, 0.3, 0.5}, material));
+    }
+    BVH bvh{list};
+
+    const char *names[] = {"pinhole tiles", "spread origins", "incoherent rays"};
+    const int count = 30000;
+    long mismatches[3] = {0, 0, 0}, rays[3] = {0, 0, 0};
+    for (int n = 0; n < count; ++n)
+    {
+        const int kind = n % 3;
+        const int size = 1 + n / 3 % RAY_PACKET_SIZE;
+        Point3 eye = random_point(sampler, Point3{-15, 0.5, -15}, Point3{15, 6, 15});
+        Vector3 forward = random_direction(sampler);
+        Vector3 right = normalize_Vector3(cross_Vector3(forward, random_direction(sampler)));
+        Vector3 up = cross_Vector3(right, forward);
+
+        RayPacket packet;
+        for (int k = 0; k < size; ++k)
+        {
+            Vector3 d = forward + static_cast<number_t>(0.02) * ((k % 8 - 3.5) * right + (k / 8 - 3.5) * up);
+            if (kind == 0)
+                packet.add(Ray{eye, d});
+            else if (kind == 1)
+                packet.add(Ray{eye + 0.2 * random_direction(sampler), d});
+            else
+                packet.add(Ray{random_point(sampler, Point3{-15, 0.5, -15}, Point3{15, 6, 15}),
+                               random_direction(sampler)});
+        }
+        packet.update_bounds();
+
+        HitRecord recs[RAY_PACKET_SIZE];
+        bool hits[RAY_PACKET_SIZE];
+        bvh.hit_packet(packet, spawn_t_min, infinity, recs, hits);
+        for (int k = 0; k < size; ++k)
+        {
+            HitRecord rec;
+            bool hit = bvh.hit(packet.rays[k], spawn_t_min, infinity, rec);
+            if (hit != hits[k] || (hit && (rec.t != recs[k].t || rec.object != recs[k].object ||
+                                           rec.primitive != recs[k].primitive)))
+                ++mismatches[kind];
+        }
+        rays[kind] += size;
+    }
+    for (int kind = 0; kind < 3; ++kind)
+        report(std::string("BVH::hit_packet vs hit: ") + names[kind], mismatches[kind], rays[kind]);
+}
+
+// BVH::refit and BVH::update after moving spheres with set_center, against a
+// BVH built from scratch: the same closest hits. The spheres drift a little,
+// those of one corner are scattered over a quarter of the scene, so update()
+// rebuilds the subtrees holding them. With a growth limit of zero it rebuilds
+// the whole tree, which has to keep the ground plane outside it.
+void refit_checks(Sampler &sampler)
+{
+    auto material = std::make_shared<Lambertian>(Color{0.5});
+    HitableList list;
+    list.add(std::make_shared<Plane>(Point3{0}, Vector3{0, 1, 0}, material));
+    std::vector<std::shared_ptr<Sphere>> spheres;
+    for (int i = 0; i < 4000; ++i)
+    {
+        auto sphere = std::make_shared<Sphere>(random_point(sampler, Point3{-20, 0, -20}, Point3{20, 4, 20}), 0.2,
+                                               material);
+        spheres.push_back(sphere);
+        list.add(sphere);
+    }
+    BVH refitted{list}, updated{list}, rebuilt{list};
+
+    for (const auto &sphere : spheres)
+    {
+        Point3 c = sphere->center();
+        if (c.x() < -16 && c.z() < -16)
+            sphere->set_center(random_point(sampler, Point3{-20, 0, -20}, Point3{0, 4, 0}));
+        else
+            sphere->set_center(c + 0.3 * random_direction(sampler));
+    }
+    refitted.refit();
+    const int rebuilt_subtrees = updated.update();
+    const int all_subtrees = rebuilt.update(0);
+    BVH fresh{list};
+
+    const BVH *structures[] = {&refitted, &updated, &rebuilt};
+    const char *names[] = {"BVH::refit", "BVH::update (subtrees)", "BVH::update (whole tree)"};
+    const int count = 100000;
+    long mismatches[3] = {0, 0, 0};
+    for (int k = 0; k < count; ++k)
+    {
+        Ray r{random_point(sampler, Point3{-25, 0.01, -25}, Point3{25, 6, 25}), random_direction(sampler)};
+        HitRecord expected;
+        bool expected_hit = fresh.hit(r, spawn_t_min, infinity, expected);
+        for (int s = 0; s < 3; ++s)
+        {
+            HitRecord rec;
+            bool hit = structures[s]->hit(r, spawn_t_min, infinity, rec);
+            if (hit != expected_hit || (hit && (rec.t != expected.t || rec.object != expected.object)))
+                ++mismatches[s];
+        }
+    }
+    report("BVH::update: only the scattered subtrees rebuilt",
+           rebuilt_subtrees <= 0 || rebuilt_subtrees >= all_subtrees, 1);
+    report("BVH::update: ground plane kept out of the rebuilt tree",
+           rebuilt.unbounded().size() != 1 || rebuilt.objects().size() != spheres.size(), 1);
+    for (int s = 0; s < 3; ++s)
+        report(std::string(names[s]) + " vs fresh BVH: closest hit", mismatches[s], count);
+}
+
+// The ground sphere of the book becomes the plane touching it below the small
+// spheres, a sky dome enclosing the scene stays.
+void ground_substitution_checks(Sampler &sampler)
+{
+    auto material = std::make_shared<Lambertian>(Color{0.5});
+    HitableList world;
+    world.add(std::make_shared<Sphere>(Point3{0, -1000, 0}, 1000, material));
+    for (int i = 0; i < 50; ++i)
+        world.add(std::make_shared<Sphere>(random_point(sampler, Point3{-11, 0.2, -11}, Point3{11, 0.2, 11}), 0.2,
+                                           material));
+    world.add(std::make_shared<Sphere>(Point3{0}, 1e5, material));
+
+    int replaced = substitute_ground_spheres(world);
+    long mismatches = replaced != 1 || world.objects().size() != 52;
+    int planes = 0;
+    const number_t tolerance = 64 * std::numeric_limits<number_t>::epsilon();
+    for (const auto &object : world.objects())
+    {
+        if (object->type() != HitableType::Plane)
+            continue;
+        const Plane &plane = static_cast<const Plane &>(*object);
+        ++planes;
+        Vector3 radial = plane.point() - Point3{0, -1000, 0};
+        if (std::fabs(radial.length() - 1000) > 1000 * tolerance ||
+            (plane.normal() - radial / 1000).length() > tolerance || plane.normal().y() < 0.999 ||
+            plane.material() != material)
+            ++mismatches;
+    }
+    report("substitute_ground_spheres: ground plane, dome kept", mismatches + (planes != 1), 1);
+}
+
+// Records completed only for the closest hit, by HitableList and BVH, against
+// completing every closer candidate as soon as it is found: bit-identical,
+// including texture coordinates where the material reads them.
+void deferred_completion_checks(Sampler &sampler)
+{
+    auto solid = std::make_shared<Lambertian>(Color{0.5});
+    auto textured = std::make_shared<Lambertian>(std::make_shared<UVTexture>());
+    HitableList list;
+    list.add(std::make_shared<Plane>(Point3{0, -1, 0}, Vector3{0, 1, 0}, textured));
+    for (int i = 0; i < 200; ++i)
+    {
+        Point3 c = random_point(sampler, Point3{-6, 0, -6}, Point3{6, 3, 6});
+        MaterialPtr material = i % 2 ? solid : textured;
+        if (i % 4 < 2)
+            list.add(std::make_shared<Sphere>(c, 0.3, material));
+        else if (i % 4 == 2)
+            list.add(std::make_shared<Quad>(c, 0.5 * random_direction(sampler), 0.5 * random_direction(sampler),
+                                            material));
+        else
+            list.add(std::make_shared<Box>(c, c + Vector3{0.4, 0.3, 0.5}, material));
+    }
+    list.add(make_torus(40, 20, textured));
+    list.add(std::make_shared<Instance>(make_torus(20, 10, solid), translate_Transform(Vector3{0, 2, 0}), textured));
+    list.add(std::make_shared<Instance>(std::make_shared<Sphere>(Point3{0}, 1, solid),
+                                        rotate_Transform(Vector3{1, 0, 0}, 40) * scale_Transform(0.8)));
+    BVH bvh{list};
+
+    const int count = 100000;
+    long list_mismatches = 0, bvh_mismatches = 0;
+    for (int k = 0; k < count; ++k)
+    {
+        Ray r{random_point(sampler, Point3{-8, 0, -8}, Point3{8, 5, 8}), random_direction(sampler)};
+
+        HitRecord expected;
+        bool expected_hit = false;
+        number_t closest = infinity;
+        for (const auto &object : list.objects())
+        {
+            HitRecord candidate;
+            if (object->hit(r, spawn_t_min, closest, candidate))
+            {
+                expected_hit = true;
+                closest = candidate.t;
+                expected = candidate;
+            }
+        }
+
+        HitRecord rec;
+        bool hit = list.hit(r, spawn_t_min, infinity, rec);
+        if (hit != expected_hit || (hit && !same_record(expected, rec)))
+            ++list_mismatches;
+        hit = bvh.hit(r, spawn_t_min, infinity, rec);
+        if (hit != expected_hit || (hit && !same_record(expected, rec)))
+            ++bvh_mismatches;
+    }
+    report("HitableList vs completing every candidate", list_mismatches, count);
+    report("BVH vs completing every candidate", bvh_mismatches, count);
+}
+
+// Materials referenced by handle resolve to the pointers they were added as:
+// a MaterialTable deduplicates them, and a SphereSet returns the same hits
+// and materials as a BVH over its spheres.
+void material_checks(Sampler &sampler)
+{
+    std::vector<MaterialPtr> materials;
+    for (int i = 0; i < 8; ++i)
+        materials.push_back(std::make_shared<Lambertian>(Color{number_t(i) / 8}));
+
+    MaterialTable table;
+    long table_mismatches = table.add(NULL) != NO_MATERIAL || table.get(NO_MATERIAL) != NULL;
+    for (int round = 0; round < 2; ++round)
+        for (int i = 0; i < 8; ++i)
+            if (table.add(materials[i]) != static_cast<MaterialHandle>(i) ||
+                table.get(static_cast<MaterialHandle>(i)) != materials[i].get())
+                ++table_mismatches;
+    report("MaterialTable: deduplicated handles", table_mismatches + (table.size() != 8), 17);
+
+    std::vector<std::shared_ptr<Sphere>> spheres;
+    HitableList list;
+    for (int i = 0; i < 2000; ++i)
+    {
+        auto sphere = std::make_shared<Sphere>(random_point(sampler, Point3{-10}, Point3{10}),
+                                               random_number_t(sampler, 0.1, 0.5), materials[i % 8]);
+        spheres.push_back(sphere);
+        list.add(sphere);
+    }
+    BVH bvh{list};
+    SphereSet set{spheres};
+
+    const int count = 100000;
+    long mismatches = 0;
+    for (int k = 0; k < count; ++k)
+    {
+        Ray r{random_point(sampler, Point3{-12}, Point3{12}), random_direction(sampler)};
+        HitRecord a, b;
+        bool hit_a = bvh.hit(r, spawn_t_min, infinity, a);
+        bool hit_b = set.hit(r, spawn_t_min, infinity, b);
+        if (hit_a != hit_b ||
+            (hit_a && (a.t != b.t || !same_vector(a.p, b.p) || !same_vector(a.normal, b.normal) ||
+                       a.front_face != b.front_face || a.material != b.material ||
+                       a.material != spheres[b.primitive]->material().get())))
+            ++mismatches;
+    }
+    report("SphereSet vs BVH over Spheres: hit and material", mismatches, count);
+}
+
+// A BVH stored in the cache directory and loaded back has the nodes and hits
+// of the one built, and damaged cache files are rejected, falling back to a
+// build with the same hits.
+void bvh_cache_checks(Sampler &sampler)
+{
+    const std::string directory = PROJECT "_cache";
+    auto material = std::make_shared<Lambertian>(Color{0.5});
+    HitableList list;
+    for (int i = 0; i < 5000; ++i)
+        list.add(std::make_shared<Sphere>(random_point(sampler, Point3{-10}, Point3{10}), 0.1, material));
+    BVHBuildOptions options;
+    BVH built{list, options};
+
+    options.cache_directory = directory;
+    std::vector<AABB> bounds;
+    for (const auto &object : list.objects())
+    {
+        AABB box;
+        object->bounding_box(box);
+        bounds.push_back(box);
+    }
+    const uint64_t hash = hash_bvh_input(bounds, options);
+    const std::string path = bvh_cache_path(directory, hash);
+    std::remove(path.c_str());
+
+    BVH cold{list, options};
+    std::vector<BVHNode> nodes;
+    std::vector<int> order;
+    bool loaded = load_bvh_cache(path, hash, bounds.size(), nodes, order);
+    BVH warm{list, options};
+
+    auto same_nodes = [](const std::vector<BVHNode> &a, const std::vector<BVHNode> &b) {
+        if (a.size() != b.size())
+            return false;
+        for (size_t i = 0; i < a.size(); ++i)
+            if (!same_vector(a[i].bounds.min(), b[i].bounds.min()) ||
+                !same_vector(a[i].bounds.max(), b[i].bounds.max()) || a[i].offset != b[i].offset ||
+                a[i].count != b[i].count || (!a[i].is_leaf() && a[i].axis != b[i].axis))
+                return false;
+        return true;
+    };
+    report("BVH cache: saved and loaded", !loaded || !same_nodes(nodes, built.nodes()), 1);
+    report("BVH cache: tree of a warm start", !same_nodes(warm.nodes(), built.nodes()) ||
+                                                  warm.objects() != built.objects(), 1);
+
+    // Cut in the order, cut right after the header, and an order that is not
+    // a permutation (the last primitive repeats the first)
+    std::string bytes;
+    {
+        std::ifstream file(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    const std::string truncated = bytes.substr(0, bytes.size() - 4);
+    const std::string header_only = bytes.substr(0, 48);
+    std::string repeated = bytes;
+    repeated.replace(repeated.size() - 4, 4, repeated, repeated.size() - 4 * bounds.size(), 4);
+
+    const int count = 20000;
+    std::vector<Ray> rays;
+    for (int k = 0; k < count; ++k)
+        rays.push_back(Ray{random_point(sampler, Point3{-12}, Point3{12}), random_direction(sampler)});
+    auto hit_mismatches = [&](const BVH &bvh) {
+        long mismatches = 0;
+        for (const Ray &r : rays)
+        {
+            HitRecord a, b;
+            bool hit_a = built.hit(r, spawn_t_min, infinity, a);
+            bool hit_b = bvh.hit(r, spawn_t_min, infinity, b);
+            if (hit_a != hit_b || (hit_a && (a.t != b.t || a.object != b.object)))
+                ++mismatches;
+        }
+        return mismatches;
+    };
+
+    // Each rebuild stores its tree again, replacing the damaged file
+    long damaged_loaded = 0, damaged_mismatches = hit_mismatches(warm);
+    const std::string *damaged_files[] = {&truncated, &header_only, &repeated};
+    for (const std::string *damaged : damaged_files)
+    {
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(damaged->data(), damaged->size());
+        }
+        damaged_loaded += load_bvh_cache(path, hash, bounds.size(), nodes, order);
+        BVH rebuilt{list, options};
+        damaged_mismatches += hit_mismatches(rebuilt);
+    }
+    report("BVH cache: warm and rebuilt trees vs built: closest hit", damaged_mismatches, 4 * count);
+    report("BVH cache: damaged files rejected", damaged_loaded, 3);
+    std::remove(path.c_str());
+    std::remove(directory.c_str());
+}
+
+// Small spheres seen from far away, where half_b^2 - a c cancels in float:
+// Sphere hits agree with the distance of the ray's line to the center taken
+// in double, outside a thin band around the silhouette, and SphereSet agrees
+// with a BVH over the same spheres.
+void distant_sphere_checks(Sampler &sampler)
+{
+    auto material = std::make_shared<Lambertian>(Color{0.5});
+    std::vector<std::shared_ptr<Sphere>> spheres;
+    HitableList list;
+    for (int i = 0; i < 1000; ++i)
+    {
+        auto sphere = std::make_shared<Sphere>(random_point(sampler, Point3{-20}, Point3{20}),
+                                               random_number_t(sampler, 0.05, 0.5), material);
+        spheres.push_back(sphere);
+        list.add(sphere);
+    }
+    BVH bvh{list};
+    SphereSet set{spheres};
+    SphereSet built{spheres};
+    built.build();
+
+    const int count = 100000;
+    long silhouette_mismatches = 0, set_mismatches = 0, built_mismatches = 0;
+    for (int k = 0; k < count; ++k)
+    {
+        // Rays from about 300 away, aimed within twice the radius of a sphere
+        const Sphere &target = *spheres[k % spheres.size()];
+        Point3 origin = target.center() + 300 * random_direction(sampler);
+        Point3 aim = target.center() + 2 * target.radius() * random_direction(sampler);
+        Ray r{origin, normalize_Vector3(aim - origin)};
+
+        double o[3], d[3], od = 0, dd = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            o[i] = static_cast<double>(r.origin()[i]) - static_cast<double>(target.center()[i]);
+            d[i] = static_cast<double>(r.direction()[i]);
+            od += o[i] * d[i];
+            dd += d[i] * d[i];
+        }
+        double distance_squared = 0;
+        for (int i = 0; i < 3; ++i)
+            distance_squared += (o[i] - od / dd * d[i]) * (o[i] - od / dd * d[i]);
+        double distance = std::sqrt(distance_squared);
+        HitRecord rec;
+        if (std::fabs(distance - target.radius()) > 1e-3 &&
+            target.hit(r, spawn_t_min, infinity, rec) != (distance < target.radius()))
+            ++silhouette_mismatches;
+
+        HitRecord a, b, c;
+        bool hit_a = bvh.hit(r, spawn_t_min, infinity, a);
+        bool hit_b = set.hit(r, spawn_t_min, infinity, b);
+        bool hit_c = built.hit(r, spawn_t_min, infinity, c);
+        if (hit_a != hit_b || (hit_a && (a.t != b.t || a.object != spheres[b.primitive].get())))
+            ++set_mismatches;
+        if (hit_a != hit_c || (hit_a && a.t != c.t))
+            ++built_mismatches;
+    }
+    report("Distant Sphere vs line distance in double", silhouette_mismatches, count);
+    report("Distant SphereSet vs BVH over Spheres: hit, t", set_mismatches, count);
+    report("Distant SphereSet (built) vs BVH over Spheres: hit, t", built_mismatches, count);
+}
+
+void write_file(const std::string &path, const std::string &bytes)
+{
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(bytes.data(), bytes.size());
+}
+
+template <class T>
+void put_binary(std::string &out, const T value, const bool big_endian)
+{
+    const uint16_t probe = 1;
+    const bool host_big_endian = *reinterpret_cast<const uint8_t *>(&probe) == 0;
+    char bytes[sizeof(T)];
+    memcpy(bytes, &value, sizeof(T));
+    if (big_endian != host_big_endian)
+        std::reverse(bytes, bytes + sizeof(T));
+    out.append(bytes, sizeof(T));
+}
+
+// Triangles of a mesh in a canonical order, without the padding of its leaves
+std::vector<std::vector<int>> mesh_triangles(const TriangleMesh &mesh)
+{
+    std::vector<std::vector<int>> triangles;
+    const std::vector<int> &indices = mesh.indices();
+    for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        if (indices[t] != indices[t + 1] || indices[t] != indices[t + 2])
+            triangles.push_back({indices[t], indices[t + 1], indices[t + 2]});
+    std::sort(triangles.begin(), triangles.end());
+    return triangles;
+}
+
+// A loaded mesh against the buffers expected from its file
+long mesh_mismatches(const std::shared_ptr<TriangleMesh> &mesh, const std::vector<Point3> &vertices,
+                     const std::vector<std::vector<int>> &triangles, const std::vector<Vector3> &normals,
+                     const std::vector<number_t> &uvs)
+{
+    if (!mesh)
+        return 1;
+    long mismatches = mesh->vertices().size() != vertices.size() || mesh->normals().size() != normals.size() ||
+                      mesh->uvs() != uvs || mesh_triangles(*mesh) != triangles ||
+                      mesh->triangle_count() != static_cast<int>(triangles.size());
+    for (size_t i = 0; i < vertices.size() && i < mesh->vertices().size(); ++i)
+        mismatches += !same_vector(mesh->vertices()[i], vertices[i]);
+    for (size_t i = 0; i < normals.size() && i < mesh->normals().size(); ++i)
+        mismatches += !same_vector(mesh->normals()[i], normals[i]);
+    return mismatches;
+}
+
+// load_ply and load_obj on small files: binary PLY of both byte orders with
+// normals, texture coordinates and polygons split into fans, OBJ with every
+// corner form, negative indices and statements to skip. Out of range
+// indices, truncated and malformed files give no mesh.
+void mesh_loader_checks()
+{
+    auto material = std::make_shared<Lambertian>(Color{0.5});
+    const std::vector<Point3> vertices = {Point3{0, 0, 0},  Point3{1, 0, 0},      Point3{1, 1, 0},
+                                          Point3{0, 1, 0}, Point3{0.5, 1.5, 0.25}, Point3{-0.5, 0.75, -2}};
+    std::vector<Vector3> normals;
+    std::vector<number_t> uvs;
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        normals.push_back(Vector3{0, 0.5, static_cast<number_t>(i % 2 ? 0.75 : -0.75)});
+        uvs.push_back(vertices[i].x() + 0.5);
+        uvs.push_back(vertices[i].y() * 0.5);
+    }
+
+    // A quad, a pentagon and a triangle
+    const std::vector<std::vector<int>> faces = {{0, 1, 2, 3}, {1, 2, 3, 4, 5}, {5, 0, 2}};
+    std::vector<std::vector<int>> triangles;
+    for (const auto &face : faces)
+        for (size_t k = 2; k < face.size(); ++k)
+            triangles.push_back({face[0], face[k - 1], face[k]});
+    std::sort(triangles.begin(), triangles.end());
+
+    const std::string ply_path = PROJECT "_mesh.ply";
+    long ply_mismatches = 0, ply_rejected = 0;
+    for (bool big_endian : {false, true})
+    {
+        std::ostringstream header;
+        header << "ply\nformat " << (big_endian ? "binary_big_endian" : "binary_little_endian") << " 1.0\n"
+               << "comment written by the tests\n"
+               << "element vertex " << vertices.size() << "\n"
+               << "property float x\nproperty float y\nproperty float z\n"
+               << "property float nx\nproperty float ny\nproperty float nz\n"
+               << "property uchar flags\nproperty float s\nproperty float t\n"
+               << "element face " << faces.size() << "\n"
+               << "property uchar flags\nproperty list uchar int vertex_indices\n"
+               << "end_header\n";
+        std::string body;
+        for (size_t i = 0; i < vertices.size(); ++i)
+        {
+            for (int a = 0; a < 3; ++a)
+                put_binary(body, static_cast<float>(vertices[i][a]), big_endian);
+            for (int a = 0; a < 3; ++a)
+                put_binary(body, static_cast<float>(normals[i][a]), big_endian);
+            put_binary(body, static_cast<uint8_t>(7), big_endian);
+            put_binary(body, static_cast<float>(uvs[2 * i]), big_endian);
+            put_binary(body, static_cast<float>(uvs[2 * i + 1]), big_endian);
+        }
+        std::string out_of_range = body;
+        for (const auto &face : faces)
+        {
+            put_binary(body, static_cast<uint8_t>(0), big_endian);
+            put_binary(body, static_cast<uint8_t>(face.size()), big_endian);
+            put_binary(out_of_range, static_cast<uint8_t>(0), big_endian);
+            put_binary(out_of_range, static_cast<uint8_t>(face.size()), big_endian);
+            for (int index : face)
+            {
+                put_binary(body, static_cast<int32_t>(index), big_endian);
+                put_binary(out_of_range, static_cast<int32_t>(index == 4 ? 6 : index), big_endian);
+            }
+        }
+
+        write_file(ply_path, header.str() + body);
+        ply_mismatches += mesh_mismatches(load_ply(ply_path, material), vertices, triangles, normals, uvs);
+
+        std::string ascii = header.str();
+        ascii.replace(ascii.find(big_endian ? "binary_big_endian" : "binary_little_endian"),
+                      big_endian ? 17 : 20, "ascii");
+        const std::string damaged[] = {header.str() + out_of_range, header.str() + body.substr(0, body.size() - 2),
+                                       ascii + body};
+        for (const std::string &bytes : damaged)
+        {
+            write_file(ply_path, bytes);
+            ply_rejected += load_ply(ply_path, material) == NULL;
+        }
+    }
+    std::remove(ply_path.c_str());
+    report("load_ply: little and big endian buffers", ply_mismatches, 2);
+    report("load_ply: bad index, truncated and ascii files rejected", 6 - ply_rejected, 6);
+
+    // The same mesh, with the fifth and sixth vertex defined after the quad
+    // and the following faces addressing them relative to the end
+    std::ostringstream obj;
+    obj << std::setprecision(9) << "# written by the tests\nmtllib none.mtl\no mesh\n";
+    for (size_t i = 0; i < vertices.size(); ++i)
+    {
+        obj << "v " << vertices[i].x() << " " << vertices[i].y() << " " << vertices[i].z() << "\n";
+        obj << "vt " << uvs[2 * i] << " " << uvs[2 * i + 1] << "\n";
+        obj << "vn " << normals[i].x() << " " << normals[i].y() << " " << normals[i].z() << "\n";
+        if (i == 3)
+            obj << "usemtl none\ns off\nf 1/1/1 2/2/2 3/3/3 4/4/4\n";
+    }
+    obj << "g rest\nf -5//-5 -4//-4 -3//-3 -2//-2 -1//-1\r\nf 6/6 1/1 3/3 # a comment\n";
+    const std::string obj_path = PROJECT "_mesh.obj";
+    write_file(obj_path, obj.str());
+    long obj_mismatches = mesh_mismatches(load_obj(obj_path, material), vertices, triangles, normals, uvs);
+
+    // Corners not using the same index for v, vt and vn drop the attributes
+    write_file(obj_path, obj.str() + "f 1/2/1 2/2/2 3/3/3\n");
+    std::vector<std::vector<int>> more_triangles = triangles;
+    more_triangles.push_back({0, 1, 2});
+    std::sort(more_triangles.begin(), more_triangles.end());
+    obj_mismatches += mesh_mismatches(load_obj(obj_path, material), vertices, more_triangles,
+                                      std::vector<Vector3>(), std::vector<number_t>());
+    report("load_obj: vertex, normal, uv and index buffers", obj_mismatches, 2);
+
+    long obj_rejected = 0;
+    for (const char *face : {"f 1 2 7\n", "f 1 x 3\n", "f -7 1 2\n", "f 0 1 2\n"})
+    {
+        write_file(obj_path, obj.str() + face);
+        obj_rejected += load_obj(obj_path, material) == NULL;
+    }
+    std::remove(obj_path.c_str());
+    report("load_obj: malformed faces rejected", 4 - obj_rejected, 4);
+}
+
+// An OutOfCoreMesh traced ray by ray and in batches, with all clusters in
+// memory and with a cap forcing evictions, against the TriangleMesh it was
+// written from: bit-identical hits, normals and texture coordinates. Damaged
+// files must not open.
+void out_of_core_checks(Sampler &sampler)
+{
+    const std::string path = PROJECT "_mesh.ooc";
+    auto material = std::make_shared<Lambertian>(std::make_shared<UVTexture>());
+    auto mesh = make_torus(400, 200, material);
+    bool written = OutOfCoreMesh::write(path, *mesh, 1024);
+    report("OutOfCoreMesh: write", !written, 1);
+
+    const int count = 100000;
+    std::vector<Ray> rays;
+    for (int k = 0; k < count; ++k)
+        rays.push_back(Ray{random_point(sampler, Point3{-3}, Point3{3}), random_direction(sampler)});
+    std::vector<HitRecord> expected(count);
+    std::vector<char> expected_hits(count);
+    for (int k = 0; k < count; ++k)
+        expected_hits[k] = mesh->hit(rays[k], spawn_t_min, infinity, expected[k]);
+
+    auto same = [](const HitRecord &a, const HitRecord &b) {
+        return a.t == b.t && same_vector(a.p, b.p) && same_vector(a.normal, b.normal) &&
+               a.front_face == b.front_face && a.error == b.error && a.material == b.material &&
+               a.u == b.u && a.v == b.v;
+    };
+    const size_t caps[] = {0, 256 << 10};
+    for (size_t cap : caps)
+    {
+        OutOfCoreMesh ooc{path, material, cap};
+        const std::string name = std::string("OutOfCoreMesh (cap ") + (cap ? "256 KiB" : "none") + ")";
+        long hit_mismatches = 0, occluded_mismatches = 0, batch_mismatches = 0;
+        for (int k = 0; k < count; ++k)
+        {
+            HitRecord rec;
+            bool hit = ooc.hit(rays[k], spawn_t_min, infinity, rec);
+            if (hit != bool(expected_hits[k]) || (hit && !same(expected[k], rec)))
+                ++hit_mismatches;
+            if (ooc.occluded(rays[k], spawn_t_min, infinity) != bool(expected_hits[k]))
+                ++occluded_mismatches;
+        }
+
+        std::vector<HitRecord> recs(count);
+        std::unique_ptr<bool[]> hits(new bool[count]);
+        ooc.hit_batch(rays.data(), count, spawn_t_min, infinity, recs.data(), hits.get());
+        for (int k = 0; k < count; ++k)
+            if (hits[k] != bool(expected_hits[k]) || (hits[k] && !same(expected[k], recs[k])))
+                ++batch_mismatches;
+
+        report(name + " vs TriangleMesh: open", !ooc.is_open(), 1);
+        report(name + " vs TriangleMesh: hit", hit_mismatches, count);
+        report(name + " vs TriangleMesh: occluded", occluded_mismatches, count);
+        report(name + " vs TriangleMesh: hit_batch", batch_mismatches, count);
+    }
+
+    // Cut in the last cluster, and cut right after the header
+    std::string bytes;
+    {
+        std::ifstream file(path, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    }
+    const std::string truncated = bytes.substr(0, bytes.size() - 4096);
+    const std::string header_only = bytes.substr(0, 64);
+    long damaged_opened = 0;
+    for (const std::string *damaged : {&truncated, &header_only})
+    {
+        {
+            std::ofstream file(path, std::ios::binary | std::ios::trunc);
+            file.write(damaged->data(), damaged->size());
+        }
+        OutOfCoreMesh ooc{path, material};
+        damaged_opened += ooc.is_open();
+    }
+    report("OutOfCoreMesh: damaged files rejected", damaged_opened, 2);
+    std::remove(path.c_str());
+}
+
+// render_adaptive() with rounds of no samples takes the base samples only,
+// and write_sample_counts() refuses estimates not matching the image size.
+void adaptive_checks()
+{
+    std::vector<PixelEstimate> pixels;
+    AdaptiveOptions options;
+    long mismatches = 0;
+    for (int round_samples : {0, -8})
+    {
+        options.round_samples = round_samples;
+        render_adaptive(64, 32, options, [](int p, int s) { return Color{number_t((p + s) % 2)}; }, pixels);
+        for (const PixelEstimate &pixel : pixels)
+            mismatches += pixel.count() != options.base_samples;
+    }
+    options = AdaptiveOptions{};
+    options.base_samples = 0;
+    render_adaptive(64, 0, options, [](int, int) { return Color{0.5}; }, pixels);
+    for (const PixelEstimate &pixel : pixels)
+        mismatches += pixel.count() != 1;
+    report("render_adaptive: base samples without rounds", mismatches, 3 * 64);
+
+    std::ostringstream out;
+    mismatches = write_sample_counts(out, std::vector<PixelEstimate>(), 8, 8) +
+                 write_sample_counts(out, pixels, 8, 4) + !out.str().empty() + !write_sample_counts(out, pixels, 8, 8);
+    report("write_sample_counts: size checked", mismatches, 4);
+}
+
+// An instance flattened by a zero scale factor is never hit, instead of being
+// traced with an all zero inverse.
+void singular_transform_checks(Sampler &sampler)
+{
+    auto material = std::make_shared<Lambertian>(Color{0.5});
+    auto sphere = std::make_shared<Sphere>(Point3{0}, 1, material);
+    Transform flat = translate_Transform(Vector3{0, 1, 0}) * scale_Transform(Vector3{1, 0, 1});
+    Instance instance{sphere, flat};
+
+    const int count = 10000;
+    long mismatches = flat.invertible() || flat.inverse().invertible() || !scale_Transform(2).invertible();
+    for (int k = 0; k < count; ++k)
+    {
+        Ray r{random_point(sampler, Point3{-2}, Point3{2}), random_direction(sampler)};
+        HitRecord rec;
+        if (instance.hit(r, spawn_t_min, infinity, rec) || instance.occluded(r, spawn_t_min, infinity))
+            ++mismatches;
+    }
+    report("Instance with a singular transform: never hit", mismatches, count);
+}
+
+int main(int argc, char const *argv[])
+{
+    Sampler sampler{1};
+
+    primitive_checks(sampler);
+    structure_checks(sampler);
+    packet_checks(sampler);
+    refit_checks(sampler);
+    bvh_cache_checks(sampler);
+    ground_substitution_checks(sampler);
+    deferred_completion_checks(sampler);
+    material_checks(sampler);
+    distant_sphere_checks(sampler);
+    mesh_loader_checks();
+    out_of_core_checks(sampler);
+    adaptive_checks();
+    singular_transform_checks(sampler);
+
+    if (failed_checks)
+        std::cerr << failed_checks << " checks failed" << std::endl;
+    return failed_checks ? EXIT_FAILURE : EXIT_SUCCESS;
+}
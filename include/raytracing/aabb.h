@@ -0,0 +1,153 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef AABB_H
+#define AABB_H
+
+#include <utility>
+#include <raytracing/raytracing.h>
+#include <raytracing/vector3.h>
+#include <raytracing/ray.h>
+#include <raytracing/utils.h>
+
+class AABB
+{
+    Point3 _minimum;
+    Point3 _maximum;
+
+public:
+    AABB() : _minimum{infinity}, _maximum{-infinity} {}
+    AABB(const Point3 &a, const Point3 &b)
+        : _minimum{std::fmin(a.x(), b.x()), std::fmin(a.y(), b.y()), std::fmin(a.z(), b.z())},
+          _maximum{std::fmax(a.x(), b.x()), std::fmax(a.y(), b.y()), std::fmax(a.z(), b.z())} {}
+
+    Point3 min() const { return _minimum; }
+    Point3 max() const { return _maximum; }
+
+    bool is_empty() const
+    {
+        return _minimum[0] > _maximum[0] || _minimum[1] > _maximum[1] || _minimum[2] > _maximum[2];
+    }
+
+    Vector3 extent() const { return _maximum - _minimum; }
+    Point3 centroid() const { return 0.5 * (_minimum + _maximum); }
+
+    number_t surface_area() const
+    {
+        if (is_empty())
+            return 0;
+
+        Vector3 d = extent();
+        return 2 * (d[0] * d[1] + d[1] * d[2] + d[2] * d[0]);
+    }
+
+    // Slightly enlarged, so rounding in the slab test cannot cull hits on flat,
+    // axis-aligned primitives or on edges lying in a box face.
+    AABB padded() const
+    {
+        const number_t relative = std::fmax(number_t(1e-9), 64 * std::numeric_limits<number_t>::epsilon());
+        Vector3 pad = relative * (Vector3{1} + Vector3(std::fmax(std::fabs(_minimum.x()), std::fabs(_maximum.x())),
+                                                       std::fmax(std::fabs(_minimum.y()), std::fabs(_maximum.y())),
+                                                       std::fmax(std::fabs(_minimum.z()), std::fabs(_maximum.z()))));
+        return AABB(_minimum - pad, _maximum + pad);
+    }
+
+    int longest_axis() const
+    {
+        Vector3 d = extent();
+        if (d[0] > d[1] && d[0] > d[2])
+            return 0;
+        return d[1] > d[2] ? 1 : 2;
+    }
+
+    // Plain comparisons instead of fmin/fmax, these are hot in builds and refits.
+    AABB &extend(const Point3 &p)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            _minimum[a] = p[a] < _minimum[a] ? p[a] : _minimum[a];
+            _maximum[a] = p[a] > _maximum[a] ? p[a] : _maximum[a];
+        }
+        return *this;
+    }
+
+    AABB &extend(const AABB &box)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            _minimum[a] = box._minimum[a] < _minimum[a] ? box._minimum[a] : _minimum[a];
+            _maximum[a] = box._maximum[a] > _maximum[a] ? box._maximum[a] : _maximum[a];
+        }
+        return *this;
+    }
+
+    bool hit(const Ray &r, number_t t_min, number_t t_max) const
+    {
+        Vector3 inv_direction = 1 / r.direction();
+        return hit(r.origin(), inv_direction, t_min, t_max);
+    }
+
+    // Slab test with a precomputed reciprocal ray direction, as used by the
+    // acceleration structures during traversal.
+    bool hit(const Point3 &origin, const Vector3 &inv_direction, number_t t_min, number_t t_max) const
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            auto t0 = (_minimum[a] - origin[a]) * inv_direction[a];
+            auto t1 = (_maximum[a] - origin[a]) * inv_direction[a];
+            if (inv_direction[a] < 0)
+                std::swap(t0, t1);
+
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if (t_max < t_min)
+                return false;
+        }
+        return true;
+    }
+    // Same, also returning where the ray enters the box
+    bool hit(const Point3 &origin, const Vector3 &inv_direction, number_t t_min, number_t t_max,
+             number_t &t_enter) const
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            auto t0 = (_minimum[a] - origin[a]) * inv_direction[a];
+            auto t1 = (_maximum[a] - origin[a]) * inv_direction[a];
+            if (inv_direction[a] < 0)
+                std::swap(t0, t1);
+
+            t_min = t0 > t_min ? t0 : t_min;
+            t_max = t1 < t_max ? t1 : t_max;
+            if (t_max < t_min)
+                return false;
+        }
+        t_enter = t_min;
+        return true;
+    }
+};
+
+inline AABB surrounding_box(const AABB &box0, const AABB &box1)
+{
+    AABB tmp{box0};
+    return tmp.extend(box1);
+}
+
+#endif /* AABB_H */
@@ -0,0 +1,150 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef ADAPTIVE_H
+#define ADAPTIVE_H
+
+#include <math.h>
+#include <algorithm>
+#include <iostream>
+#include <vector>
+#include <raytracing/raytracing.h>
+#include <raytracing/color.h>
+
+// Running sum, mean and variance of the samples of one pixel. The variance is
+// kept for the luminance with the update of Welford, which stays accurate for
+// many samples of similar value.
+class PixelEstimate
+{
+    Color _sum;
+    number_t _mean; // luminance
+    number_t _m2;   // sum of squared deviations of the luminance
+    int _count;
+
+public:
+    PixelEstimate() : _mean(0), _m2(0), _count(0) {}
+
+    void add(const Color &c)
+    {
+        const number_t luminance = 0.2126 * c.r() + 0.7152 * c.g() + 0.0722 * c.b();
+        const number_t delta = luminance - _mean;
+        _sum += c;
+        _mean += delta / ++_count;
+        _m2 += delta * (luminance - _mean);
+    }
+
+    const Color &sum() const { return _sum; }
+    int count() const { return _count; }
+    number_t luminance() const { return _mean; }
+
+    // Sample variance of the luminance
+    number_t variance() const { return _count > 1 ? _m2 / (_count - 1) : 0; }
+
+    // Half width of the 95% confidence interval of the pixel after encoding
+    // with gamma 2, as written by write_color(): the interval e of the mean
+    // luminance L widens to sqrt(L + e) - sqrt(L), steepest for dark pixels
+    number_t error() const
+    {
+        if (_count < 2)
+            return 1;
+        const number_t e = 1.96 * sqrt(variance() / _count);
+        return sqrt(_mean + e) - sqrt(_mean);
+    }
+};
+
+struct AdaptiveOptions
+{
+    int base_samples;   // taken by every pixel first
+    int round_samples;  // taken by every pixel above the threshold per round
+    int max_samples;    // per pixel
+    number_t threshold; // of PixelEstimate::error(), about a level of 8 bit output
+
+    AdaptiveOptions() : base_samples(16), round_samples(8), max_samples(1024), threshold(1.0 / 256) {}
+};
+
+// Takes samples_per_pixel samples per pixel on average. Every pixel first takes
+// options.base_samples, then rounds give options.round_samples more to the
+// pixels whose error is above options.threshold. A round spends at most half
+// of the remaining budget, on the pixels with the largest error per square
+// root of their samples: the variance a sample removes from a pixel mean,
+// so the summed variance falls fastest. Stops when the budget is spent or all
+// pixels are below the threshold.
+//
+// sample(p, s) returns sample s of pixel p. Samples are numbered
+// consecutively per pixel and rounds only depend on the estimates, so the
+// result does not depend on the number of threads.
+template <class Sample>
+void render_adaptive(int pixel_count, int samples_per_pixel, const AdaptiveOptions &options, const Sample &sample,
+                     std::vector<PixelEstimate> &pixels)
+{
+    // Every pixel takes at least one sample, so that each estimate has a mean.
+    // Rounds need a positive size, without one only the base samples are taken.
+    pixels.assign(std::max(pixel_count, 0), PixelEstimate{});
+    const int base_samples = std::max(1, std::min(options.base_samples, samples_per_pixel));
+
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int p = 0; p < pixel_count; ++p)
+        for (int s = 0; s < base_samples; ++s)
+            pixels[p].add(sample(p, s));
+
+    long budget = 0;
+    if (options.round_samples > 0)
+        budget = static_cast<long>(pixel_count) * (samples_per_pixel - base_samples);
+    std::vector<int> active;
+    while (budget > 0 && budget >= options.round_samples)
+    {
+        active.clear();
+        for (int p = 0; p < pixel_count; ++p)
+            if (pixels[p].count() < options.max_samples && pixels[p].error() > options.threshold)
+                active.push_back(p);
+        if (active.empty())
+            break;
+
+        const long round_budget = std::max(budget / 2, static_cast<long>(options.round_samples));
+        const long round_count = std::min(static_cast<long>(active.size()), round_budget / options.round_samples);
+        if (round_count < static_cast<long>(active.size()))
+            std::nth_element(active.begin(), active.begin() + round_count, active.end(), [&pixels](int a, int b) {
+                return pixels[a].error() * sqrt(static_cast<number_t>(pixels[b].count())) >
+                       pixels[b].error() * sqrt(static_cast<number_t>(pixels[a].count()));
+            });
+
+        long taken = 0;
+#pragma omp parallel for schedule(dynamic, 16) reduction(+ : taken)
+        for (long a = 0; a < round_count; ++a)
+        {
+            PixelEstimate &pixel = pixels[active[a]];
+            const int count = std::min(options.round_samples, options.max_samples - pixel.count());
+            for (int k = 0; k < count; ++k)
+                pixel.add(sample(active[a], pixel.count()));
+            taken += count;
+        }
+        budget -= taken;
+    }
+}
+
+// Writes the samples taken per pixel as a PPM image, from black for the fewest
+// to white for the most, with rows in the order of the apps' images (row
+// j = 0 at the bottom). Writes nothing and returns false unless pixels holds
+// image_width x image_height estimates.
+bool write_sample_counts(std::ostream &out, const std::vector<PixelEstimate> &pixels, int image_width,
+                         int image_height);
+
+#endif /* ADAPTIVE_H */
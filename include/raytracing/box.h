@@ -0,0 +1,159 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef BOX_H
+#define BOX_H
+
+#include <raytracing/raytracing.h>
+#include <raytracing/hitable.h>
+#include <raytracing/material.h>
+
+// Axis-aligned box, intersected with the slab test. Its bounds are exact, rotate
+// it with an Instance. Each face has texture coordinates from 0 to 1.
+class Box final : public Hitable
+{
+    AABB _box;
+    MaterialPtr _material;
+
+    // Entry or exit distance in [t_min, t_max], face = 2 * axis + (max side)
+    bool root(const Ray &r, number_t t_min, number_t t_max, number_t &t, int &face) const;
+
+public:
+    Box(const Point3 &a, const Point3 &b, MaterialPtr material = NULL)
+        : Hitable(HitableType::Box), _box(a, b), _material(material) {}
+
+    Point3 min() const { return _box.min(); }
+    Point3 max() const { return _box.max(); }
+    MaterialPtr material() const { return _material; }
+
+    virtual bool intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const override;
+    virtual bool bounding_box(AABB &output_box) const override;
+    virtual void compute_interaction(const Ray &r, HitRecord &rec) const override;
+    virtual void compute_uv(const Ray &r, HitRecord &rec) const override;
+    virtual bool occluded(const Ray &r, number_t t_min, number_t t_max) const override;
+};
+
+inline bool Box::root(const Ray &r, number_t t_min, number_t t_max, number_t &t, int &face) const
+{
+    Point3 lo = _box.min(), hi = _box.max();
+    Point3 origin = r.origin();
+    Vector3 direction = r.direction();
+
+    number_t t_near = -infinity, t_far = infinity;
+    int near_face = -1, far_face = -1;
+    for (int a = 0; a < 3; ++a)
+    {
+        auto inv = 1 / direction[a];
+        auto t0 = (lo[a] - origin[a]) * inv;
+        auto t1 = (hi[a] - origin[a]) * inv;
+        int f0 = 2 * a, f1 = 2 * a + 1;
+        if (inv < 0)
+        {
+            std::swap(t0, t1);
+            std::swap(f0, f1);
+        }
+
+        if (t0 > t_near)
+        {
+            t_near = t0;
+            near_face = f0;
+        }
+        if (t1 < t_far)
+        {
+            t_far = t1;
+            far_face = f1;
+        }
+    }
+
+    // No face at all for a zero direction
+    if (!(t_near <= t_far) || far_face < 0)
+        return false;
+    if (t_min <= t_near && t_near <= t_max)
+    {
+        t = t_near;
+        face = near_face;
+        return true;
+    }
+    if (t_min <= t_far && t_far <= t_max)
+    {
+        t = t_far;
+        face = far_face;
+        return true;
+    }
+    return false;
+}
+
+inline bool Box::intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
+{
+    number_t t;
+    int face;
+    if (!root(r, t_min, t_max, t, face))
+        return false;
+
+    rec.t = t;
+    rec.object = this;
+    rec.instance = NULL;
+    rec.primitive = face;
+
+    return true;
+}
+
+inline bool Box::bounding_box(AABB &output_box) const
+{
+    output_box = _box;
+    return true;
+}
+
+inline void Box::compute_interaction(const Ray &r, HitRecord &rec) const
+{
+    // The coordinate across the face is exact once snapped onto it
+    int axis = rec.primitive / 2;
+    bool max_side = rec.primitive % 2;
+    rec.p = r.at(rec.t);
+    rec.p[axis] = max_side ? _box.max()[axis] : _box.min()[axis];
+    number_t magnitude = std::fmax(std::fmax(std::fabs(rec.p.x()), std::fabs(rec.p.y())), std::fabs(rec.p.z()));
+    rec.error = error_gamma(3) * magnitude;
+
+    Vector3 outward_normal{0};
+    outward_normal[axis] = max_side ? 1 : -1;
+    rec.set_face_normal(r, outward_normal);
+    rec.material = _material.get();
+}
+
+inline void Box::compute_uv(const Ray &r, HitRecord &rec) const
+{
+    int axis = rec.primitive / 2;
+    int a = (axis + 1) % 3, b = (axis + 2) % 3;
+    Point3 p = r.at(rec.t), lo = _box.min();
+    Vector3 extent = _box.extent();
+    // Faces of a flat box have zero width, keep u, v finite on them
+    rec.u = extent[a] > 0 ? (p[a] - lo[a]) / extent[a] : 0;
+    rec.v = extent[b] > 0 ? (p[b] - lo[b]) / extent[b] : 0;
+}
+
+inline bool Box::occluded(const Ray &r, number_t t_min, number_t t_max) const
+{
+    number_t t;
+    int face;
+    return root(r, t_min, t_max, t, face);
+}
+
+#endif /* BOX_H */
@@ -0,0 +1,193 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef BVH_H
+#define BVH_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <raytracing/raytracing.h>
+#include <raytracing/hitable.h>
+#include <raytracing/hitable_list.h>
+#include <raytracing/aabb.h>
+
+// Maximum depth of a BVH, also the size of the traversal stack.
+#define BVH_MAX_DEPTH 128
+
+struct BVHNode
+{
+    AABB bounds;
+    int offset; // first primitive (leaf) or second child (interior node)
+    int count;  // number of primitives, zero for interior nodes
+    int axis;   // split axis of interior nodes
+
+    bool is_leaf() const { return count > 0; }
+};
+
+enum class BVHBuilder
+{
+    SAH,  // binned surface area heuristic, best trace performance
+    LBVH, // parallel Morton code (linear) BVH, fastest build
+};
+
+struct BVHBuildOptions
+{
+    BVHBuilder builder;
+    int bins;                 // number of SAH bins per split
+    int max_leaf_size;        // leaves never hold more primitives than this
+    number_t traversal_cost;  // SAH cost of visiting a node ...
+    number_t intersect_cost;  // ... relative to intersecting a primitive
+    int morton_bits;          // LBVH: 30 or 60 bit Morton codes
+    int treelet_bits;         // LBVH: leading code bits grouping primitives into treelets
+    bool sah_top_levels;      // LBVH: join the treelets with SAH instead of Morton splits
+    std::string cache_directory; // load/store built trees here, see bvh_cache.h (empty: no cache)
+
+    BVHBuildOptions()
+        : builder(BVHBuilder::SAH), bins(16), max_leaf_size(4), traversal_cost(1.0), intersect_cost(1.0),
+          morton_bits(30), treelet_bits(12), sah_top_levels(false) {}
+};
+
+// Build a flattened, depth-first BVH over the given primitive bounds. The first
+// child of an interior node directly follows its parent, the second child is
+// stored in BVHNode::offset. The primitive order expected by the leaves is
+// written to order.
+void build_bvh_sah(
+    const std::vector<AABB> &bounds, const BVHBuildOptions &options,
+    std::vector<BVHNode> &nodes, std::vector<int> &order);
+
+// Same contract as build_bvh_sah, but sorts the primitives along a Morton curve
+// and emits independent treelets in parallel. With options.sah_top_levels the
+// treelets are joined by a SAH build, trading build time for trace quality.
+void build_bvh_lbvh(
+    const std::vector<AABB> &bounds, const BVHBuildOptions &options,
+    std::vector<BVHNode> &nodes, std::vector<int> &order);
+
+// SAH cost of the subtree stored in nodes[root ... end), relative to the
+// surface area of its root.
+number_t bvh_sah_cost(
+    const std::vector<BVHNode> &nodes, int root, int end, const BVHBuildOptions &options);
+
+// Stack traversal of the subtree at nodes[root] shared by the BVH based
+// structures. visit_leaf(node) is called for each leaf the ray enters within
+// [t_min, t_max] and returns true to end the traversal; it may shrink t_max
+// (a closer hit) to cull the remaining nodes. With dir_is_neg, the near child
+// is visited first so the far one is often culled; any-hit queries pass
+// nullptr and take the children in memory order.
+template <class LeafVisitor>
+inline void traverse_bvh(const BVHNode *nodes, int root, const Point3 &origin, const Vector3 &inv_direction,
+                         const bool *dir_is_neg, number_t t_min, const number_t &t_max, LeafVisitor visit_leaf)
+{
+    int stack[BVH_MAX_DEPTH];
+    int stack_size = 0;
+    int current = root;
+
+    while (true)
+    {
+        const BVHNode &node = nodes[current];
+        if (node.bounds.hit(origin, inv_direction, t_min, t_max))
+        {
+            if (node.is_leaf())
+            {
+                if (visit_leaf(node))
+                    return;
+            }
+            else
+            {
+                if (dir_is_neg && dir_is_neg[node.axis])
+                {
+                    stack[stack_size++] = current + 1;
+                    current = node.offset;
+                }
+                else
+                {
+                    stack[stack_size++] = node.offset;
+                    current = current + 1;
+                }
+                continue;
+            }
+        }
+
+        if (stack_size == 0)
+            return;
+        current = stack[--stack_size];
+    }
+}
+
+// Independently refittable part of a BVH, see BVH::refit.
+struct BVHSubtree
+{
+    int root;      // nodes[root ... end)
+    int end;
+    int first;     // objects[first ... last)
+    int last;
+    number_t cost; // SAH cost after the last (re)build
+};
+
+class BVH : public Hitable
+{
+    std::vector<BVHNode> _nodes;
+    std::vector<HitablePtr> _objects;
+    std::vector<HitablePtr> _unbounded; // no bounding box (e.g. Plane), tested before the tree
+    BVHBuildOptions _options;
+    number_t _cost; // SAH cost after the last full build
+    std::vector<BVHSubtree> _subtrees;
+    std::vector<int> _top_nodes; // ancestors of the subtrees, in depth-first order
+
+    void build(const std::vector<HitablePtr> &objects, const BVHBuildOptions &options);
+    void partition_subtrees();
+    void refit_node(int index);
+    void rebuild_subtree(BVHSubtree &subtree, std::vector<BVHNode> &nodes);
+    bool intersect_subtree(int root, const Ray &r, const Vector3 &inv_direction,
+                           number_t t_min, number_t &t_max, HitRecord &rec) const;
+
+public:
+    BVH() : _cost(0) {}
+    BVH(const HitableList &list, const BVHBuildOptions &options = BVHBuildOptions())
+    {
+        build(list.objects(), options);
+    }
+    BVH(const std::vector<HitablePtr> &objects, const BVHBuildOptions &options = BVHBuildOptions())
+    {
+        build(objects, options);
+    }
+
+    const std::vector<BVHNode> &nodes() const { return _nodes; }
+    const std::vector<HitablePtr> &objects() const { return _objects; }
+    const std::vector<HitablePtr> &unbounded() const { return _unbounded; }
+
+    // For animations that keep the objects but move them (e.g. Sphere::set_center).
+    // refit() recomputes all bounds bottom-up, in parallel over the subtrees.
+    // update() also rebuilds the subtrees whose SAH cost grew by more than a
+    // factor of max_cost_growth since their last build, or the whole tree if
+    // its cost did, and returns the number of rebuilt subtrees.
+    void refit();
+    int update(number_t max_cost_growth = 1.5);
+    number_t sah_cost() const;
+
+    virtual bool intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const override;
+    virtual bool bounding_box(AABB &output_box) const override;
+    virtual bool occluded(const Ray &r, number_t t_min, number_t t_max) const override;
+    virtual void hit_packet(
+        const RayPacket &packet, number_t t_min, number_t t_max, HitRecord *recs, bool *hits) const override;
+};
+
+#endif /* BVH_H */
@@ -0,0 +1,56 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef BVH_CACHE_H
+#define BVH_CACHE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <raytracing/raytracing.h>
+#include <raytracing/aabb.h>
+#include <raytracing/bvh.h>
+
+// Bump when the file layout or a builder changes its output.
+#define BVH_CACHE_VERSION 1
+
+// On-disk cache of built BVHs. A tree is fully determined by the primitive
+// bounds and the build options, so their hash names the cache file and a
+// matching file can replace the build. Files hold a small header, the nodes
+// and the primitive order; they are read through mmap.
+
+// 64 bit FNV-1a style hash of the primitive bounds and the options that affect the build.
+uint64_t hash_bvh_input(const std::vector<AABB> &bounds, const BVHBuildOptions &options);
+
+std::string bvh_cache_path(const std::string &directory, uint64_t hash);
+
+// Writes to a temporary file first and renames it, so concurrent renders
+// never see partial files. Creates the directory if needed.
+bool save_bvh_cache(
+    const std::string &path, uint64_t hash, const std::vector<BVHNode> &nodes, const std::vector<int> &order);
+
+// False (leaving nodes and order untouched) if the file is missing, belongs
+// to another hash or primitive count, or fails validation.
+bool load_bvh_cache(
+    const std::string &path, uint64_t hash, size_t primitive_count,
+    std::vector<BVHNode> &nodes, std::vector<int> &order);
+
+#endif /* BVH_CACHE_H */
@@ -25,7 +25,9 @@
 #include <raytracing/raytracing.h>
 #include <raytracing/vector3.h>
 #include <raytracing/ray.h>
+#include <raytracing/sampler.h>
 #include <raytracing/utils.h>
+#include <raytracing/warp.h>
 
 class Camera
 {
@@ -39,15 +41,16 @@ class Camera
 public:
     Camera()
     {
-        auto aspect_ratio = 16.0 / 9.0;
-        auto viewport_height = 2.0;
-        auto viewport_width = aspect_ratio * viewport_height;
-        auto focal_length = 1.0;
+        number_t aspect_ratio = 16.0 / 9.0;
+        number_t viewport_height = 2;
+        number_t viewport_width = aspect_ratio * viewport_height;
+        number_t focal_length = 1;
 
         origin = Point3{0};
         horizontal = Vector3{viewport_width, 0.0, 0.0};
         vertical = Vector3{0.0, viewport_height, 0.0};
         lower_left_corner = origin - horizontal / 2 - vertical / 2 - Vector3{0, 0, focal_length};
+        lens_radius = 0;
     }
     Camera(
         Point3 lookfrom,
@@ -59,9 +62,9 @@ public:
         number_t focus_dist)
     {
         auto theta = degrees_to_radians(vfov);
-        auto h = tan(theta / 2);
-        auto viewport_height = 2.0 * h;
-        auto viewport_width = aspect_ratio * viewport_height;
+        number_t h = std::tan(theta / 2);
+        number_t viewport_height = 2 * h;
+        number_t viewport_width = aspect_ratio * viewport_height;
 
         w = normalize_Vector3(lookfrom - lookat);
         u = normalize_Vector3(cross_Vector3(vup, w));
@@ -75,9 +78,20 @@ public:
         lens_radius = aperture / 2;
     }
 
+    // All rays share their origin, which makes neighbouring rays coherent.
+    bool is_pinhole() const { return lens_radius == 0; }
+
+    // Lens samples are drawn from sampler, or from thread_sampler() without one
     Ray get_ray(number_t s, number_t t) const
     {
-        Vector3 rd = lens_radius * random_in_unit_disk();
+        return get_ray(s, t, thread_sampler());
+    }
+
+    Ray get_ray(number_t s, number_t t, Sampler &sampler) const
+    {
+        const number_t lens_u = random_number_t(sampler);
+        const number_t lens_v = random_number_t(sampler);
+        Vector3 rd = lens_radius * concentric_disk(lens_u, lens_v);
         Vector3 offset = u * rd.x() + v * rd.y();
 
         return Ray(
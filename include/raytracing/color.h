@@ -39,14 +39,13 @@ class Color : public Vector3
     using Vector3::z;
 
 public:
-    Color() : Vector3{0, 0, 0} {}
-    Color(const number_t c) : Vector3{c, c, c} {}
-    Color(const Color &c) : Vector3{c.r(), c.g(), c.b()} {}
-    Color(const Vector3 &v) : Vector3{v} {}
-    Color(const number_t r, const number_t g, const number_t b) : Vector3{r, g, b} {}
-    number_t r() const { return x(); }
-    number_t g() const { return y(); }
-    number_t b() const { return z(); }
+    constexpr Color() : Vector3{0, 0, 0} {}
+    constexpr Color(const number_t c) : Vector3{c, c, c} {}
+    constexpr Color(const Vector3 &v) : Vector3{v} {}
+    constexpr Color(const number_t r, const number_t g, const number_t b) : Vector3{r, g, b} {}
+    constexpr number_t r() const { return x(); }
+    constexpr number_t g() const { return y(); }
+    constexpr number_t b() const { return z(); }
 };
 
 inline std::ostream &operator<<(std::ostream &out, const Color &c)
@@ -0,0 +1,95 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include <raytracing/raytracing.h>
+#include <raytracing/hitable.h>
+#include <raytracing/material.h>
+#include <raytracing/texture.h>
+#include <raytracing/sphere.h>
+#include <raytracing/plane.h>
+#include <raytracing/quad.h>
+#include <raytracing/box.h>
+
+// Closed-world dispatch: the built-in primitives and materials are reached
+// through a switch on their type and a qualified call, which the compiler can
+// inline into traversal and shading loops. They are final and the base
+// constructors taking a type are private to them, so the type tag cannot name
+// a base of an overriding class or of an unrelated one. Types it does not
+// know, e.g. user extensions deriving from Hitable or Material, get the tag
+// Other and fall back to the virtual interface. dispatch_value() for textures
+// lives in texture.h.
+
+inline bool dispatch_intersect(
+    const Hitable &object, const Ray &r, number_t t_min, number_t t_max, HitRecord &rec)
+{
+    switch (object.type())
+    {
+    case HitableType::Sphere:
+        return static_cast<const Sphere &>(object).Sphere::intersect(r, t_min, t_max, rec);
+    case HitableType::Plane:
+        return static_cast<const Plane &>(object).Plane::intersect(r, t_min, t_max, rec);
+    case HitableType::Quad:
+        return static_cast<const Quad &>(object).Quad::intersect(r, t_min, t_max, rec);
+    case HitableType::Box:
+        return static_cast<const Box &>(object).Box::intersect(r, t_min, t_max, rec);
+    default:
+        return object.intersect(r, t_min, t_max, rec);
+    }
+}
+
+inline bool dispatch_occluded(const Hitable &object, const Ray &r, number_t t_min, number_t t_max)
+{
+    switch (object.type())
+    {
+    case HitableType::Sphere:
+        return static_cast<const Sphere &>(object).Sphere::occluded(r, t_min, t_max);
+    case HitableType::Plane:
+        return static_cast<const Plane &>(object).Plane::occluded(r, t_min, t_max);
+    case HitableType::Quad:
+        return static_cast<const Quad &>(object).Quad::occluded(r, t_min, t_max);
+    case HitableType::Box:
+        return static_cast<const Box &>(object).Box::occluded(r, t_min, t_max);
+    default:
+        return object.occluded(r, t_min, t_max);
+    }
+}
+
+inline bool dispatch_scatter(
+    const Material &material, const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered,
+    Sampler &sampler)
+{
+    switch (material.type())
+    {
+    case MaterialType::Lambertian:
+        return static_cast<const Lambertian &>(material).Lambertian::scatter(r_in, rec, attenuation, scattered, sampler);
+    case MaterialType::Metal:
+        return static_cast<const Metal &>(material).Metal::scatter(r_in, rec, attenuation, scattered, sampler);
+    case MaterialType::Dielectric:
+        return static_cast<const Dielectric &>(material).Dielectric::scatter(r_in, rec, attenuation, scattered, sampler);
+    default:
+        return material.scatter(r_in, rec, attenuation, scattered, sampler);
+    }
+}
+
+#endif /* DISPATCH_H */
@@ -0,0 +1,72 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef GRID_H
+#define GRID_H
+
+#include <memory>
+#include <vector>
+#include <raytracing/raytracing.h>
+#include <raytracing/hitable.h>
+#include <raytracing/hitable_list.h>
+#include <raytracing/aabb.h>
+
+// Uniform grid traversed with a 3D-DDA. Best suited for many primitives of
+// similar size spread evenly over the scene. Objects larger than a cell (or
+// without bounds) are kept in an overflow list that is tested for every ray.
+class UniformGrid : public Hitable
+{
+    AABB _bounds;
+    int _resolution[3];
+    Vector3 _cell_size;
+    Vector3 _inv_cell_size;
+    std::vector<int> _cell_offsets; // objects of cell c: _cell_objects[_cell_offsets[c] ... _cell_offsets[c + 1])
+    std::vector<int> _cell_objects;
+    std::vector<HitablePtr> _objects;
+    std::vector<HitablePtr> _overflow;
+
+    void choose_resolution(const AABB &bounds, size_t count, number_t density);
+    void build(const std::vector<HitablePtr> &objects, number_t density, const int *resolution);
+    int cell_index(int x, int y, int z) const { return (z * _resolution[1] + y) * _resolution[0] + x; }
+
+    struct DDA; // cell walk along a ray, see grid.cpp
+    bool begin_dda(const Ray &r, number_t t_min, number_t t_max, DDA &dda) const;
+
+public:
+    UniformGrid() {}
+    // Automatic resolution with about density objects per cell
+    UniformGrid(const HitableList &list, number_t density = 3) { build(list.objects(), density, NULL); }
+    // Fixed resolution, components below one are raised to one
+    UniformGrid(const HitableList &list, int nx, int ny, int nz)
+    {
+        int resolution[3] = {nx, ny, nz};
+        build(list.objects(), 0, resolution);
+    }
+
+    int resolution(int axis) const { return _resolution[axis]; }
+    const std::vector<HitablePtr> &overflow() const { return _overflow; }
+
+    virtual bool intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const override;
+    virtual bool bounding_box(AABB &output_box) const override;
+    virtual bool occluded(const Ray &r, number_t t_min, number_t t_max) const override;
+};
+
+#endif /* GRID_H */
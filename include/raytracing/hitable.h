@@ -22,32 +22,123 @@
 #ifndef HITABLE_H
 #define HITABLE_H
 
+#include <memory>
 #include <raytracing/raytracing.h>
 #include <raytracing/ray.h>
+#include <raytracing/aabb.h>
+#include <raytracing/packet.h>
 
 class Material;
+class Hitable;
 
+// Hitable::intersect() only fills t, object, instance and primitive, the rest
+// is evaluated by Hitable::complete() once the closest hit is known. In between
+// a primitive may keep its own data in the other fields (e.g. barycentrics in p).
 struct HitRecord
 {
     Point3 p;
     Vector3 normal;
     number_t t;
-    std::shared_ptr<Material> material;
+    const Material *material; // owned by the scene
     bool front_face;
-    double u;
-    double v;
+    number_t u;
+    number_t v;
+    number_t error; // bound on the absolute rounding error of each coordinate of p
+    const Hitable *object;   // primitive that was hit
+    const Hitable *instance; // instance placing object in the world, if any
+    int primitive;           // element of object that was hit (sphere, triangle)
 
     inline void set_face_normal(const Ray &r, const Vector3 &outward_normal)
     {
         front_face = r.direction().dot(outward_normal) < 0;
         normal = front_face ? outward_normal : -outward_normal;
     }
+
+    // Ray leaving the surface at p, trace it with t_min = spawn_t_min
+    inline Ray spawn_ray(const Vector3 &direction) const
+    {
+        return Ray(offset_ray_origin(p, error, normal, direction), direction);
+    }
+};
+
+// Concrete type of a primitive, for the closed-world dispatch in dispatch.h.
+// Anything not listed is reached through virtual calls.
+enum class HitableType
+{
+    Sphere,
+    Plane,
+    Quad,
+    Box,
+    Other
 };
 
 class Hitable
 {
+    // The built-in primitives are final and the only ones allowed to name
+    // their type, so the tag always names the class whose methods dispatch.h
+    // calls.
+    HitableType _type;
+
+    Hitable(HitableType type) : _type(type) {}
+    friend class Sphere;
+    friend class Plane;
+    friend class Quad;
+    friend class Box;
+
 public:
-    virtual bool hit(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const = 0;
+    Hitable() : _type(HitableType::Other) {}
+
+    HitableType type() const { return _type; }
+
+    // Closest hit within [t_min, t_max] with all fields of rec filled. Only the
+    // closest hit is evaluated, see intersect() and complete().
+    bool hit(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
+    {
+        if (!intersect(r, t_min, t_max, rec))
+            return false;
+        complete(r, rec);
+        return true;
+    }
+
+    // Closest hit within [t_min, t_max], filling only t, object, instance and
+    // primitive. rec is written only when returning true, so aggregates pass
+    // the same record to all children while t_max shrinks.
+    virtual bool intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const = 0;
+    virtual bool bounding_box(AABB &output_box) const = 0;
+
+    // Evaluates p, normal, front_face, error and material of a hit returned by
+    // intersect() of this object, for the same ray.
+    virtual void compute_interaction(const Ray & /*r*/, HitRecord & /*rec*/) const {}
+    // Evaluates u and v, after compute_interaction().
+    virtual void compute_uv(const Ray & /*r*/, HitRecord & /*rec*/) const {}
+
+    // Finishes a record filled by intersect(). Texture coordinates cost
+    // transcendentals on spheres and are skipped unless the material reads them.
+    static void complete(const Ray &r, HitRecord &rec);
+
+    // Whether anything blocks the ray within [t_min, t_max], for shadow and
+    // visibility rays. Overrides stop at the first intersection found and fill
+    // no HitRecord, so materials and texture coordinates are never touched.
+    virtual bool occluded(const Ray &r, number_t t_min, number_t t_max) const
+    {
+        HitRecord rec;
+        return intersect(r, t_min, t_max, rec);
+    }
+
+    // Closest hits of all rays of a packet, hits[k] tells whether packet.rays[k]
+    // hit anything. Acceleration structures override this with packet traversal.
+    virtual void hit_packet(
+        const RayPacket &packet, number_t t_min, number_t t_max, HitRecord *recs, bool *hits) const
+    {
+        for (int k = 0; k < packet.size; ++k)
+            hits[k] = hit(packet.rays[k], t_min, t_max, recs[k]);
+    }
+
+    // Closest hits of count unrelated rays, e.g. a wave of paths, traced in
+    // parallel. The default traces them one by one; structures that profit
+    // from seeing many rays at once, like OutOfCoreMesh, override this.
+    virtual void hit_batch(
+        const Ray *rays, int count, number_t t_min, number_t t_max, HitRecord *recs, bool *hits) const;
 };
 
 #endif /* HITABLE_H */
\ No newline at end of file
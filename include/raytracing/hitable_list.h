@@ -25,40 +25,70 @@
 #include <memory>
 #include <vector>
 #include <raytracing/hitable.h>
+#include <raytracing/dispatch.h>
 
 typedef std::shared_ptr<Hitable> HitablePtr;
 
 class HitableList : public Hitable
 {
-    std::vector<HitablePtr> objects;
+    std::vector<HitablePtr> _objects;
 
 public:
     HitableList() {}
     HitableList(HitablePtr object) { add(object); }
 
-    void clear() { objects.clear(); }
-    void add(HitablePtr object) { objects.push_back(object); }
+    void clear() { _objects.clear(); }
+    void add(HitablePtr object) { _objects.push_back(object); }
 
-    virtual bool hit(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const override;
+    const std::vector<HitablePtr> &objects() const { return _objects; }
+
+    virtual bool intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const override;
+    virtual bool bounding_box(AABB &output_box) const override;
+    virtual bool occluded(const Ray &r, number_t t_min, number_t t_max) const override;
 };
 
-bool HitableList::hit(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
+inline bool HitableList::intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
 {
-    HitRecord temp_rec;
     bool hit_anything = false;
     auto closest_so_far = t_max;
 
-    for (const auto &object : objects)
+    for (const auto &object : _objects)
     {
-        if (object->hit(r, t_min, closest_so_far, temp_rec))
+        if (dispatch_intersect(*object, r, t_min, closest_so_far, rec))
         {
             hit_anything = true;
-            closest_so_far = temp_rec.t;
-            rec = temp_rec;
+            closest_so_far = rec.t;
         }
     }
 
     return hit_anything;
 }
 
+inline bool HitableList::occluded(const Ray &r, number_t t_min, number_t t_max) const
+{
+    for (const auto &object : _objects)
+        if (dispatch_occluded(*object, r, t_min, t_max))
+            return true;
+
+    return false;
+}
+
+inline bool HitableList::bounding_box(AABB &output_box) const
+{
+    if (_objects.empty())
+        return false;
+
+    AABB temp_box;
+    output_box = AABB();
+
+    for (const auto &object : _objects)
+    {
+        if (!object->bounding_box(temp_box))
+            return false;
+        output_box.extend(temp_box);
+    }
+
+    return true;
+}
+
 #endif /* HITABLE_LIST_H */
\ No newline at end of file
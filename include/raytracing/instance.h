@@ -0,0 +1,62 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef INSTANCE_H
+#define INSTANCE_H
+
+#include <memory>
+#include <raytracing/raytracing.h>
+#include <raytracing/hitable.h>
+#include <raytracing/material.h>
+#include <raytracing/transform.h>
+
+// Placement of a shared bottom-level object (usually a BVH) in the world. A BVH
+// over many instances forms the top level of a two-level acceleration structure.
+// A singular transform flattens the object to no area, such instances are never hit.
+class Instance : public Hitable
+{
+    std::shared_ptr<Hitable> _object;
+    Transform _transform; // object to world
+    MaterialPtr _material;
+    AABB _bounds;
+    bool _has_bounds;
+
+public:
+    Instance(std::shared_ptr<Hitable> object, const Transform &transform, MaterialPtr material = NULL)
+        : _object(object), _transform(transform), _material(material)
+    {
+        AABB box;
+        _has_bounds = _object->bounding_box(box);
+        if (_has_bounds)
+            _bounds = _transform.box(box);
+    }
+
+    const Transform &transform() const { return _transform; }
+    std::shared_ptr<Hitable> object() const { return _object; }
+
+    virtual bool intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const override;
+    virtual bool bounding_box(AABB &output_box) const override;
+    virtual void compute_interaction(const Ray &r, HitRecord &rec) const override;
+    virtual void compute_uv(const Ray &r, HitRecord &rec) const override;
+    virtual bool occluded(const Ray &r, number_t t_min, number_t t_max) const override;
+};
+
+#endif /* INSTANCE_H */
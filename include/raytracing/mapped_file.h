@@ -0,0 +1,67 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Read-only view of a whole file, mapped with mmap where available and read
+// into memory otherwise. Empty files and errors give is_open() == false.
+class MappedFile
+{
+    const char *_data;
+    size_t _size;
+    bool _mapped;
+    std::vector<char> _buffer; // fallback without mmap
+
+public:
+    MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool is_open() const { return _data != NULL; }
+    const char *data() const { return _data; }
+    size_t size() const { return _size; }
+
+    // Tell the kernel the file is read front to back and to start reading it,
+    // e.g. before parsing. Hints only, no-op without mmap.
+    void advise_sequential() const;
+    // Tell the kernel not to read ahead, for files accessed in scattered chunks
+    void advise_random() const;
+    // Start reading [offset, offset + size) in one go
+    void prefetch(size_t offset, size_t size) const;
+    // Drop the whole pages within [offset, offset + size) from the process,
+    // they are read from the file again on the next access. No-op without mmap.
+    void release(size_t offset, size_t size) const;
+};
+
+// Name to write a file under before renaming it to path. It lies next to
+// path, so the rename stays within one file system, and holds the process id
+// (where available) and a call counter, so concurrent writers of the same
+// path never share it.
+std::string temporary_path(const std::string &path);
+
+#endif /* MAPPED_FILE_H */
@@ -27,50 +27,89 @@
 #include <raytracing/hitable.h>
 #include <raytracing/color.h>
 #include <raytracing/ray.h>
+#include <raytracing/sampler.h>
 #include <raytracing/texture.h>
 
 typedef std::shared_ptr<Material> MaterialPtr;
 
+// Concrete type of a material, lets integrators batch shading work per type.
+enum class MaterialType
+{
+    Lambertian,
+    Metal,
+    Dielectric,
+    Other
+};
+
+const int MATERIAL_TYPE_COUNT = 4;
+
 class Material
 {
+    // The built-in materials are final and the only ones allowed to name
+    // their type, so the tag always names the class whose scatter()
+    // dispatch.h calls.
+    MaterialType _type;
+
+    Material(MaterialType type) : _type(type) {}
+    friend class Lambertian;
+    friend class Metal;
+    friend class Dielectric;
+
 public:
+    Material() : _type(MaterialType::Other) {}
+
+    // Random decisions draw from sampler, the overload without one from
+    // thread_sampler()
     virtual bool scatter(
-        const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered) const = 0;
+        const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered, Sampler &sampler) const = 0;
+    bool scatter(const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered) const
+    {
+        return scatter(r_in, rec, attenuation, scattered, thread_sampler());
+    }
+    MaterialType type() const { return _type; }
+    // Whether scatter() reads the texture coordinates of the hit
+    virtual bool needs_uv() const { return false; }
 };
 
-class Lambertian : public Material
+class Lambertian final : public Material
 {
     std::shared_ptr<Texture> _albedo;
 
 public:
-    Lambertian(const Color &albedo) : _albedo(std::make_shared<SolidColor>(albedo)) {}
-    Lambertian(std::shared_ptr<Texture> texture) : _albedo(texture) {}
+    Lambertian(const Color &albedo)
+        : Material(MaterialType::Lambertian), _albedo(std::make_shared<SolidColor>(albedo)) {}
+    Lambertian(std::shared_ptr<Texture> texture) : Material(MaterialType::Lambertian), _albedo(texture) {}
 
+    using Material::scatter;
     virtual bool scatter(
-        const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered) const override;
+        const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered, Sampler &sampler) const override;
+    virtual bool needs_uv() const override { return _albedo->needs_uv(); }
 };
 
-class Metal : public Material
+class Metal final : public Material
 {
     Color _albedo;
     number_t _fuzz;
 
 public:
-    Metal(const Color &albedo, const number_t fuzz) : _albedo(albedo), _fuzz(fuzz < 1 ? fuzz : 1) {}
+    Metal(const Color &albedo, const number_t fuzz)
+        : Material(MaterialType::Metal), _albedo(albedo), _fuzz(fuzz < 1 ? fuzz : 1) {}
 
+    using Material::scatter;
     virtual bool scatter(
-        const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered) const override;
+        const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered, Sampler &sampler) const override;
 };
 
-class Dielectric : public Material
+class Dielectric final : public Material
 {
     number_t _ir; // Index of Refraction
 
 public:
-    Dielectric(number_t index_of_refraction) : _ir(index_of_refraction) {}
+    Dielectric(number_t index_of_refraction) : Material(MaterialType::Dielectric), _ir(index_of_refraction) {}
 
+    using Material::scatter;
     virtual bool scatter(
-        const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered) const override;
+        const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered, Sampler &sampler) const override;
 };
 
 #endif /* MATERIAL_H */
\ No newline at end of file
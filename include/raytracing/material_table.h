@@ -0,0 +1,61 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef MATERIAL_TABLE_H
+#define MATERIAL_TABLE_H
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <raytracing/raytracing.h>
+#include <raytracing/material.h>
+
+// 32-bit reference to a material of a MaterialTable
+typedef uint32_t MaterialHandle;
+
+const MaterialHandle NO_MATERIAL = UINT32_MAX;
+
+// Keeps the materials of a scene alive and hands out handles to them.
+// Primitives with many materials store handles instead of shared pointers,
+// and hit records point to materials without owning them, so reference
+// counts are only touched while the scene is set up, never per ray.
+class MaterialTable
+{
+    std::vector<MaterialPtr> _materials;
+    std::unordered_map<const Material *, MaterialHandle> _handles;
+
+public:
+    // Handle of material, registering it on first use. NULL maps to NO_MATERIAL.
+    MaterialHandle add(const MaterialPtr &material);
+
+    const Material *get(MaterialHandle handle) const
+    {
+        return handle == NO_MATERIAL ? NULL : _materials[handle].get();
+    }
+    MaterialPtr material(MaterialHandle handle) const
+    {
+        return handle == NO_MATERIAL ? NULL : _materials[handle];
+    }
+
+    int size() const { return static_cast<int>(_materials.size()); }
+};
+
+#endif /* MATERIAL_TABLE_H */
@@ -0,0 +1,61 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef MESH_LOADER_H
+#define MESH_LOADER_H
+
+#include <memory>
+#include <string>
+#include <raytracing/raytracing.h>
+#include <raytracing/material.h>
+#include <raytracing/triangle_mesh.h>
+
+struct MeshLoadStats
+{
+    size_t bytes;      // file size
+    double parse_time; // mapping, parsing and triangle bounds [s]
+    double build_time; // BVH construction [s]
+};
+
+// Loaders that map the file and parse it in parallel chunks straight into the
+// TriangleMesh buffers. Each chunk also computes the bounds of its triangles,
+// so the BVH build starts right after the last chunk. Polygons are split into
+// triangle fans. Return NULL if the file cannot be read or is malformed.
+
+// Binary PLY, little or big endian: vertex x, y, z with optional nx, ny, nz
+// and u, v (or s, t), faces as a vertex_indices list.
+std::shared_ptr<TriangleMesh> load_ply(
+    const std::string &path, MaterialPtr material,
+    const BVHBuildOptions &options = TriangleMesh::default_build_options(), MeshLoadStats *stats = NULL);
+
+// Wavefront OBJ with v, vt, vn and f lines (negative indices allowed), other
+// statements are skipped. Normals and UVs are kept only if they are per
+// vertex, i.e. every face corner uses the same index for v, vt and vn.
+std::shared_ptr<TriangleMesh> load_obj(
+    const std::string &path, MaterialPtr material,
+    const BVHBuildOptions &options = TriangleMesh::default_build_options(), MeshLoadStats *stats = NULL);
+
+// Chooses the loader by file extension (.ply or .obj)
+std::shared_ptr<TriangleMesh> load_mesh(
+    const std::string &path, MaterialPtr material,
+    const BVHBuildOptions &options = TriangleMesh::default_build_options(), MeshLoadStats *stats = NULL);
+
+#endif /* MESH_LOADER_H */
@@ -0,0 +1,130 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef OUT_OF_CORE_MESH_H
+#define OUT_OF_CORE_MESH_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <raytracing/raytracing.h>
+#include <raytracing/hitable.h>
+#include <raytracing/material.h>
+#include <raytracing/bvh.h>
+#include <raytracing/mapped_file.h>
+#include <raytracing/triangle_mesh.h>
+
+// Bump when the file layout changes
+#define OUT_OF_CORE_VERSION 1
+
+// Triangles per cluster, about 600 KiB of vertices in double precision
+#define OUT_OF_CORE_CLUSTER_TRIANGLES 4096
+
+// Triangle mesh traced straight from a file, for meshes that do not fit in
+// memory. write() cuts the BVH of a TriangleMesh into clusters, subtrees of
+// at most cluster_triangles triangles stored page aligned with their nodes
+// and vertices. Only the levels above the clusters are read into memory, the
+// rest of the file is mapped and the kernel pages a cluster in when a ray
+// first reaches it. Once the clusters touched add up to more than the memory
+// cap, the least recently used ones are released again.
+//
+// Rays traced one by one page in on demand. hit_batch() runs all rays through
+// the resident levels first and queues them per cluster, then visits each
+// cluster once with its whole queue, so a page-in serves many rays.
+class OutOfCoreMesh : public Hitable
+{
+    struct Cluster
+    {
+        size_t offset; // in the file
+        size_t size;   // bytes
+        int first;     // first triangle slot
+        const BVHNode *nodes;
+        const number_t *positions; // blocks of 9 x TRIANGLE_MESH_WIDTH, a.x, a.y, ..., c.z
+        const number_t *normals;   // 9 per slot, optional
+        const number_t *uvs;       // 6 per slot, optional
+    };
+
+    struct TraversalRay; // see out_of_core_mesh.cpp
+
+    std::unique_ptr<MappedFile> _file;
+    MaterialPtr _material;
+    int _triangle_count;
+    AABB _bounds;
+    std::vector<BVHNode> _nodes; // resident levels, leaves hold one cluster
+    std::vector<Cluster> _clusters;
+    std::vector<int> _firsts; // first slot of each cluster, to find the cluster of a hit
+
+    // Least recently used bookkeeping. _last_use is zero for clusters not
+    // paged in, otherwise the value of _clock when last touched; the clock
+    // only advances on page-ins, so touching is a plain load most of the time.
+    size_t _memory_cap;
+    std::unique_ptr<std::atomic<uint64_t>[]> _last_use;
+    mutable std::atomic<uint64_t> _clock;
+    mutable std::atomic<size_t> _resident;
+    mutable std::atomic<size_t> _page_ins;
+    mutable std::mutex _release_mutex;
+
+    void touch(int cluster) const;
+    void page_in(int cluster) const;
+    void release(int keep) const;
+    int cluster_of(int slot) const;
+
+    int hit_cluster(int cluster, const TraversalRay &ray, number_t t_min, number_t &t_max, number_t *barycentric,
+                    bool any_hit) const;
+    void record_hit(int slot, number_t t, const number_t *barycentric, HitRecord &rec) const;
+
+public:
+    // Writes mesh as clusters of at most cluster_triangles triangles (rounded
+    // to whole SIMD blocks) to path. Files depend on number_t and the SIMD width.
+    static bool write(const std::string &path, const TriangleMesh &mesh,
+                      int cluster_triangles = OUT_OF_CORE_CLUSTER_TRIANGLES);
+
+    // Maps a file written by write(), keeping cluster pages within about
+    // memory_cap bytes, zero for no limit. is_open() is false if the file is
+    // missing or was written by another build.
+    OutOfCoreMesh(const std::string &path, MaterialPtr material, size_t memory_cap = 0);
+
+    bool is_open() const { return _file && _file->is_open(); }
+    int triangle_count() const { return _triangle_count; }
+    int cluster_count() const { return static_cast<int>(_clusters.size()); }
+    size_t file_size() const { return _file ? _file->size() : 0; }
+    // Bytes always in memory: the resident levels and the cluster table
+    size_t memory() const;
+
+    size_t memory_cap() const { return _memory_cap; }
+    void set_memory_cap(size_t bytes) { _memory_cap = bytes; }
+    // Bytes of the clusters currently paged in, and how often one was paged in
+    size_t resident_bytes() const { return _resident; }
+    size_t page_ins() const { return _page_ins; }
+
+    virtual bool intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const override;
+    virtual bool bounding_box(AABB &output_box) const override;
+    virtual void compute_interaction(const Ray &r, HitRecord &rec) const override;
+    virtual void compute_uv(const Ray &r, HitRecord &rec) const override;
+    virtual bool occluded(const Ray &r, number_t t_min, number_t t_max) const override;
+    virtual void hit_batch(
+        const Ray *rays, int count, number_t t_min, number_t t_max, HitRecord *recs, bool *hits) const override;
+};
+
+#endif /* OUT_OF_CORE_MESH_H */
@@ -0,0 +1,84 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef PACKET_H
+#define PACKET_H
+
+#include <raytracing/raytracing.h>
+#include <raytracing/vector3.h>
+#include <raytracing/ray.h>
+
+// Maximum number of rays in a packet, an 8x8 pixel tile.
+#define RAY_PACKET_SIZE 64
+
+// Coherent rays, e.g. the primary rays of a pixel tile, traced together. Next to
+// the rays themselves the origins and reciprocal directions are kept in
+// structure-of-arrays form, along with their intervals over the packet.
+struct RayPacket
+{
+    int size;
+    Ray rays[RAY_PACKET_SIZE];
+    number_t origin[3][RAY_PACKET_SIZE];
+    number_t inv_direction[3][RAY_PACKET_SIZE];
+    number_t origin_min[3], origin_max[3];
+    number_t inv_direction_min[3], inv_direction_max[3];
+    bool coherent; // all directions have the same signs
+
+    RayPacket() : size(0), coherent(false) {}
+
+    void clear() { size = 0; }
+
+    void add(const Ray &r)
+    {
+        Point3 o = r.origin();
+        Vector3 d = r.direction();
+        rays[size] = r;
+        for (int a = 0; a < 3; ++a)
+        {
+            // Avoid 0 * inf = NaN in the slab tests for axis-parallel rays
+            number_t da = fabs(d[a]) > 1e-12 ? d[a] : (d[a] < 0 ? -1e-12 : 1e-12);
+            origin[a][size] = o[a];
+            inv_direction[a][size] = 1 / da;
+        }
+        ++size;
+    }
+
+    // Update the intervals and coherence after adding the rays.
+    void update_bounds()
+    {
+        coherent = size > 0;
+        for (int a = 0; a < 3; ++a)
+        {
+            origin_min[a] = origin_max[a] = origin[a][0];
+            inv_direction_min[a] = inv_direction_max[a] = inv_direction[a][0];
+            for (int k = 1; k < size; ++k)
+            {
+                origin_min[a] = fmin(origin_min[a], origin[a][k]);
+                origin_max[a] = fmax(origin_max[a], origin[a][k]);
+                inv_direction_min[a] = fmin(inv_direction_min[a], inv_direction[a][k]);
+                inv_direction_max[a] = fmax(inv_direction_max[a], inv_direction[a][k]);
+            }
+            coherent = coherent && (inv_direction_min[a] > 0 || inv_direction_max[a] < 0);
+        }
+    }
+};
+
+#endif /* PACKET_H */
@@ -0,0 +1,103 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef PLANE_H
+#define PLANE_H
+
+#include <raytracing/raytracing.h>
+#include <raytracing/hitable.h>
+#include <raytracing/material.h>
+
+// Infinite plane through a point. It has no bounding box, so acceleration
+// structures keep it out of their trees and test it against every ray, which
+// is cheap and lets a ground plane cull everything below it early.
+class Plane final : public Hitable
+{
+    Point3 _point;
+    Vector3 _normal;    // unit length
+    number_t _offset;   // _normal.dot(_point)
+    Vector3 _tangent;   // texture coordinate axes, unit length
+    Vector3 _bitangent;
+    MaterialPtr _material;
+
+public:
+    Plane(const Point3 &point, const Vector3 &normal, MaterialPtr material = NULL)
+        : Hitable(HitableType::Plane), _point(point), _normal(normalize_Vector3(normal)), _material(material)
+    {
+        _offset = _normal.dot(_point);
+        Vector3 axis = std::fabs(_normal.x()) > 0.9 ? Vector3{0, 0, 1} : Vector3{1, 0, 0};
+        _bitangent = normalize_Vector3(cross_Vector3(_normal, axis));
+        _tangent = cross_Vector3(_bitangent, _normal);
+    }
+
+    Point3 point() const { return _point; }
+    Vector3 normal() const { return _normal; }
+    MaterialPtr material() const { return _material; }
+
+    virtual bool intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const override;
+    virtual bool bounding_box(AABB & /*output_box*/) const override { return false; }
+    virtual void compute_interaction(const Ray &r, HitRecord &rec) const override;
+    virtual void compute_uv(const Ray &r, HitRecord &rec) const override;
+    virtual bool occluded(const Ray &r, number_t t_min, number_t t_max) const override;
+};
+
+inline bool Plane::intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
+{
+    // Rays parallel to the plane give an infinite or NaN root, both fail the range test.
+    auto t = (_offset - _normal.dot(r.origin())) / _normal.dot(r.direction());
+    if (!(t_min <= t && t <= t_max))
+        return false;
+
+    rec.t = t;
+    rec.object = this;
+    rec.instance = NULL;
+    rec.primitive = 0;
+
+    return true;
+}
+
+inline void Plane::compute_interaction(const Ray &r, HitRecord &rec) const
+{
+    // Back onto the plane, the error then only depends on the magnitude of p
+    Point3 p = r.at(rec.t);
+    rec.p = p - (_normal.dot(p) - _offset) * _normal;
+    number_t magnitude = std::fmax(std::fmax(std::fabs(rec.p.x()), std::fabs(rec.p.y())), std::fabs(rec.p.z()));
+    rec.error = error_gamma(8) * (magnitude + std::fabs(_offset));
+
+    rec.set_face_normal(r, _normal);
+    rec.material = _material.get();
+}
+
+inline void Plane::compute_uv(const Ray &r, HitRecord &rec) const
+{
+    // Distances along the plane, textures repeat them as they see fit
+    Vector3 d = r.at(rec.t) - _point;
+    rec.u = d.dot(_tangent);
+    rec.v = d.dot(_bitangent);
+}
+
+inline bool Plane::occluded(const Ray &r, number_t t_min, number_t t_max) const
+{
+    auto t = (_offset - _normal.dot(r.origin())) / _normal.dot(r.direction());
+    return t_min <= t && t <= t_max;
+}
+
+#endif /* PLANE_H */
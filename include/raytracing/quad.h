@@ -0,0 +1,126 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef QUAD_H
+#define QUAD_H
+
+#include <raytracing/raytracing.h>
+#include <raytracing/hitable.h>
+#include <raytracing/material.h>
+
+// Parallelogram spanned by the edges u and v from corner, with texture
+// coordinates running from 0 to 1 along the two edges.
+class Quad final : public Hitable
+{
+    Point3 _corner;
+    Vector3 _u, _v;
+    Vector3 _normal;  // unit length
+    number_t _offset; // _normal.dot(_corner)
+    Vector3 _w;       // maps a point in the plane to its edge coordinates
+    MaterialPtr _material;
+    AABB _bounds;
+
+    bool root(const Ray &r, number_t t_min, number_t t_max, number_t &t, number_t &alpha, number_t &beta) const;
+
+public:
+    Quad(const Point3 &corner, const Vector3 &u, const Vector3 &v, MaterialPtr material = NULL)
+        : Hitable(HitableType::Quad), _corner(corner), _u(u), _v(v), _material(material)
+    {
+        Vector3 n = cross_Vector3(_u, _v);
+        _normal = normalize_Vector3(n);
+        _offset = _normal.dot(_corner);
+        _w = n / n.dot(n);
+
+        _bounds.extend(_corner);
+        _bounds.extend(_corner + _u);
+        _bounds.extend(_corner + _v);
+        _bounds.extend(_corner + _u + _v);
+        _bounds = _bounds.padded();
+    }
+
+    Point3 corner() const { return _corner; }
+    Vector3 u() const { return _u; }
+    Vector3 v() const { return _v; }
+    MaterialPtr material() const { return _material; }
+
+    virtual bool intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const override;
+    virtual bool bounding_box(AABB &output_box) const override;
+    virtual void compute_interaction(const Ray &r, HitRecord &rec) const override;
+    virtual bool occluded(const Ray &r, number_t t_min, number_t t_max) const override;
+};
+
+inline bool Quad::root(
+    const Ray &r, number_t t_min, number_t t_max, number_t &t, number_t &alpha, number_t &beta) const
+{
+    // Rays parallel to the quad give an infinite or NaN root, both fail the range test.
+    t = (_offset - _normal.dot(r.origin())) / _normal.dot(r.direction());
+    if (!(t_min <= t && t <= t_max))
+        return false;
+
+    Vector3 d = r.at(t) - _corner;
+    alpha = _w.dot(cross_Vector3(d, _v));
+    beta = _w.dot(cross_Vector3(_u, d));
+    return 0 <= alpha && alpha <= 1 && 0 <= beta && beta <= 1;
+}
+
+inline bool Quad::intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
+{
+    number_t t, alpha, beta;
+    if (!root(r, t_min, t_max, t, alpha, beta))
+        return false;
+
+    // The edge coordinates are the texture coordinates, keep them for compute_interaction()
+    rec.t = t;
+    rec.object = this;
+    rec.instance = NULL;
+    rec.primitive = 0;
+    rec.u = alpha;
+    rec.v = beta;
+
+    return true;
+}
+
+inline bool Quad::bounding_box(AABB &output_box) const
+{
+    output_box = _bounds;
+    return true;
+}
+
+inline void Quad::compute_interaction(const Ray &r, HitRecord &rec) const
+{
+    // Rebuilt from the edge coordinates like a triangle from its barycentrics
+    Vector3 a = rec.u * _u, b = rec.v * _v;
+    rec.p = _corner + a + b;
+    rec.error = 0;
+    for (int k = 0; k < 3; ++k)
+        rec.error = std::fmax(rec.error, error_gamma(7) * (std::fabs(_corner[k]) + std::fabs(a[k]) + std::fabs(b[k])));
+
+    rec.set_face_normal(r, _normal);
+    rec.material = _material.get();
+}
+
+inline bool Quad::occluded(const Ray &r, number_t t_min, number_t t_max) const
+{
+    number_t t, alpha, beta;
+    return root(r, t_min, t_max, t, alpha, beta);
+}
+
+#endif /* QUAD_H */
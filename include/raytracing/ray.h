@@ -22,6 +22,8 @@
 #ifndef RAY_H
 #define RAY_H
 
+#include <cmath>
+#include <limits>
 #include <raytracing/raytracing.h>
 #include <raytracing/vector3.h>
 
@@ -40,4 +42,30 @@ public:
     Point3 at(number_t t) const { return _origin + t * _direction; }
 };
 
+// Smallest t_min for rays leaving a surface through offset_ray_origin. Their
+// origin is already off the surface, only a root at exactly zero is excluded.
+const number_t spawn_t_min = std::numeric_limits<number_t>::min();
+
+// Moves a point p on a surface with normal n out of the error bound of p
+// (absolute, per coordinate) to the side of direction, so a ray leaving from
+// there cannot hit the surface it starts on again. This replaces a fixed
+// minimum distance, which is too small for float and needlessly large for
+// double. See Pharr, Jakob and Humphreys, Physically Based Rendering, 3.9.5.
+inline Point3 offset_ray_origin(const Point3 &p, number_t error, const Vector3 &n, const Vector3 &direction)
+{
+    number_t d = error * (std::fabs(n.x()) + std::fabs(n.y()) + std::fabs(n.z()));
+    Vector3 offset = direction.dot(n) < 0 ? -d * n : d * n;
+    Point3 origin = p + offset;
+
+    // The addition may round back towards p
+    for (int a = 0; a < 3; ++a)
+    {
+        if (offset[a] > 0)
+            origin[a] = std::nextafter(origin[a], std::numeric_limits<number_t>::infinity());
+        else if (offset[a] < 0)
+            origin[a] = std::nextafter(origin[a], -std::numeric_limits<number_t>::infinity());
+    }
+    return origin;
+}
+
 #endif /* RAY_H */
\ No newline at end of file
@@ -22,6 +22,12 @@
 #ifndef RAYTRACING_H
 #define RAYTRACING_H
 
+// Precision of all geometry and shading, chosen at compile time. Single
+// precision halves the size of vectors and rays and doubles the SIMD width.
+#if defined(RAYTRACING_SINGLE_PRECISION)
+typedef float number_t;
+#else
 typedef double number_t;
+#endif
 
 #endif /* RAYTRACING_H */
\ No newline at end of file
@@ -0,0 +1,154 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include <stdint.h>
+#include <raytracing/raytracing.h>
+
+// Sequences the numbers of a Sampler come from. Independent numbers converge
+// at the Monte Carlo rate; the others stratify the samples of a pixel and
+// converge faster where the integrand is smooth.
+enum class SamplePattern
+{
+    Independent, // hashed random numbers
+    Sobol,       // Owen-scrambled Sobol points, with shuffled sample order
+    Halton,      // Halton points in bases 2 and 3 with random digit permutations
+    BlueNoise,   // rank-1 lattice sequence rotated by a blue noise mask
+};
+
+// Counter-based random numbers for rendering. Each number is a hash of its
+// stream, chosen by a seed, a pixel and a sample index, and of its position
+// in the stream, a bounce and a dimension within that bounce. A path thus
+// draws the same numbers whichever thread traces it and however many numbers
+// earlier bounces consumed, and threads share no generator state. The hash is
+// the SplitMix64 output function, so a stream is a SplitMix64 sequence.
+//
+// With a low-discrepancy pattern, dimensions 2k and 2k+1 of a bounce are the
+// two coordinates of a 2D point, point s of a sequence for sample s. Every
+// pair of every bounce has its own scrambling and sample order, so pairs are
+// decorrelated from each other (padding). The camera draws the pixel and the
+// lens position, and the materials their directions, as such pairs.
+class Sampler
+{
+    uint64_t _seed;
+    uint64_t _stream;
+    uint64_t _counter; // bounce in the upper, dimension in the lower 32 bits
+
+    SamplePattern _pattern;
+    uint32_t _width;      // of the image, for the blue noise mask
+    uint64_t _pixel;      // hash of seed and pixel
+    uint32_t _sample;
+    uint32_t _mask_x, _mask_y;
+    uint64_t _second_counter; // counter at which _second is drawn
+    uint32_t _second;
+
+    static uint64_t mix(uint64_t x)
+    {
+        x ^= x >> 30;
+        x *= 0xbf58476d1ce4e5b9ull;
+        x ^= x >> 27;
+        x *= 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    // Next number of the pattern as a fraction of 2^32
+    uint32_t next_low_discrepancy();
+
+public:
+    explicit Sampler(uint64_t seed = 0, SamplePattern pattern = SamplePattern::Independent, uint32_t image_width = 1)
+        : _seed(seed), _stream(mix(seed)), _counter(0), _pattern(pattern), _width(image_width), _pixel(0), _sample(0),
+          _mask_x(0), _mask_y(0), _second_counter(0), _second(0)
+    {
+    }
+
+    SamplePattern pattern() const { return _pattern; }
+
+    // Starts the numbers of one sample of a pixel, at bounce 0. The pixel is
+    // j * image_width + i for the blue noise mask.
+    void start(uint64_t pixel, uint32_t sample)
+    {
+        _stream = mix(_seed + mix(pixel * 0x9e3779b97f4a7c15ull + sample));
+        _counter = 0;
+        _second_counter = 0;
+        if (_pattern != SamplePattern::Independent)
+        {
+            _pixel = mix(mix(_seed) + pixel * 0x9e3779b97f4a7c15ull);
+            _sample = sample;
+            _mask_x = static_cast<uint32_t>(pixel) % _width;
+            _mask_y = static_cast<uint32_t>(pixel) / _width;
+        }
+    }
+
+    // Numbers drawn after this belong to the next bounce of the path
+    void next_bounce()
+    {
+        _counter = ((_counter >> 32) + 1) << 32;
+    }
+
+    uint32_t bounce() const { return static_cast<uint32_t>(_counter >> 32); }
+    uint32_t dimension() const { return static_cast<uint32_t>(_counter); }
+
+    // Independent bits, whatever the pattern
+    uint64_t next_bits()
+    {
+        return mix(_stream + 0x9e3779b97f4a7c15ull * ++_counter);
+    }
+
+    // Uniform in [0,1), from as many bits as number_t has mantissa, so the
+    // result never rounds up to one
+    number_t next()
+    {
+        if (_pattern != SamplePattern::Independent)
+        {
+#if defined(RAYTRACING_SINGLE_PRECISION)
+            return static_cast<number_t>(next_low_discrepancy() >> 8) * (1.0f / 16777216.0f);
+#else
+            return static_cast<number_t>(next_low_discrepancy()) * (1.0 / 4294967296.0);
+#endif
+        }
+#if defined(RAYTRACING_SINGLE_PRECISION)
+        return static_cast<number_t>(next_bits() >> 40) * (1.0f / 16777216.0f);
+#else
+        return static_cast<number_t>(next_bits() >> 11) * (1.0 / 9007199254740992.0);
+#endif
+    }
+
+    // Uniform in [min,max)
+    number_t next(number_t min, number_t max)
+    {
+        return min + (max - min) * next();
+    }
+};
+
+// Seed of the next thread_sampler(), one per thread in order of first use
+uint64_t next_thread_sampler_seed();
+
+// Sampler of the calling thread, for code that does not pass one around.
+// Its numbers depend on the order in which threads first use it.
+inline Sampler &thread_sampler()
+{
+    static thread_local Sampler sampler{next_thread_sampler_seed()};
+    return sampler;
+}
+
+#endif /* SAMPLER_H */
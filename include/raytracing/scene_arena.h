@@ -0,0 +1,116 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef SCENE_ARENA_H
+#define SCENE_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Bytes per block, large enough to hold thousands of primitives
+#define SCENE_ARENA_BLOCK_SIZE (1 << 20)
+
+// Bump pointer allocator for the primitives, materials and textures of a
+// scene. Objects are placed one after another in large blocks instead of one
+// heap allocation each, and handed out as non-owning shared pointers: they
+// have no control block, and copying them never touches a reference count.
+// Everything dies with the arena, so it has to outlive the scene, e.g.
+//
+//     SceneArena arena;
+//     BVH world{random_scene(arena)};
+//
+// Not thread safe, objects are created from one thread.
+class SceneArena
+{
+    // Each object is preceded by a header, the function that destroys it
+    // and returns the end of its record, so teardown walks the blocks.
+    typedef char *(*Destructor)(char *record);
+
+    std::vector<std::pair<char *, char *>> _blocks; // start and end of the records
+    size_t _block_size;
+    char *_current; // free space of the last block
+    char *_end;
+    size_t _used;
+    size_t _reserved;
+
+    static char *align(char *p, size_t alignment)
+    {
+        return reinterpret_cast<char *>((reinterpret_cast<size_t>(p) + alignment - 1) / alignment * alignment);
+    }
+
+    // Reserves a record for an object of size and alignment, with destructor in its header
+    char *allocate(size_t size, size_t alignment, Destructor destructor);
+
+    template <class T>
+    static T *object_of(char *record)
+    {
+        return reinterpret_cast<T *>(align(record + sizeof(Destructor), alignof(T)));
+    }
+
+    template <class T>
+    static char *skip(char *record)
+    {
+        return reinterpret_cast<char *>(object_of<T>(record) + 1);
+    }
+
+    template <class T>
+    static char *destroy(char *record)
+    {
+        T *object = object_of<T>(record);
+        object->~T();
+        return reinterpret_cast<char *>(object + 1);
+    }
+
+public:
+    SceneArena(size_t block_size = SCENE_ARENA_BLOCK_SIZE);
+    ~SceneArena();
+
+    SceneArena(const SceneArena &) = delete;
+    SceneArena &operator=(const SceneArena &) = delete;
+
+    template <class T, class... Args>
+    std::shared_ptr<T> make(Args &&... args)
+    {
+        // Only objects that were constructed are destroyed with the arena
+        char *record = allocate(sizeof(T), alignof(T), &skip<T>);
+        T *object = new (object_of<T>(record)) T(std::forward<Args>(args)...);
+        *reinterpret_cast<Destructor *>(record) = &destroy<T>;
+
+        // Aliasing an empty pointer: points to object, owns nothing
+        return std::shared_ptr<T>(std::shared_ptr<T>(), object);
+    }
+
+    // Bytes of the objects and their headers, and bytes of all blocks
+    size_t used() const { return _used; }
+    size_t reserved() const { return _reserved; }
+};
+
+// Creates an object in arena, or with std::make_shared if arena is NULL
+template <class T, class... Args>
+std::shared_ptr<T> make_in(SceneArena *arena, Args &&... args)
+{
+    return arena ? arena->make<T>(std::forward<Args>(args)...) : std::make_shared<T>(std::forward<Args>(args)...);
+}
+
+#endif /* SCENE_ARENA_H */
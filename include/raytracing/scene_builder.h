@@ -0,0 +1,37 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef SCENE_BUILDER_H
+#define SCENE_BUILDER_H
+
+#include <raytracing/raytracing.h>
+#include <raytracing/hitable_list.h>
+
+// Replaces every sphere that only serves as ground by the Plane touching it
+// where it faces the rest of the scene, with the same material. A sphere
+// counts as ground when its radius is at least min_ratio times the diagonal
+// of the bounds of all other objects; over that region the sphere then drops
+// below the plane by at most 1 / (8 min_ratio) of the diagonal. Huge spheres
+// give acceleration structures huge bounds and lose precision near the
+// horizon, a plane stays out of the tree. Returns the number of replacements.
+int substitute_ground_spheres(HitableList &world, number_t min_ratio = 10);
+
+#endif /* SCENE_BUILDER_H */
@@ -0,0 +1,76 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <raytracing/raytracing.h>
+
+#if defined(__AVX512F__) || defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+// Lanes of number_t per SIMD register: a 512 bit register holds 8 doubles or
+// 16 floats, a 256 bit one 4 or 8. Without AVX the kernels loop over blocks
+// of 4 in scalar code.
+#if defined(RAYTRACING_SINGLE_PRECISION)
+#if defined(__AVX512F__)
+#define SIMD_WIDTH 16
+#elif defined(__AVX__)
+#define SIMD_WIDTH 8
+#else
+#define SIMD_WIDTH 4
+#endif
+#else
+#if defined(__AVX512F__)
+#define SIMD_WIDTH 8
+#else
+#define SIMD_WIDTH 4
+#endif
+#endif
+
+// Register types and intrinsics for number_t, so a kernel is written once
+// for both precisions: MM512(add) is _mm512_add_pd or _mm512_add_ps.
+#if defined(RAYTRACING_SINGLE_PRECISION)
+#if defined(__AVX512F__)
+typedef __m512 simd512_t;
+typedef __mmask16 simd512_mask_t;
+#define MM512(name) _mm512_##name##_ps
+#define MM512_CMP_MASK _mm512_cmp_ps_mask
+#endif
+#if defined(__AVX__)
+typedef __m256 simd256_t;
+#define MM256(name) _mm256_##name##_ps
+#endif
+#else
+#if defined(__AVX512F__)
+typedef __m512d simd512_t;
+typedef __mmask8 simd512_mask_t;
+#define MM512(name) _mm512_##name##_pd
+#define MM512_CMP_MASK _mm512_cmp_pd_mask
+#endif
+#if defined(__AVX__)
+typedef __m256d simd256_t;
+#define MM256(name) _mm256_##name##_pd
+#endif
+#endif
+
+#endif /* SIMD_H */
@@ -26,56 +26,133 @@
 #include <raytracing/hitable.h>
 #include <raytracing/material.h>
 
-class Sphere : public Hitable
+class Sphere final : public Hitable
 {
     Point3 _center;
     number_t _radius;
     MaterialPtr _material;
-    void get_sphere_uv(const Point3 &p, double &u, double &v) const;
 
 public:
-    Sphere() {}
+    Sphere() : Hitable(HitableType::Sphere) {}
     Sphere(Point3 center, number_t radius)
-        : _center(center), _radius(radius), _material(NULL){};
+        : Hitable(HitableType::Sphere), _center(center), _radius(radius), _material(NULL){};
     Sphere(Point3 center, number_t radius, MaterialPtr material)
-        : _center(center), _radius(radius), _material(material){};
-
-    virtual bool hit(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const override;
+        : Hitable(HitableType::Sphere), _center(center), _radius(radius), _material(material){};
+
+    Point3 center() const { return _center; }
+    void set_center(const Point3 &center) { _center = center; }
+    number_t radius() const { return _radius; }
+    MaterialPtr material() const { return _material; }
+
+    // Texture coordinates of a point p on the unit sphere
+    static void get_sphere_uv(const Point3 &p, number_t &u, number_t &v);
+
+    // Moves a point near the sphere onto it. The error of the result only
+    // depends on the magnitude of center and radius, not on how accurately
+    // the root was found.
+    static Point3 project_to_surface(const Point3 &p, const Point3 &center, number_t radius, number_t &error);
+
+    // Roots near <= far of |oc + t direction| = radius, false if the line
+    // misses. Neither the discriminant nor the roots subtract nearly equal
+    // values, so a float ray far from a small sphere still finds its
+    // silhouette (Ray Tracing Gems, chapter 7).
+    static bool intersect_roots(const Vector3 &oc, const Vector3 &direction, number_t radius,
+                                number_t &near, number_t &far);
+
+    virtual bool intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const override;
+    virtual bool bounding_box(AABB &output_box) const override;
+    virtual void compute_interaction(const Ray &r, HitRecord &rec) const override;
+    virtual void compute_uv(const Ray &r, HitRecord &rec) const override;
+    virtual bool occluded(const Ray &r, number_t t_min, number_t t_max) const override;
 };
 
-bool Sphere::hit(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
+inline bool Sphere::intersect_roots(const Vector3 &oc, const Vector3 &direction, number_t radius,
+                                    number_t &near, number_t &far)
 {
-    Vector3 oc = r.origin() - _center;
-    auto a = r.direction().length_squared();
-    auto half_b = oc.dot(r.direction());
-    auto c = oc.length_squared() - _radius * _radius;
+    auto a = direction.length_squared();
+    auto half_b = oc.dot(direction);
+    auto c = oc.length_squared() - radius * radius;
+
+    // half_b^2 - a c in terms of the distance f of the center to the line
+    Vector3 f = oc - (half_b / a) * direction;
+    auto discriminant = a * (radius * radius - f.length_squared());
+    if (!(discriminant >= 0))
+        return false;
+    auto sqrtd = std::sqrt(discriminant);
+
+    // q adds values of the same sign, the other root follows from t0 t1 = c / a
+    auto q = -(half_b + (half_b < 0 ? -sqrtd : sqrtd));
+    auto t0 = q / a, t1 = c / q;
+    near = t0 < t1 ? t0 : t1;
+    far = t0 > t1 ? t0 : t1;
+    return true;
+}
 
-    auto discriminant = half_b * half_b - a * c;
-    if (discriminant < 0)
+inline bool Sphere::intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
+{
+    number_t near, far;
+    if (!intersect_roots(r.origin() - _center, r.direction(), _radius, near, far))
         return false;
-    auto sqrtd = sqrt(discriminant);
 
     // Find the nearest root that lies in the acceptable range.
-    auto root = (-half_b - sqrtd) / a;
-    if (root < t_min || t_max < root)
+    auto root = near;
+    if (!(t_min <= root && root <= t_max))
     {
-        root = (-half_b + sqrtd) / a;
-        if (root < t_min || t_max < root)
+        root = far;
+        if (!(t_min <= root && root <= t_max))
             return false;
     }
 
     rec.t = root;
-    rec.p = r.at(rec.t);
+    rec.object = this;
+    rec.instance = NULL;
+    rec.primitive = 0;
+
+    return true;
+}
+
+inline void Sphere::compute_interaction(const Ray &r, HitRecord &rec) const
+{
+    rec.p = project_to_surface(r.at(rec.t), _center, _radius, rec.error);
 
     Vector3 outward_normal = (rec.p - _center) / _radius;
     rec.set_face_normal(r, outward_normal);
-    rec.material = _material;
+    rec.material = _material.get();
+}
+
+inline void Sphere::compute_uv(const Ray &r, HitRecord &rec) const
+{
+    // rec.p may already be in world space, redo the hit point in object space
+    Vector3 outward_normal = normalize_Vector3(r.at(rec.t) - _center);
+    if (_radius < 0)
+        outward_normal = -outward_normal;
     get_sphere_uv(outward_normal, rec.u, rec.v);
+}
 
+inline bool Sphere::occluded(const Ray &r, number_t t_min, number_t t_max) const
+{
+    number_t near, far;
+    if (!intersect_roots(r.origin() - _center, r.direction(), _radius, near, far))
+        return false;
+    return (t_min <= near && near <= t_max) || (t_min <= far && far <= t_max);
+}
+
+inline bool Sphere::bounding_box(AABB &output_box) const
+{
+    // Negative radii (hollow glass spheres) still occupy |radius| around the center.
+    auto r = Vector3{std::fabs(_radius)};
+    output_box = AABB(_center - r, _center + r);
     return true;
 }
 
-void Sphere::get_sphere_uv(const Point3 &p, double &u, double &v) const
+inline Point3 Sphere::project_to_surface(const Point3 &p, const Point3 &center, number_t radius, number_t &error)
+{
+    number_t magnitude = std::fmax(std::fmax(std::fabs(center.x()), std::fabs(center.y())), std::fabs(center.z()));
+    error = error_gamma(7) * (magnitude + std::fabs(radius));
+    return center + std::fabs(radius) * normalize_Vector3(p - center);
+}
+
+inline void Sphere::get_sphere_uv(const Point3 &p, number_t &u, number_t &v)
 {
     // p: a given point on the sphere of radius one, centered at the origin.
     // u: returned value [0,1] of angle around the Y axis from X=-1.
@@ -0,0 +1,85 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+#include <memory>
+#include <vector>
+#include <raytracing/raytracing.h>
+#include <raytracing/hitable.h>
+#include <raytracing/material.h>
+#include <raytracing/material_table.h>
+#include <raytracing/sphere.h>
+#include <raytracing/bvh.h>
+#include <raytracing/simd.h>
+
+// Spheres intersected per SIMD instruction
+#define SPHERE_SET_WIDTH SIMD_WIDTH
+
+// Many spheres in one primitive, stored as structure of arrays. Rays are
+// intersected against SPHERE_SET_WIDTH spheres at a time. After build() the spheres are grouped
+// into the leaves of an internal BVH, each leaf padded to whole SIMD blocks;
+// before that every ray tests all spheres.
+class SphereSet : public Hitable
+{
+    std::vector<number_t> _center_x, _center_y, _center_z;
+    std::vector<number_t> _radius;     // NaN in padding slots, which never hit
+    std::vector<MaterialHandle> _material_ids; // into _materials
+    MaterialTable _materials;
+    int _count;
+    AABB _bounds;
+    std::vector<BVHNode> _nodes; // leaves address blocks of the padded arrays
+
+    void push(const Point3 &center, number_t radius, MaterialHandle material_id);
+    void pad();
+    int hit_block(int first, const Point3 &origin, const Vector3 &direction, number_t a,
+                  number_t t_min, number_t &t_max) const;
+    bool occluded_block(int first, const Point3 &origin, const Vector3 &direction, number_t a,
+                        number_t t_min, number_t t_max) const;
+    int hit_range(int first, int count, const Point3 &origin, const Vector3 &direction, number_t a,
+                  number_t t_min, number_t &t_max) const;
+
+public:
+    SphereSet() : _count(0) {}
+    SphereSet(const std::vector<std::shared_ptr<Sphere>> &spheres);
+
+    void add(const Point3 &center, number_t radius, MaterialPtr material = NULL);
+    void add(const Sphere &sphere) { add(sphere.center(), sphere.radius(), sphere.material()); }
+
+    // Builds the internal BVH. By default leaves hold one SIMD block, which
+    // costs about as much as a single sphere test.
+    void build(const BVHBuildOptions &options);
+    void build();
+
+    int size() const { return _count; }
+    int slots() const { return static_cast<int>(_radius.size()); } // including padding
+    const std::vector<BVHNode> &nodes() const { return _nodes; }
+    const MaterialTable &materials() const { return _materials; }
+
+    virtual bool intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const override;
+    virtual bool bounding_box(AABB &output_box) const override;
+    virtual void compute_interaction(const Ray &r, HitRecord &rec) const override;
+    virtual void compute_uv(const Ray &r, HitRecord &rec) const override;
+    virtual bool occluded(const Ray &r, number_t t_min, number_t t_max) const override;
+};
+
+#endif /* SPHERE_SET_H */
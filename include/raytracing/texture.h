@@ -22,26 +22,91 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <cmath>
+#include <memory>
 #include "raytracing/color.h"
 
+// Concrete type of a texture, see dispatch_value()
+enum class TextureType
+{
+    SolidColor,
+    Checker,
+    Other
+};
+
 class Texture
 {
+    // The built-in textures are final and the only ones allowed to name
+    // their type, so the tag always names the class whose value()
+    // dispatch_value() calls.
+    TextureType _type;
+
+    Texture(TextureType type) : _type(type) {}
+    friend class SolidColor;
+    friend class CheckerTexture;
+
 public:
-    virtual Color value(double u, double v, const Point3 &p) const = 0;
+    Texture() : _type(TextureType::Other) {}
+
+    virtual Color value(number_t u, number_t v, const Point3 &p) const = 0;
+    // Whether value() depends on u and v, textures of p alone override this.
+    virtual bool needs_uv() const { return true; }
+    TextureType type() const { return _type; }
 };
 
-class SolidColor : public Texture
+// Texture::value() with a switch over the built-in textures instead of a
+// virtual call, so that they are inlined into the shading code.
+inline Color dispatch_value(const Texture &texture, number_t u, number_t v, const Point3 &p);
+
+class SolidColor final : public Texture
 {
     Color _color;
 
 public:
-    SolidColor() {}
-    SolidColor(const Color &c) : _color{c} {}
+    SolidColor() : Texture(TextureType::SolidColor) {}
+    SolidColor(const Color &c) : Texture(TextureType::SolidColor), _color{c} {}
 
-    virtual Color value(double u, double v, const Point3 &p) const override
+    virtual Color value(number_t u, number_t v, const Point3 &p) const override
     {
         return _color;
     }
+    virtual bool needs_uv() const override { return false; }
 };
 
-#endif /* TEXTURE_H */
\ No newline at end of file
+// Alternates between two textures in a 3D checker pattern of the hit point
+class CheckerTexture final : public Texture
+{
+    std::shared_ptr<Texture> _even;
+    std::shared_ptr<Texture> _odd;
+
+public:
+    CheckerTexture(const std::shared_ptr<Texture> even, const std::shared_ptr<Texture> odd)
+        : Texture(TextureType::Checker), _even(even), _odd(odd) {}
+    CheckerTexture(const Color &c1, const Color &c2)
+        : Texture(TextureType::Checker), _even(std::make_shared<SolidColor>(c1)), _odd(std::make_shared<SolidColor>(c2)) {}
+
+    virtual Color value(number_t u, number_t v, const Point3 &p) const override
+    {
+        auto sines = std::sin(10 * p.x()) * std::sin(10 * p.y()) * std::sin(10 * p.z());
+        if (sines < 0)
+            return dispatch_value(*_odd, u, v, p);
+        else
+            return dispatch_value(*_even, u, v, p);
+    }
+    virtual bool needs_uv() const override { return _even->needs_uv() || _odd->needs_uv(); }
+};
+
+inline Color dispatch_value(const Texture &texture, number_t u, number_t v, const Point3 &p)
+{
+    switch (texture.type())
+    {
+    case TextureType::SolidColor:
+        return static_cast<const SolidColor &>(texture).SolidColor::value(u, v, p);
+    case TextureType::Checker:
+        return static_cast<const CheckerTexture &>(texture).CheckerTexture::value(u, v, p);
+    default:
+        return texture.value(u, v, p);
+    }
+}
+
+#endif /* TEXTURE_H */
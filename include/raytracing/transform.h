@@ -0,0 +1,108 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include <raytracing/raytracing.h>
+#include <raytracing/vector3.h>
+#include <raytracing/ray.h>
+#include <raytracing/aabb.h>
+
+// Affine transformation p' = A p + b with its inverse kept alongside.
+class Transform
+{
+    number_t _m[3][4];
+    number_t _inv[3][4];
+    bool _invertible;
+
+    static Point3 apply_point(const number_t m[3][4], const Point3 &p)
+    {
+        return Point3{
+            m[0][0] * p[0] + m[0][1] * p[1] + m[0][2] * p[2] + m[0][3],
+            m[1][0] * p[0] + m[1][1] * p[1] + m[1][2] * p[2] + m[1][3],
+            m[2][0] * p[0] + m[2][1] * p[1] + m[2][2] * p[2] + m[2][3]};
+    }
+
+    static Vector3 apply_vector(const number_t m[3][4], const Vector3 &v)
+    {
+        return Vector3{
+            m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2],
+            m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2],
+            m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2]};
+    }
+
+public:
+    Transform();
+    Transform(const number_t m[3][4]);
+
+    number_t operator()(int i, int j) const { return _m[i][j]; }
+
+    // False if A is singular (e.g. a zero scale factor), the inverse is then
+    // all zero and maps every point to -b.
+    bool invertible() const { return _invertible; }
+
+    Transform inverse() const;
+    Transform operator*(const Transform &t) const; // apply t first, then this
+
+    Point3 point(const Point3 &p) const { return apply_point(_m, p); }
+    Vector3 vector(const Vector3 &v) const { return apply_vector(_m, v); }
+    Point3 inverse_point(const Point3 &p) const { return apply_point(_inv, p); }
+    Vector3 inverse_vector(const Vector3 &v) const { return apply_vector(_inv, v); }
+
+    Vector3 normal(const Vector3 &n) const
+    {
+        // Normals transform with the inverse transpose
+        return Vector3{
+            _inv[0][0] * n[0] + _inv[1][0] * n[1] + _inv[2][0] * n[2],
+            _inv[0][1] * n[0] + _inv[1][1] * n[1] + _inv[2][1] * n[2],
+            _inv[0][2] * n[0] + _inv[1][2] * n[1] + _inv[2][2] * n[2]};
+    }
+
+    // Error bound of point(p) when the coordinates of p are off by up to error
+    number_t point_error(const Point3 &p, number_t error) const
+    {
+        number_t bound = 0;
+        for (int i = 0; i < 3; ++i)
+        {
+            number_t row = std::fabs(_m[i][0]) + std::fabs(_m[i][1]) + std::fabs(_m[i][2]);
+            number_t magnitude = std::fabs(_m[i][0] * p[0]) + std::fabs(_m[i][1] * p[1]) +
+                                 std::fabs(_m[i][2] * p[2]) + std::fabs(_m[i][3]);
+            bound = std::fmax(bound, (1 + error_gamma(3)) * row * error + error_gamma(3) * magnitude);
+        }
+        return bound;
+    }
+
+    Ray inverse_ray(const Ray &r) const
+    {
+        // The direction is not renormalized, so hit distances carry over unchanged.
+        return Ray(inverse_point(r.origin()), inverse_vector(r.direction()));
+    }
+
+    AABB box(const AABB &b) const;
+};
+
+Transform translate_Transform(const Vector3 &offset);
+Transform scale_Transform(const Vector3 &factors);
+Transform scale_Transform(const number_t factor);
+Transform rotate_Transform(const Vector3 &axis, const number_t degrees);
+
+#endif /* TRANSFORM_H */
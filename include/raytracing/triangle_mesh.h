@@ -0,0 +1,111 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef TRIANGLE_MESH_H
+#define TRIANGLE_MESH_H
+
+#include <memory>
+#include <vector>
+#include <raytracing/raytracing.h>
+#include <raytracing/hitable.h>
+#include <raytracing/material.h>
+#include <raytracing/bvh.h>
+#include <raytracing/simd.h>
+
+// Triangles intersected per SIMD instruction
+#define TRIANGLE_MESH_WIDTH SIMD_WIDTH
+
+// Ray in the per-ray coordinate frame of the watertight test: the axes are
+// permuted so that kz follows the largest direction component, then the ray
+// is sheared onto the z axis.
+struct ShearedRay
+{
+    int kx, ky, kz;      // axis permutation
+    number_t sx, sy, sz; // shear onto the z axis
+    number_t origin[3];  // permuted
+
+    ShearedRay(const Ray &r);
+};
+
+// Watertight test of TRIANGLE_MESH_WIDTH triangles gathered into lanes, with
+// p[3 * corner + k][lane] the permuted coordinate k of a vertex relative to the
+// ray origin (64 byte aligned) and lanes a bit mask of the real triangles.
+// Returns the lane of the nearest hit in [t_min, t_max] and shrinks t_max, or -1.
+int hit_triangle_lanes(const number_t (*p)[TRIANGLE_MESH_WIDTH], int lanes, const ShearedRay &ray, number_t t_min,
+                       number_t &t_max, number_t *barycentric);
+
+// Indexed triangle mesh with shared vertex, normal and UV buffers. Triangles
+// are three vertex indices, not objects; an internal BVH groups them into
+// leaves padded to whole SIMD blocks (with degenerate triangles that never
+// hit), and each block is tested with the watertight ray/triangle algorithm
+// of Woop, Benthin and Wald, so rays never slip through shared edges.
+class TriangleMesh : public Hitable
+{
+    std::vector<Point3> _vertices;
+    std::vector<Vector3> _normals; // per vertex, optional
+    std::vector<number_t> _uvs;    // two per vertex, optional
+    std::vector<int> _indices;     // three per triangle, in BVH leaf order
+    int _triangle_count;
+    MaterialPtr _material;
+    AABB _bounds;
+    std::vector<BVHNode> _nodes; // leaves address blocks of triangles
+
+    int hit_block(int first, const ShearedRay &ray, number_t t_min, number_t &t_max, number_t *barycentric) const;
+    int hit_range(int first, int count, const ShearedRay &ray, number_t t_min, number_t &t_max,
+                  number_t *barycentric) const;
+    void layout(const BVHBuildOptions &options, const std::vector<int> &triangles, const std::vector<AABB> &bounds);
+
+public:
+    TriangleMesh() : _triangle_count(0) {}
+    // Takes the buffers over; indices hold three vertex indices per triangle.
+    TriangleMesh(std::vector<Point3> vertices, std::vector<int> indices, MaterialPtr material,
+                 std::vector<Vector3> normals = std::vector<Vector3>(),
+                 std::vector<number_t> uvs = std::vector<number_t>(),
+                 const BVHBuildOptions &options = default_build_options());
+    // Same, with the bounds of all triangles already computed by triangle_bounds(),
+    // e.g. by a loader while parsing.
+    TriangleMesh(std::vector<Point3> vertices, std::vector<int> indices, MaterialPtr material,
+                 std::vector<Vector3> normals, std::vector<number_t> uvs,
+                 const std::vector<AABB> &triangle_bounds, const BVHBuildOptions &options = default_build_options());
+
+    // Leaves hold one SIMD block, which costs about as much as a single triangle test.
+    static BVHBuildOptions default_build_options();
+    void build(const BVHBuildOptions &options);
+    // Bounds of a triangle as used for the BVH, slightly enlarged
+    static AABB triangle_bounds(const Point3 &a, const Point3 &b, const Point3 &c);
+
+    int triangle_count() const { return _triangle_count; }
+    const std::vector<Point3> &vertices() const { return _vertices; }
+    const std::vector<int> &indices() const { return _indices; }
+    const std::vector<Vector3> &normals() const { return _normals; }
+    const std::vector<number_t> &uvs() const { return _uvs; }
+    const std::vector<BVHNode> &nodes() const { return _nodes; }
+    // Bytes held by the mesh buffers and the BVH
+    size_t memory() const;
+
+    virtual bool intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const override;
+    virtual bool bounding_box(AABB &output_box) const override;
+    virtual void compute_interaction(const Ray &r, HitRecord &rec) const override;
+    virtual void compute_uv(const Ray &r, HitRecord &rec) const override;
+    virtual bool occluded(const Ray &r, number_t t_min, number_t t_max) const override;
+};
+
+#endif /* TRIANGLE_MESH_H */
@@ -26,20 +26,42 @@
 #include <limits>
 #include <sstream>
 #include <raytracing/raytracing.h>
+#include <raytracing/sampler.h>
 
 const number_t infinity = std::numeric_limits<number_t>::infinity();
 const number_t pi = acos(-1.0);
 
-inline number_t random_number_t()
+// Largest number_t below one
+const number_t one_minus_epsilon = 1 - std::numeric_limits<number_t>::epsilon() / 2;
+
+// Bound on the relative rounding error of n chained floating point operations,
+// gamma(n) in Pharr, Jakob and Humphreys, Physically Based Rendering.
+inline number_t error_gamma(int n)
+{
+    const number_t u = std::numeric_limits<number_t>::epsilon() / 2;
+    return (n * u) / (1 - n * u);
+}
+
+inline number_t random_number_t(Sampler &sampler)
 {
     // Returns a random real in [0,1).
-    return rand() / (RAND_MAX + 1.0);
+    return sampler.next();
 }
 
-inline number_t random_number_t(number_t min, number_t max)
+inline number_t random_number_t(Sampler &sampler, number_t min, number_t max)
 {
     // Returns a random real in [min,max).
-    return min + (max - min) * random_number_t();
+    return sampler.next(min, max);
+}
+
+inline number_t random_number_t()
+{
+    return random_number_t(thread_sampler());
+}
+
+inline number_t random_number_t(number_t min, number_t max)
+{
+    return random_number_t(thread_sampler(), min, max);
 }
 
 inline number_t degrees_to_radians(number_t degrees)
@@ -27,17 +27,37 @@
 #include <raytracing/raytracing.h>
 #include <raytracing/utils.h>
 
-class Vector3
+// Vector3 optionally pads its three coordinates to four lanes, so that it
+// fills one 128 bit register in single precision or two in double precision
+// and the lane-wise operators below compile to packed SSE or NEON
+// instructions. The fourth lane starts at zero, goes through the same
+// arithmetic as the others and is never read by the accessors, dot() or
+// length(). Padding costs a third more memory for every stored vector.
+#if defined(RAYTRACING_PADDED_VECTOR3)
+#define VECTOR3_LANES 4
+#define VECTOR3_ALIGNMENT 16
+#define VECTOR3_PAD(lane) , lane
+#else
+#define VECTOR3_LANES 3
+#define VECTOR3_ALIGNMENT alignof(number_t)
+#define VECTOR3_PAD(lane)
+#endif
+
+class alignas(VECTOR3_ALIGNMENT) Vector3
 {
-    number_t _v[3];
+    number_t _v[VECTOR3_LANES];
+
+#if defined(RAYTRACING_PADDED_VECTOR3)
+    constexpr Vector3(const number_t v0, const number_t v1, const number_t v2, const number_t v3)
+        : _v{v0, v1, v2, v3} {}
+#endif
 
 public:
-    Vector3() : _v{0, 0, 0} {}
-    Vector3(const number_t v) : _v{v, v, v} {}
-    Vector3(const Vector3 &v) : _v{v._v[0], v._v[1], v._v[2]} {}
-    Vector3(const number_t v0, const number_t v1, const number_t v2) : _v{v0, v1, v2} {}
+    constexpr Vector3() : _v{0, 0, 0 VECTOR3_PAD(0)} {}
+    constexpr Vector3(const number_t v) : _v{v, v, v VECTOR3_PAD(0)} {}
+    constexpr Vector3(const number_t v0, const number_t v1, const number_t v2) : _v{v0, v1, v2 VECTOR3_PAD(0)} {}
 
-    number_t dot(const Vector3 &v) const
+    constexpr number_t dot(const Vector3 &v) const
     {
         return _v[0] * v._v[0] + _v[1] * v._v[1] + _v[2] * v._v[2];
     }
@@ -49,68 +69,69 @@ public:
     }
 
     number_t length() const { return std::sqrt(length_squared()); }
-    number_t length_squared() const { return _v[0] * _v[0] + _v[1] * _v[1] + _v[2] * _v[2]; }
+    constexpr number_t length_squared() const { return _v[0] * _v[0] + _v[1] * _v[1] + _v[2] * _v[2]; }
 
     Vector3 &normalize()
     {
         return *this /= length();
     }
 
-    number_t sum() const { return _v[0] + _v[1] + _v[2]; }
+    constexpr number_t sum() const { return _v[0] + _v[1] + _v[2]; }
 
-    number_t x() const { return _v[0]; }
-    number_t y() const { return _v[1]; }
-    number_t z() const { return _v[2]; }
+    constexpr number_t x() const { return _v[0]; }
+    constexpr number_t y() const { return _v[1]; }
+    constexpr number_t z() const { return _v[2]; }
 
-    number_t operator[](int i) const { return _v[i]; }
+    constexpr number_t operator[](int i) const { return _v[i]; }
     number_t &operator[](int i) { return _v[i]; }
 
-    Vector3 &operator+=(const Vector3 &v)
+    Vector3 &operator+=(const Vector3 &v) { return *this = *this + v; }
+    Vector3 &operator-=(const Vector3 &v) { return *this = *this - v; }
+    Vector3 &operator*=(const number_t t) { return *this = *this * t; }
+    Vector3 &operator*=(const Vector3 &v) { return *this = *this * v; }
+    Vector3 &operator/=(const number_t t) { return *this = *this / t; }
+    Vector3 &operator/=(const Vector3 &v) { return *this = *this / v; }
+
+    friend constexpr Vector3 operator+(const Vector3 &v, const Vector3 &w)
+    {
+        return Vector3{v._v[0] + w._v[0], v._v[1] + w._v[1], v._v[2] + w._v[2] VECTOR3_PAD(v._v[3] + w._v[3])};
+    }
+
+    friend constexpr Vector3 operator-(const Vector3 &v)
+    {
+        return Vector3{-v._v[0], -v._v[1], -v._v[2] VECTOR3_PAD(-v._v[3])};
+    }
+
+    friend constexpr Vector3 operator-(const Vector3 &v, const Vector3 &w)
     {
-        _v[0] += v._v[0];
-        _v[1] += v._v[1];
-        _v[2] += v._v[2];
-        return *this;
+        return Vector3{v._v[0] - w._v[0], v._v[1] - w._v[1], v._v[2] - w._v[2] VECTOR3_PAD(v._v[3] - w._v[3])};
     }
 
-    Vector3 &operator-=(const Vector3 &v)
+    friend constexpr Vector3 operator*(const Vector3 &v, const number_t t)
     {
-        _v[0] -= v._v[0];
-        _v[1] -= v._v[1];
-        _v[2] -= v._v[2];
-        return *this;
+        return Vector3{v._v[0] * t, v._v[1] * t, v._v[2] * t VECTOR3_PAD(v._v[3] * t)};
     }
 
-    Vector3 &operator*=(const number_t t)
+    friend constexpr Vector3 operator*(const Vector3 &v, const Vector3 &w)
     {
-        _v[0] *= t;
-        _v[1] *= t;
-        _v[2] *= t;
-        return *this;
+        return Vector3{v._v[0] * w._v[0], v._v[1] * w._v[1], v._v[2] * w._v[2] VECTOR3_PAD(v._v[3] * w._v[3])};
     }
 
-    Vector3 &operator*=(const Vector3 &v)
+    // Divides rather than multiplying by the reciprocal, which would round
+    // differently.
+    friend constexpr Vector3 operator/(const Vector3 &v, const number_t t)
     {
-        _v[0] *= v[0];
-        _v[1] *= v[1];
-        _v[2] *= v[2];
-        return *this;
+        return Vector3{v._v[0] / t, v._v[1] / t, v._v[2] / t VECTOR3_PAD(v._v[3] / t)};
     }
 
-    Vector3 &operator/=(const number_t t)
+    friend constexpr Vector3 operator/(const number_t t, const Vector3 &v)
     {
-        _v[0] /= t;
-        _v[1] /= t;
-        _v[2] /= t;
-        return *this;
+        return Vector3{t / v._v[0], t / v._v[1], t / v._v[2] VECTOR3_PAD(v._v[3])};
     }
 
-    Vector3 &operator/=(const Vector3 &v)
+    friend constexpr Vector3 operator/(const Vector3 &v, const Vector3 &w)
     {
-        _v[0] /= v[0];
-        _v[1] /= v[1];
-        _v[2] /= v[2];
-        return *this;
+        return Vector3{v._v[0] / w._v[0], v._v[1] / w._v[1], v._v[2] / w._v[2] VECTOR3_PAD(v._v[3])};
     }
 };
 
@@ -119,22 +140,43 @@ inline std::ostream &operator<<(std::ostream &out, const Vector3 &v)
     return out << '[' << v.x() << ',' << v.y() << ',' << v.z() << ']';
 }
 
-Vector3 operator+(const Vector3 &v, const Vector3 &w);
-Vector3 operator-(const Vector3 &v);
-Vector3 operator-(const Vector3 &v, const Vector3 &w);
-Vector3 &operator*=(const number_t t, Vector3 &v);
-Vector3 operator*(const Vector3 &v, const number_t t);
-Vector3 operator*(const number_t t, const Vector3 &v);
-Vector3 operator*(const Vector3 &v, const Vector3 &w);
-Vector3 &operator/=(const number_t t, Vector3 &v);
-Vector3 operator/(const Vector3 &v, const number_t t);
-Vector3 operator/(const number_t t, const Vector3 &v);
-Vector3 operator/(const Vector3 v, const Vector3 &w);
-Vector3 cross_Vector3(const Vector3 &u, const Vector3 &v);
-Vector3 normalize_Vector3(const Vector3 &v);
+constexpr Vector3 operator*(const number_t t, const Vector3 &v)
+{
+    return v * t;
+}
+
+inline Vector3 &operator*=(const number_t t, Vector3 &v)
+{
+    return v *= t;
+}
+
+inline Vector3 &operator/=(const number_t t, Vector3 &v)
+{
+    return v = t / v;
+}
+
+constexpr Vector3 cross_Vector3(const Vector3 &u, const Vector3 &v)
+{
+    return Vector3{
+        u[1] * v[2] - u[2] * v[1],
+        u[2] * v[0] - u[0] * v[2],
+        u[0] * v[1] - u[1] * v[0]};
+}
+
+inline Vector3 normalize_Vector3(const Vector3 &v)
+{
+    return v / v.length();
+}
+
+// Random vectors drawn from sampler, or from thread_sampler() without one
+Vector3 random_Vector3(Sampler &sampler);
+Vector3 random_Vector3(Sampler &sampler, number_t min, number_t max);
 Vector3 random_Vector3();
 Vector3 random_Vector3(number_t min, number_t max);
 
+Vector3 random_in_unit_disk(Sampler &sampler);
+Vector3 random_in_unit_sphere(Sampler &sampler);
+Vector3 norm_random_in_unit_sphere(Sampler &sampler);
 Vector3 random_in_unit_disk();
 Vector3 random_in_unit_sphere();
 Vector3 norm_random_in_unit_sphere();
@@ -0,0 +1,131 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef WARP_H
+#define WARP_H
+
+#include <cmath>
+#include <raytracing/raytracing.h>
+#include <raytracing/vector3.h>
+
+// Closed-form maps from uniform samples in [0,1)^2 to points on the disk,
+// sphere and hemisphere, in place of rejection loops. They take a fixed
+// number of samples, preserve the stratification of their input and contain
+// no data dependent branches, so the batch variants vectorize. The sphere and
+// hemisphere maps lift the concentric disk mapping of Shirley and Chiu, which
+// only needs the sine and cosine of angles within [-pi/4, pi/4].
+
+// Sine and cosine of x in [-pi/4, pi/4] from their Taylor series, accurate to
+// about an ulp. Unlike std::sin and std::cos they inline and vectorize.
+inline void sincos_quarter(const number_t x, number_t &s, number_t &c)
+{
+    const number_t x2 = x * x;
+    s = x * (1 + x2 * (number_t(-1.0 / 6) + x2 * (number_t(1.0 / 120) + x2 * (number_t(-1.0 / 5040) +
+        x2 * (number_t(1.0 / 362880) + x2 * (number_t(-1.0 / 39916800) + x2 * (number_t(1.0 / 6227020800) +
+        x2 * number_t(-1.0 / 1307674368000))))))));
+    c = 1 + x2 * (number_t(-1.0 / 2) + x2 * (number_t(1.0 / 24) + x2 * (number_t(-1.0 / 720) +
+        x2 * (number_t(1.0 / 40320) + x2 * (number_t(-1.0 / 3628800) + x2 * (number_t(1.0 / 479001600) +
+        x2 * (number_t(-1.0 / 87178291200) + x2 * number_t(1.0 / 20922789888000))))))));
+}
+
+// Unit disk, preserving relative areas
+inline void concentric_disk(const number_t u, const number_t v, number_t &x, number_t &y)
+{
+    const number_t a = 2 * u - 1;
+    const number_t b = 2 * v - 1;
+    // Radius along the longer of a and b, angle from their ratio
+    const bool wide = std::fabs(a) > std::fabs(b);
+    const number_t r = wide ? a : b;
+    const number_t ratio = (wide ? b : a) / (r != 0 ? r : 1);
+
+    number_t s, c;
+    sincos_quarter(number_t(0.78539816339744830962) * ratio, s, c);
+    x = r * (wide ? c : s);
+    y = r * (wide ? s : c);
+}
+
+// Unit sphere, uniform: z = 1 - 2 r^2 of the disk point
+inline void uniform_sphere(const number_t u, const number_t v, number_t &x, number_t &y, number_t &z)
+{
+    number_t dx, dy;
+    concentric_disk(u, v, dx, dy);
+    const number_t r2 = dx * dx + dy * dy;
+    const number_t scale = 2 * std::sqrt(r2 < 1 ? 1 - r2 : 0);
+    x = dx * scale;
+    y = dy * scale;
+    z = 1 - 2 * r2;
+}
+
+// Hemisphere around +z, with density cos(theta) / pi (Malley's method)
+inline void cosine_hemisphere(const number_t u, const number_t v, number_t &x, number_t &y, number_t &z)
+{
+    concentric_disk(u, v, x, y);
+    const number_t r2 = x * x + y * y;
+    z = std::sqrt(r2 < 1 ? 1 - r2 : 0);
+}
+
+inline Vector3 concentric_disk(const number_t u, const number_t v)
+{
+    number_t x, y;
+    concentric_disk(u, v, x, y);
+    return Vector3{x, y, 0};
+}
+
+inline Vector3 uniform_sphere(const number_t u, const number_t v)
+{
+    number_t x, y, z;
+    uniform_sphere(u, v, x, y, z);
+    return Vector3{x, y, z};
+}
+
+inline Vector3 cosine_hemisphere(const number_t u, const number_t v)
+{
+    number_t x, y, z;
+    cosine_hemisphere(u, v, x, y, z);
+    return Vector3{x, y, z};
+}
+
+// Unit ball, uniform: a point on the sphere at radius cbrt(w)
+inline Vector3 uniform_ball(const number_t u, const number_t v, const number_t w)
+{
+    return std::cbrt(w) * uniform_sphere(u, v);
+}
+
+// local expressed in an orthonormal basis with z axis n, which has unit
+// length. The basis is the branch-free one of Duff et al., "Building an
+// Orthonormal Basis, Revisited".
+inline Vector3 local_to_world(const Vector3 &local, const Vector3 &n)
+{
+    const number_t sign = std::copysign(number_t(1), n.z());
+    const number_t a = -1 / (sign + n.z());
+    const number_t b = n.x() * n.y() * a;
+    const Vector3 t{1 + sign * n.x() * n.x() * a, sign * b, -sign * n.x()};
+    const Vector3 s{b, sign + n.y() * n.y() * a, -n.y()};
+    return local.x() * t + local.y() * s + local.z() * n;
+}
+
+// Batch variants, mapping count samples (u[i], v[i]) to points in
+// structure-of-arrays form
+void concentric_disk(int count, const number_t *u, const number_t *v, number_t *x, number_t *y);
+void uniform_sphere(int count, const number_t *u, const number_t *v, number_t *x, number_t *y, number_t *z);
+void cosine_hemisphere(int count, const number_t *u, const number_t *v, number_t *x, number_t *y, number_t *z);
+
+#endif /* WARP_H */
@@ -0,0 +1,93 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <memory>
+#include <vector>
+#include <raytracing/raytracing.h>
+#include <raytracing/hitable.h>
+#include <raytracing/camera.h>
+#include <raytracing/color.h>
+#include <raytracing/material.h>
+#include <raytracing/sampler.h>
+
+#define WAVEFRONT_SIZE (1 << 16)
+
+// Path tracer that advances a whole batch of paths at once instead of
+// recursing per ray. Path states live in SoA buffers and each bounce runs
+// as separate kernels: regenerate (finish paths, start new camera samples),
+// extend (closest hits) and shade (scatter). Hits are binned by material
+// type so each material is shaded in its own homogeneous loop.
+// Renders the same images as the recursive ray_color of the apps.
+class WavefrontIntegrator
+{
+    int _size;
+
+    // Path states
+    std::vector<number_t> _origin[3];
+    std::vector<number_t> _direction[3];
+    std::vector<number_t> _throughput[3]; // radiance once the path has terminated
+    std::vector<int> _pixel;              // -1 for an idle slot
+    std::vector<int> _depth;              // remaining bounces
+    std::vector<char> _alive;
+    std::vector<Sampler> _samplers;       // random numbers of the path
+
+    std::vector<int> _active;
+    std::vector<int> _fresh;
+
+    // Per active path (indexed like _active) during a bounce
+    std::vector<Ray> _rays;
+    std::vector<HitRecord> _records;
+    std::unique_ptr<bool[]> _hits;
+    std::vector<int> _queues[MATERIAL_TYPE_COUNT]; // positions in _active
+
+    Ray path_ray(int k) const
+    {
+        return Ray(Point3{_origin[0][k], _origin[1][k], _origin[2][k]},
+                   Vector3{_direction[0][k], _direction[1][k], _direction[2][k]});
+    }
+    void set_path_ray(int k, const Ray &r);
+    void terminate_path(int k, const Color &radiance);
+
+    bool regenerate(const Camera &camera, int image_width, int image_height, int samples_per_pixel,
+                    int max_depth, long &next_sample, Color *pixel);
+    void extend(const Hitable &world);
+    void shade();
+    template <class T>
+    void shade_queue(const std::vector<int> &queue);
+
+public:
+    WavefrontIntegrator(int size = WAVEFRONT_SIZE);
+
+    static Color background(const Ray &r);
+
+    // Accumulates samples_per_pixel samples into pixel[j * image_width + i],
+    // with row j = 0 at the bottom of the image. Sample s of pixel p draws its
+    // numbers from a Sampler with the given seed and pattern started at (p, s),
+    // and every scatter event starts a new bounce of that sampler.
+    void render(const Hitable &world, const Camera &camera, int image_width, int image_height,
+                int samples_per_pixel, int max_depth, Color *pixel, uint64_t seed = 0,
+                SamplePattern pattern = SamplePattern::Independent);
+};
+
+#endif /* WAVEFRONT_H */
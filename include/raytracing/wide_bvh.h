@@ -0,0 +1,76 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include <memory>
+#include <vector>
+#include <raytracing/raytracing.h>
+#include <raytracing/hitable.h>
+#include <raytracing/hitable_list.h>
+#include <raytracing/bvh.h>
+
+// Node of an N-wide BVH. The child bounds are stored in single precision and
+// structure-of-arrays form, so that one SIMD slab test covers all children.
+template <int N>
+struct WideBVHNode
+{
+    float min_x[N], min_y[N], min_z[N];
+    float max_x[N], max_y[N], max_z[N];
+    int child[N]; // child node (interior) or first primitive (leaf)
+    int count[N]; // primitives in a leaf child, 0 for interior children, -1 for empty slots
+};
+
+// Collapsed binary BVH with N = 4 (SSE) or N = 8 (AVX) children per node.
+// Children are visited nearest-first, primitives are intersected in number_t
+// precision through the common Hitable interface.
+template <int N>
+class WideBVH : public Hitable
+{
+    std::vector<WideBVHNode<N>> _nodes;
+    std::vector<HitablePtr> _objects;
+    std::vector<HitablePtr> _unbounded; // taken over from the binary BVH
+    AABB _bounds;
+
+    void collapse(const BVH &bvh);
+
+public:
+    WideBVH() {}
+    WideBVH(const BVH &bvh) { collapse(bvh); }
+    WideBVH(const HitableList &list, const BVHBuildOptions &options = BVHBuildOptions())
+    {
+        collapse(BVH(list, options));
+    }
+
+    const std::vector<WideBVHNode<N>> &nodes() const { return _nodes; }
+    const std::vector<HitablePtr> &objects() const { return _objects; }
+    const std::vector<HitablePtr> &unbounded() const { return _unbounded; }
+
+    virtual bool intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const override;
+    virtual bool bounding_box(AABB &output_box) const override;
+    virtual bool occluded(const Ray &r, number_t t_min, number_t t_max) const override;
+};
+
+typedef WideBVH<4> BVH4;
+typedef WideBVH<8> BVH8;
+
+#endif /* WIDE_BVH_H */
@@ -0,0 +1,48 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <raytracing/adaptive.h>
+
+bool write_sample_counts(std::ostream &out, const std::vector<PixelEstimate> &pixels, int image_width,
+                         int image_height)
+{
+    if (image_width <= 0 || image_height <= 0 ||
+        pixels.size() != static_cast<size_t>(image_width) * static_cast<size_t>(image_height))
+        return false;
+
+    int min_count = pixels[0].count(), max_count = min_count;
+    for (const PixelEstimate &pixel : pixels)
+    {
+        min_count = std::min(min_count, pixel.count());
+        max_count = std::max(max_count, pixel.count());
+    }
+    const number_t scale = max_count > min_count ? 255.0 / (max_count - min_count) : 0;
+
+    out << "P3\n"
+        << image_width << " " << image_height << "\n255\n";
+    for (int j = image_height - 1; j >= 0; --j)
+        for (int i = 0; i < image_width; ++i)
+        {
+            const int level = static_cast<int>(scale * (pixels[j * image_width + i].count() - min_count) + 0.5);
+            out << level << ' ' << level << ' ' << level << '\n';
+        }
+    return true;
+}
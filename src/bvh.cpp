@@ -0,0 +1,336 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <raytracing/bvh.h>
+#include <raytracing/bvh_cache.h>
+
+struct BuildPrimitive
+{
+    AABB bounds;
+    Point3 centroid;
+    int index;
+};
+
+struct BuildBin
+{
+    AABB bounds;
+    int count;
+
+    BuildBin() : count(0) {}
+};
+
+static int bin_index(const Point3 &centroid, int axis, number_t min, number_t scale, int bins)
+{
+    int b = static_cast<int>((centroid[axis] - min) * scale);
+    return b < bins ? b : bins - 1;
+}
+
+static int median_split(std::vector<BuildPrimitive> &primitives, int begin, int end, int axis)
+{
+    int mid = (begin + end) / 2;
+    std::nth_element(
+        primitives.begin() + begin, primitives.begin() + mid, primitives.begin() + end,
+        [axis](const BuildPrimitive &a, const BuildPrimitive &b)
+        { return a.centroid[axis] < b.centroid[axis]; });
+    return mid;
+}
+
+static int build_node(
+    std::vector<BuildPrimitive> &primitives, int begin, int end, int depth,
+    const BVHBuildOptions &options, std::vector<BVHNode> &nodes)
+{
+    int index = static_cast<int>(nodes.size());
+    nodes.push_back(BVHNode());
+
+    AABB bounds, centroid_bounds;
+    for (int i = begin; i < end; ++i)
+    {
+        bounds.extend(primitives[i].bounds);
+        centroid_bounds.extend(primitives[i].centroid);
+    }
+
+    nodes[index].bounds = bounds;
+    nodes[index].offset = begin;
+    nodes[index].count = end - begin;
+    nodes[index].axis = 0;
+
+    int count = end - begin;
+    if (count == 1)
+        return index;
+
+    int axis = centroid_bounds.longest_axis();
+    number_t min = centroid_bounds.min()[axis];
+    number_t extent = centroid_bounds.extent()[axis];
+    int mid;
+
+    if (extent <= 0)
+    {
+        // All centroids coincide, any split is as good as the other.
+        if (count <= options.max_leaf_size)
+            return index;
+        mid = (begin + end) / 2;
+    }
+    else if (depth >= BVH_MAX_DEPTH / 2)
+    {
+        // Median splits bound the remaining depth by log2(count).
+        mid = median_split(primitives, begin, end, axis);
+    }
+    else
+    {
+        // Bin the centroids and sweep the bin boundaries for the cheapest split.
+        int bins = options.bins;
+        number_t scale = bins / extent;
+        std::vector<BuildBin> bin(bins);
+
+        for (int i = begin; i < end; ++i)
+        {
+            auto &b = bin[bin_index(primitives[i].centroid, axis, min, scale, bins)];
+            b.bounds.extend(primitives[i].bounds);
+            ++b.count;
+        }
+
+        std::vector<number_t> right_area(bins);
+        std::vector<int> right_count(bins);
+        AABB right_bounds;
+        int right = 0;
+        for (int b = bins - 1; b > 0; --b)
+        {
+            right_bounds.extend(bin[b].bounds);
+            right += bin[b].count;
+            right_area[b] = right_bounds.surface_area();
+            right_count[b] = right;
+        }
+
+        number_t area = bounds.surface_area();
+        number_t inv_area = area > 0 ? 1 / area : 0;
+        number_t best_cost = infinity;
+        int best_split = 1;
+        AABB left_bounds;
+        int left = 0;
+        for (int b = 1; b < bins; ++b)
+        {
+            left_bounds.extend(bin[b - 1].bounds);
+            left += bin[b - 1].count;
+            if (left == 0 || right_count[b] == 0)
+                continue;
+
+            number_t cost = options.traversal_cost +
+                            options.intersect_cost * inv_area *
+                                (left * left_bounds.surface_area() + right_count[b] * right_area[b]);
+            if (cost < best_cost)
+            {
+                best_cost = cost;
+                best_split = b;
+            }
+        }
+
+        if (count <= options.max_leaf_size && options.intersect_cost * count <= best_cost)
+            return index;
+
+        auto it = std::partition(
+            primitives.begin() + begin, primitives.begin() + end,
+            [&](const BuildPrimitive &p)
+            { return bin_index(p.centroid, axis, min, scale, bins) < best_split; });
+        mid = static_cast<int>(it - primitives.begin());
+
+        if (mid == begin || mid == end)
+            mid = median_split(primitives, begin, end, axis);
+    }
+
+    nodes[index].count = 0;
+    nodes[index].axis = axis;
+    build_node(primitives, begin, mid, depth + 1, options, nodes);
+    int second = build_node(primitives, mid, end, depth + 1, options, nodes);
+    nodes[index].offset = second;
+
+    return index;
+}
+
+void build_bvh_sah(
+    const std::vector<AABB> &bounds, const BVHBuildOptions &options,
+    std::vector<BVHNode> &nodes, std::vector<int> &order)
+{
+    nodes.clear();
+    order.clear();
+    if (bounds.empty())
+        return;
+
+    std::vector<BuildPrimitive> primitives(bounds.size());
+    for (size_t i = 0; i < bounds.size(); ++i)
+    {
+        primitives[i].bounds = bounds[i];
+        primitives[i].centroid = bounds[i].centroid();
+        primitives[i].index = static_cast<int>(i);
+    }
+
+    nodes.reserve(2 * bounds.size());
+    build_node(primitives, 0, static_cast<int>(primitives.size()), 0, options, nodes);
+
+    order.resize(primitives.size());
+    for (size_t i = 0; i < primitives.size(); ++i)
+        order[i] = primitives[i].index;
+}
+
+void BVH::build(const std::vector<HitablePtr> &all_objects, const BVHBuildOptions &options)
+{
+    int total = static_cast<int>(all_objects.size());
+    std::vector<AABB> bounds(total);
+    std::vector<char> bounded(total);
+    _options = options;
+
+#pragma omp parallel for
+    for (int i = 0; i < total; ++i)
+        bounded[i] = all_objects[i]->bounding_box(bounds[i]);
+
+    // Unbounded objects (e.g. planes) cannot be placed in the tree
+    _unbounded.clear();
+    std::vector<HitablePtr> bounded_objects;
+    if (std::find(bounded.begin(), bounded.end(), 0) != bounded.end())
+    {
+        int count = 0;
+        for (int i = 0; i < total; ++i)
+        {
+            if (bounded[i])
+            {
+                bounded_objects.push_back(all_objects[i]);
+                bounds[count++] = bounds[i];
+            }
+            else
+            {
+                _unbounded.push_back(all_objects[i]);
+            }
+        }
+        bounds.resize(count);
+    }
+    const std::vector<HitablePtr> &objects = _unbounded.empty() ? all_objects : bounded_objects;
+    int count = static_cast<int>(objects.size());
+
+    std::vector<int> order;
+    std::string cache_path;
+    uint64_t hash = 0;
+    if (!options.cache_directory.empty())
+    {
+        hash = hash_bvh_input(bounds, options);
+        cache_path = bvh_cache_path(options.cache_directory, hash);
+    }
+
+    if (cache_path.empty() || !load_bvh_cache(cache_path, hash, bounds.size(), _nodes, order))
+    {
+        if (options.builder == BVHBuilder::LBVH)
+            build_bvh_lbvh(bounds, options, _nodes, order);
+        else
+            build_bvh_sah(bounds, options, _nodes, order);
+
+        if (!cache_path.empty())
+            save_bvh_cache(cache_path, hash, _nodes, order);
+    }
+
+    _objects.resize(order.size());
+
+#pragma omp parallel for
+    for (int i = 0; i < count; ++i)
+        _objects[i] = objects[order[i]];
+
+    partition_subtrees();
+    _cost = sah_cost();
+}
+
+bool BVH::intersect_subtree(int root, const Ray &r, const Vector3 &inv_direction,
+                            number_t t_min, number_t &t_max, HitRecord &rec) const
+{
+    // Closest hit below root, t_max shrinks to the distance of the closest hit.
+    bool dir_is_neg[3] = {inv_direction[0] < 0, inv_direction[1] < 0, inv_direction[2] < 0};
+    Point3 origin = r.origin();
+
+    bool hit_anything = false;
+    traverse_bvh(_nodes.data(), root, origin, inv_direction, dir_is_neg, t_min, t_max,
+                 [&](const BVHNode &node) -> bool
+                 {
+                     for (int i = node.offset; i < node.offset + node.count; ++i)
+                     {
+                         if (dispatch_intersect(*_objects[i], r, t_min, t_max, rec))
+                         {
+                             hit_anything = true;
+                             t_max = rec.t;
+                         }
+                     }
+                     return false;
+                 });
+
+    return hit_anything;
+}
+
+bool BVH::intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
+{
+    // A hit on a ground plane first lets the tree cull everything behind it
+    bool hit_anything = false;
+    for (const auto &object : _unbounded)
+    {
+        if (dispatch_intersect(*object, r, t_min, t_max, rec))
+        {
+            hit_anything = true;
+            t_max = rec.t;
+        }
+    }
+
+    if (!_nodes.empty() && intersect_subtree(0, r, 1 / r.direction(), t_min, t_max, rec))
+        hit_anything = true;
+
+    return hit_anything;
+}
+
+bool BVH::occluded(const Ray &r, number_t t_min, number_t t_max) const
+{
+    for (const auto &object : _unbounded)
+        if (dispatch_occluded(*object, r, t_min, t_max))
+            return true;
+
+    if (_nodes.empty())
+        return false;
+
+    Vector3 inv_direction = 1 / r.direction();
+    Point3 origin = r.origin();
+
+    bool blocked = false;
+    traverse_bvh(_nodes.data(), 0, origin, inv_direction, nullptr, t_min, t_max,
+                 [&](const BVHNode &node) -> bool
+                 {
+                     for (int i = node.offset; i < node.offset + node.count; ++i)
+                         if (dispatch_occluded(*_objects[i], r, t_min, t_max))
+                         {
+                             blocked = true;
+                             break;
+                         }
+                     return blocked;
+                 });
+
+    return blocked;
+}
+
+bool BVH::bounding_box(AABB &output_box) const
+{
+    if (_nodes.empty() || !_unbounded.empty())
+        return false;
+
+    output_box = _nodes[0].bounds;
+    return true;
+}
@@ -0,0 +1,234 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <raytracing/bvh_cache.h>
+#include <raytracing/mapped_file.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/stat.h>
+#define BVH_CACHE_MKDIR
+#endif
+
+struct BVHCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t node_size;
+    uint64_t hash;
+    uint64_t node_count;
+    uint64_t primitive_count;
+};
+
+struct BVHCacheNode
+{
+    double min[3];
+    double max[3];
+    int32_t offset;
+    int32_t count;
+    int32_t axis;
+    int32_t padding;
+};
+
+static const char bvh_cache_magic[8] = {'R', 'T', 'B', 'V', 'H', 'C', 'A', 0};
+
+// FNV-1a over 64 bit words rather than bytes, the bounds of a large scene
+// are hashed at every startup.
+template <class T>
+static void hash_value(uint64_t &hash, const T &value)
+{
+    uint64_t word = 0;
+    memcpy(&word, &value, sizeof(T) < sizeof(word) ? sizeof(T) : sizeof(word));
+    hash ^= word;
+    hash *= 1099511628211ull;
+}
+
+uint64_t hash_bvh_input(const std::vector<AABB> &bounds, const BVHBuildOptions &options)
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    hash_value(hash, BVH_CACHE_VERSION);
+    hash_value(hash, sizeof(number_t)); // bounds rounded to float must not reuse a double tree
+    hash_value(hash, static_cast<int>(options.builder));
+    hash_value(hash, options.bins);
+    hash_value(hash, options.max_leaf_size);
+    hash_value(hash, options.traversal_cost);
+    hash_value(hash, options.intersect_cost);
+    hash_value(hash, options.morton_bits);
+    hash_value(hash, options.treelet_bits);
+    hash_value(hash, options.sah_top_levels);
+
+    for (const auto &box : bounds)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            hash_value(hash, box.min()[a]);
+            hash_value(hash, box.max()[a]);
+        }
+    }
+
+    return hash;
+}
+
+std::string bvh_cache_path(const std::string &directory, uint64_t hash)
+{
+    std::ostringstream path;
+    path << directory << "/" << std::hex << std::setw(16) << std::setfill('0') << hash << ".bvh";
+    return path.str();
+}
+
+bool save_bvh_cache(
+    const std::string &path, uint64_t hash, const std::vector<BVHNode> &nodes, const std::vector<int> &order)
+{
+#ifdef BVH_CACHE_MKDIR
+    size_t slash = path.find_last_of('/');
+    if (slash != std::string::npos && slash > 0)
+        mkdir(path.substr(0, slash).c_str(), 0755);
+#endif
+
+    BVHCacheHeader header;
+    memcpy(header.magic, bvh_cache_magic, sizeof(header.magic));
+    header.version = BVH_CACHE_VERSION;
+    header.node_size = sizeof(BVHCacheNode);
+    header.hash = hash;
+    header.node_count = nodes.size();
+    header.primitive_count = order.size();
+
+    std::vector<BVHCacheNode> packed(nodes.size());
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            packed[i].min[a] = nodes[i].bounds.min()[a];
+            packed[i].max[a] = nodes[i].bounds.max()[a];
+        }
+        packed[i].offset = nodes[i].offset;
+        packed[i].count = nodes[i].count;
+        packed[i].axis = nodes[i].axis;
+        packed[i].padding = 0;
+    }
+
+    std::vector<int32_t> packed_order(order.begin(), order.end());
+
+    std::string temporary = temporary_path(path);
+    std::ofstream file(temporary, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(packed.data()), sizeof(BVHCacheNode) * packed.size());
+    file.write(reinterpret_cast<const char *>(packed_order.data()), sizeof(int32_t) * packed_order.size());
+    file.close();
+
+    if (!file)
+    {
+        std::remove(temporary.c_str());
+        return false;
+    }
+
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+static bool unpack_bvh_cache(
+    const char *data, size_t size, uint64_t hash, size_t primitive_count,
+    std::vector<BVHNode> &nodes, std::vector<int> &order)
+{
+    if (size < sizeof(BVHCacheHeader))
+        return false;
+
+    BVHCacheHeader header;
+    memcpy(&header, data, sizeof(header));
+    if (memcmp(header.magic, bvh_cache_magic, sizeof(header.magic)) != 0 ||
+        header.version != BVH_CACHE_VERSION || header.node_size != sizeof(BVHCacheNode) ||
+        header.hash != hash || header.primitive_count != primitive_count ||
+        header.node_count == 0 || header.node_count > INT32_MAX || header.primitive_count > INT32_MAX ||
+        size != sizeof(BVHCacheHeader) + sizeof(BVHCacheNode) * header.node_count +
+                    sizeof(int32_t) * header.primitive_count)
+        return false;
+
+    const BVHCacheNode *packed = reinterpret_cast<const BVHCacheNode *>(data + sizeof(BVHCacheHeader));
+    const int32_t *packed_order = reinterpret_cast<const int32_t *>(packed + header.node_count);
+    const int node_count = static_cast<int>(header.node_count);
+    const int count = static_cast<int>(primitive_count);
+
+    // A hash collision or a damaged file must not produce out of range
+    // indices, nor trees deeper than the traversal stacks. Children follow
+    // their parents, so one forward pass gives the depth of every node.
+    std::vector<int> depth(node_count, 0);
+    depth[0] = 1;
+    for (int i = 0; i < node_count; ++i)
+    {
+        const BVHCacheNode &node = packed[i];
+        if (node.count < 0 || depth[i] > BVH_MAX_DEPTH)
+            return false;
+        if (node.count > 0)
+        {
+            if (node.offset < 0 || static_cast<int64_t>(node.offset) + node.count > count)
+                return false;
+        }
+        else
+        {
+            if (node.offset <= i + 1 || node.offset >= node_count || node.axis < 0 || node.axis > 2)
+                return false;
+            depth[i + 1] = std::max(depth[i + 1], depth[i] + 1);
+            depth[node.offset] = std::max(depth[node.offset], depth[i] + 1);
+        }
+    }
+
+    // The order has to be a permutation of the primitives
+    std::vector<char> seen(count, 0);
+    for (int i = 0; i < count; ++i)
+    {
+        if (packed_order[i] < 0 || packed_order[i] >= count || seen[packed_order[i]])
+            return false;
+        seen[packed_order[i]] = 1;
+    }
+
+    nodes.resize(node_count);
+    order.resize(count);
+
+#pragma omp parallel for
+    for (int i = 0; i < node_count; ++i)
+    {
+        const BVHCacheNode &node = packed[i];
+        nodes[i].bounds = AABB(Point3(node.min[0], node.min[1], node.min[2]),
+                               Point3(node.max[0], node.max[1], node.max[2]));
+        nodes[i].offset = node.offset;
+        nodes[i].count = node.count;
+        nodes[i].axis = node.axis;
+    }
+
+#pragma omp parallel for
+    for (int i = 0; i < count; ++i)
+        order[i] = packed_order[i];
+
+    return true;
+}
+
+bool load_bvh_cache(
+    const std::string &path, uint64_t hash, size_t primitive_count,
+    std::vector<BVHNode> &nodes, std::vector<int> &order)
+{
+    MappedFile file(path);
+    return file.is_open() && unpack_bvh_cache(file.data(), file.size(), hash, primitive_count, nodes, order);
+}
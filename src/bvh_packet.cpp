@@ -0,0 +1,192 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <raytracing/bvh.h>
+
+static bool packet_ray_hits(
+    const Point3 &lo, const Point3 &hi, const RayPacket &packet, int k, number_t t_min, number_t t_max)
+{
+    for (int a = 0; a < 3; ++a)
+    {
+        auto t0 = (lo[a] - packet.origin[a][k]) * packet.inv_direction[a][k];
+        auto t1 = (hi[a] - packet.origin[a][k]) * packet.inv_direction[a][k];
+        if (packet.inv_direction[a][k] < 0)
+            std::swap(t0, t1);
+
+        t_min = t0 > t_min ? t0 : t_min;
+        t_max = t1 < t_max ? t1 : t_max;
+        if (t_max < t_min)
+            return false;
+    }
+    return true;
+}
+
+static bool packet_frustum_hits(
+    const Point3 &lo, const Point3 &hi, const RayPacket &packet, number_t t_min, number_t t_max)
+{
+    // Interval arithmetic over the origins and reciprocal directions of the
+    // packet bounds the slab distances of all its rays at once.
+    for (int a = 0; a < 3; ++a)
+    {
+        bool negative = packet.inv_direction_max[a] < 0;
+        number_t near = negative ? hi[a] : lo[a];
+        number_t far = negative ? lo[a] : hi[a];
+        number_t i0 = packet.inv_direction_min[a], i1 = packet.inv_direction_max[a];
+
+        number_t n0 = near - packet.origin_max[a], n1 = near - packet.origin_min[a];
+        number_t f0 = far - packet.origin_max[a], f1 = far - packet.origin_min[a];
+        number_t t0 = std::min(std::min(n0 * i0, n0 * i1), std::min(n1 * i0, n1 * i1));
+        number_t t1 = std::max(std::max(f0 * i0, f0 * i1), std::max(f1 * i0, f1 * i1));
+
+        t_min = t0 > t_min ? t0 : t_min;
+        t_max = t1 < t_max ? t1 : t_max;
+        if (t_max < t_min)
+            return false;
+    }
+    return true;
+}
+
+struct PacketStackEntry
+{
+    int node;
+    int first; // rays before this one missed an ancestor
+};
+
+void BVH::hit_packet(
+    const RayPacket &packet, number_t t_min, number_t t_max, HitRecord *recs, bool *hits) const
+{
+    if (packet.size <= 0)
+        return;
+    if (_nodes.empty() || !packet.coherent)
+    {
+        Hitable::hit_packet(packet, t_min, t_max, recs, hits);
+        return;
+    }
+
+    const int size = packet.size;
+    number_t closest_so_far[RAY_PACKET_SIZE];
+    for (int k = 0; k < size; ++k)
+    {
+        hits[k] = false;
+        closest_so_far[k] = t_max;
+        for (const auto &object : _unbounded)
+        {
+            if (dispatch_intersect(*object, packet.rays[k], t_min, closest_so_far[k], recs[k]))
+            {
+                hits[k] = true;
+                closest_so_far[k] = recs[k].t;
+            }
+        }
+    }
+    number_t packet_t_max = *std::max_element(closest_so_far, closest_so_far + size);
+
+    PacketStackEntry stack[BVH_MAX_DEPTH];
+    int stack_size = 0;
+    int current = 0;
+    int first = 0;
+
+    while (true)
+    {
+        // First active ray traversal: descend as long as one ray hits the node,
+        // cull the node if the whole packet misses it.
+        const BVHNode &node = _nodes[current];
+        Point3 lo = node.bounds.min(), hi = node.bounds.max();
+
+        int active = first;
+        if (!packet_ray_hits(lo, hi, packet, active, t_min, closest_so_far[active]))
+        {
+            active = size;
+            if (packet_frustum_hits(lo, hi, packet, t_min, packet_t_max))
+            {
+                for (int k = first + 1; k < size; ++k)
+                {
+                    if (packet_ray_hits(lo, hi, packet, k, t_min, closest_so_far[k]))
+                    {
+                        active = k;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (active < size)
+        {
+            if (node.is_leaf() || 4 * (size - active) < size)
+            {
+                // At leaves, or once most of the packet has left this subtree,
+                // continue with the remaining rays one by one.
+                for (int k = active; k < size; ++k)
+                {
+                    const Ray &r = packet.rays[k];
+                    if (node.is_leaf())
+                    {
+                        if (k != active && !packet_ray_hits(lo, hi, packet, k, t_min, closest_so_far[k]))
+                            continue;
+
+                        for (int i = node.offset; i < node.offset + node.count; ++i)
+                        {
+                            if (dispatch_intersect(*_objects[i], r, t_min, closest_so_far[k], recs[k]))
+                            {
+                                hits[k] = true;
+                                closest_so_far[k] = recs[k].t;
+                            }
+                        }
+                    }
+                    else
+                    {
+                        Vector3 inv_direction{packet.inv_direction[0][k], packet.inv_direction[1][k], packet.inv_direction[2][k]};
+                        if (intersect_subtree(current, r, inv_direction, t_min, closest_so_far[k], recs[k]))
+                            hits[k] = true;
+                    }
+                }
+
+                packet_t_max = *std::max_element(closest_so_far, closest_so_far + size);
+            }
+            else
+            {
+                // The packet shares the direction signs, so near and far agree.
+                if (packet.inv_direction[node.axis][active] < 0)
+                {
+                    stack[stack_size++] = PacketStackEntry{current + 1, active};
+                    current = node.offset;
+                }
+                else
+                {
+                    stack[stack_size++] = PacketStackEntry{node.offset, active};
+                    current = current + 1;
+                }
+                first = active;
+                continue;
+            }
+        }
+
+        if (stack_size == 0)
+            break;
+        --stack_size;
+        current = stack[stack_size].node;
+        first = stack[stack_size].first;
+    }
+
+    for (int k = 0; k < size; ++k)
+        if (hits[k])
+            complete(packet.rays[k], recs[k]);
+}
@@ -0,0 +1,291 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <omp.h>
+#include <raytracing/bvh.h>
+
+// Minimum number of subtrees refitted in parallel
+#define BVH_REFIT_SUBTREES 64
+
+static int subtree_end(const std::vector<BVHNode> &nodes, int index)
+{
+    // The second child's subtree is laid out last.
+    while (!nodes[index].is_leaf())
+        index = nodes[index].offset;
+    return index + 1;
+}
+
+static int first_object(const std::vector<BVHNode> &nodes, int index)
+{
+    while (!nodes[index].is_leaf())
+        index = index + 1;
+    return nodes[index].offset;
+}
+
+static int last_object(const std::vector<BVHNode> &nodes, int index)
+{
+    while (!nodes[index].is_leaf())
+        index = nodes[index].offset;
+    return nodes[index].offset + nodes[index].count;
+}
+
+number_t bvh_sah_cost(
+    const std::vector<BVHNode> &nodes, int root, int end, const BVHBuildOptions &options)
+{
+    number_t area = nodes[root].bounds.surface_area();
+    if (area <= 0)
+        return 0;
+
+    number_t cost = 0;
+    for (int i = root; i < end; ++i)
+    {
+        number_t a = nodes[i].bounds.surface_area();
+        cost += nodes[i].is_leaf() ? options.intersect_cost * nodes[i].count * a : options.traversal_cost * a;
+    }
+    return cost / area;
+}
+
+void BVH::partition_subtrees()
+{
+    // Open the tree breadth-first until there are enough subtrees to keep all
+    // threads busy. Subtrees occupy contiguous node and object ranges.
+    _subtrees.clear();
+    _top_nodes.clear();
+    if (_nodes.empty())
+        return;
+
+    const size_t target = std::max(BVH_REFIT_SUBTREES, 8 * omp_get_max_threads());
+    std::vector<int> frontier(1, 0);
+    while (frontier.size() < target)
+    {
+        std::vector<int> next;
+        for (int index : frontier)
+        {
+            if (_nodes[index].is_leaf())
+            {
+                next.push_back(index);
+                continue;
+            }
+            _top_nodes.push_back(index);
+            next.push_back(index + 1);
+            next.push_back(_nodes[index].offset);
+        }
+
+        if (next.size() == frontier.size())
+            break;
+        frontier.swap(next);
+    }
+    std::sort(_top_nodes.begin(), _top_nodes.end());
+
+    _subtrees.resize(frontier.size());
+    const int count = static_cast<int>(frontier.size());
+
+#pragma omp parallel for schedule(dynamic)
+    for (int s = 0; s < count; ++s)
+    {
+        BVHSubtree &subtree = _subtrees[s];
+        subtree.root = frontier[s];
+        subtree.end = subtree_end(_nodes, subtree.root);
+        subtree.first = first_object(_nodes, subtree.root);
+        subtree.last = last_object(_nodes, subtree.root);
+        subtree.cost = bvh_sah_cost(_nodes, subtree.root, subtree.end, _options);
+    }
+}
+
+void BVH::refit_node(int index)
+{
+    BVHNode &node = _nodes[index];
+    if (node.is_leaf())
+    {
+        AABB box, temp_box;
+        for (int i = node.offset; i < node.offset + node.count; ++i)
+        {
+            _objects[i]->bounding_box(temp_box);
+            box.extend(temp_box);
+        }
+        node.bounds = box;
+    }
+    else
+    {
+        node.bounds = surrounding_box(_nodes[index + 1].bounds, _nodes[node.offset].bounds);
+    }
+}
+
+void BVH::refit()
+{
+    // Children are stored after their parents, so reverse order is bottom-up.
+    const int count = static_cast<int>(_subtrees.size());
+
+#pragma omp parallel for schedule(dynamic)
+    for (int s = 0; s < count; ++s)
+        for (int i = _subtrees[s].end - 1; i >= _subtrees[s].root; --i)
+            refit_node(i);
+
+    for (auto it = _top_nodes.rbegin(); it != _top_nodes.rend(); ++it)
+        refit_node(*it);
+}
+
+void BVH::rebuild_subtree(BVHSubtree &subtree, std::vector<BVHNode> &nodes)
+{
+    std::vector<AABB> bounds(subtree.last - subtree.first);
+    for (int i = subtree.first; i < subtree.last; ++i)
+        _objects[i]->bounding_box(bounds[i - subtree.first]);
+
+    // Subtrees are always rebuilt with SAH, they are small.
+    std::vector<int> order;
+    build_bvh_sah(bounds, _options, nodes, order);
+
+    std::vector<HitablePtr> objects(_objects.begin() + subtree.first, _objects.begin() + subtree.last);
+    for (size_t i = 0; i < order.size(); ++i)
+        _objects[subtree.first + i] = objects[order[i]];
+
+    for (auto &node : nodes)
+        if (node.is_leaf())
+            node.offset += subtree.first;
+
+    subtree.cost = bvh_sah_cost(nodes, 0, static_cast<int>(nodes.size()), _options);
+}
+
+struct RelayoutContext
+{
+    const std::vector<BVHNode> &old_nodes;
+    const std::vector<int> &old_roots;
+    const std::vector<std::vector<BVHNode>> &rebuilt;
+    std::vector<BVHSubtree> &subtrees;
+    std::vector<int> &top_nodes;
+    std::vector<BVHNode> &nodes;
+};
+
+static int relayout(RelayoutContext &context, int old_index)
+{
+    // Copy the tree depth-first, substituting the rebuilt subtrees.
+    int index = static_cast<int>(context.nodes.size());
+    auto root = std::lower_bound(context.old_roots.begin(), context.old_roots.end(), old_index);
+
+    if (root != context.old_roots.end() && *root == old_index)
+    {
+        size_t s = root - context.old_roots.begin();
+        BVHSubtree &subtree = context.subtrees[s];
+        const auto &rebuilt = context.rebuilt[s];
+        int shift = rebuilt.empty() ? index - subtree.root : index;
+        auto begin = rebuilt.empty() ? context.old_nodes.begin() + subtree.root : rebuilt.begin();
+        auto end = rebuilt.empty() ? context.old_nodes.begin() + subtree.end : rebuilt.end();
+
+        for (auto node = begin; node != end; ++node)
+        {
+            context.nodes.push_back(*node);
+            if (!node->is_leaf())
+                context.nodes.back().offset += shift;
+        }
+
+        subtree.root = index;
+        subtree.end = static_cast<int>(context.nodes.size());
+        return index;
+    }
+
+    const BVHNode &old_node = context.old_nodes[old_index];
+    context.top_nodes.push_back(index);
+    context.nodes.push_back(old_node);
+    relayout(context, old_index + 1);
+    int second = relayout(context, old_node.offset);
+    context.nodes[index].offset = second;
+    return index;
+}
+
+int BVH::update(number_t max_cost_growth)
+{
+    refit();
+    if (_nodes.empty())
+        return 0;
+
+    const int count = static_cast<int>(_subtrees.size());
+    std::vector<number_t> costs(count);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int s = 0; s < count; ++s)
+        costs[s] = bvh_sah_cost(_nodes, _subtrees[s].root, _subtrees[s].end, _options);
+
+    // Cost of the whole tree from the subtree costs
+    number_t area = _nodes[0].bounds.surface_area();
+    number_t cost = 0;
+    for (int index : _top_nodes)
+        cost += _options.traversal_cost * _nodes[index].bounds.surface_area();
+    for (int s = 0; s < count; ++s)
+        cost += costs[s] * _nodes[_subtrees[s].root].bounds.surface_area();
+    cost = area > 0 ? cost / area : 0;
+
+    if (cost > max_cost_growth * _cost)
+    {
+        // Moving geometry would only fill the cache with single-use trees
+        std::vector<HitablePtr> objects(_objects);
+        objects.insert(objects.end(), _unbounded.begin(), _unbounded.end());
+        // build() keeps the options it is given, so restore the directory
+        // for later builds
+        const std::string cache_directory = _options.cache_directory;
+        BVHBuildOptions options = _options;
+        options.cache_directory.clear();
+        build(objects, options);
+        _options.cache_directory = cache_directory;
+        return count;
+    }
+
+    std::vector<std::vector<BVHNode>> rebuilt(count);
+    int rebuilt_count = 0;
+
+#pragma omp parallel for schedule(dynamic) reduction(+ : rebuilt_count)
+    for (int s = 0; s < count; ++s)
+    {
+        if (costs[s] > max_cost_growth * _subtrees[s].cost)
+        {
+            rebuild_subtree(_subtrees[s], rebuilt[s]);
+            ++rebuilt_count;
+        }
+    }
+
+    if (rebuilt_count == 0)
+        return 0;
+
+    std::vector<int> old_roots(count);
+    for (int s = 0; s < count; ++s)
+        old_roots[s] = _subtrees[s].root;
+
+    std::vector<BVHNode> nodes;
+    nodes.reserve(_nodes.size());
+    _top_nodes.clear();
+
+    RelayoutContext context{_nodes, old_roots, rebuilt, _subtrees, _top_nodes, nodes};
+    relayout(context, 0);
+    _nodes.swap(nodes);
+
+    // The top levels still enclose the same objects, only their bounds change.
+    for (auto it = _top_nodes.rbegin(); it != _top_nodes.rend(); ++it)
+        refit_node(*it);
+
+    return rebuilt_count;
+}
+
+number_t BVH::sah_cost() const
+{
+    if (_nodes.empty())
+        return 0;
+    return bvh_sah_cost(_nodes, 0, static_cast<int>(_nodes.size()), _options);
+}
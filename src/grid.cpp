@@ -0,0 +1,321 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <raytracing/grid.h>
+
+// Upper limit of cells along one axis
+#define GRID_MAX_RESOLUTION 256
+
+void UniformGrid::choose_resolution(const AABB &bounds, size_t count, number_t density)
+{
+    // About density objects per cell, cells as close to cubes as the bounds allow.
+    Vector3 extent = bounds.extent();
+    number_t max_extent = fmax(extent[0], fmax(extent[1], extent[2]));
+    for (int a = 0; a < 3; ++a)
+        extent[a] = fmax(extent[a], 1e-3 * max_extent); // flat scenes
+
+    number_t volume = extent[0] * extent[1] * extent[2];
+    number_t cells_per_unit = volume > 0 ? cbrt(density * count / volume) : 0;
+
+    for (int a = 0; a < 3; ++a)
+    {
+        int n = static_cast<int>(extent[a] * cells_per_unit + 0.5);
+        _resolution[a] = std::max(1, std::min(n, GRID_MAX_RESOLUTION));
+    }
+}
+
+void UniformGrid::build(const std::vector<HitablePtr> &objects, number_t density, const int *resolution)
+{
+    _objects.clear();
+    _overflow.clear();
+    _cell_offsets.clear();
+    _cell_objects.clear();
+    _bounds = AABB();
+    _resolution[0] = _resolution[1] = _resolution[2] = 1;
+
+    std::vector<AABB> boxes;
+    for (const auto &object : objects)
+    {
+        AABB box;
+        if (object->bounding_box(box))
+        {
+            _objects.push_back(object);
+            boxes.push_back(box);
+        }
+        else
+        {
+            _overflow.push_back(object);
+        }
+    }
+
+    // Objects larger than a cell move to the overflow list. This shrinks the
+    // grid bounds and thereby the cells, so repeat until the split is stable,
+    // but never give up on the grid for the majority of the objects.
+    for (int pass = 0; pass < 4 && !_objects.empty(); ++pass)
+    {
+        _bounds = AABB();
+        for (const auto &box : boxes)
+            _bounds.extend(box);
+
+        if (resolution)
+        {
+            // At least one cell per axis, cell_index() assumes it
+            for (int a = 0; a < 3; ++a)
+                _resolution[a] = std::max(1, resolution[a]);
+        }
+        else
+            choose_resolution(_bounds, _objects.size(), density);
+
+        for (int a = 0; a < 3; ++a)
+            _cell_size[a] = _bounds.extent()[a] / _resolution[a];
+
+        std::vector<char> is_large(boxes.size(), 0);
+        size_t large = 0;
+        for (size_t i = 0; i < boxes.size(); ++i)
+        {
+            Vector3 extent = boxes[i].extent();
+            if (extent[0] > _cell_size[0] || extent[1] > _cell_size[1] || extent[2] > _cell_size[2])
+            {
+                is_large[i] = 1;
+                ++large;
+            }
+        }
+
+        if (large == 0 || 2 * large > _objects.size())
+            break;
+
+        size_t kept = 0;
+        for (size_t i = 0; i < boxes.size(); ++i)
+        {
+            if (is_large[i])
+            {
+                _overflow.push_back(_objects[i]);
+                continue;
+            }
+            _objects[kept] = _objects[i];
+            boxes[kept] = boxes[i];
+            ++kept;
+        }
+        _objects.resize(kept);
+        boxes.resize(kept);
+    }
+
+    if (_objects.empty())
+        return;
+
+    for (int a = 0; a < 3; ++a)
+        _inv_cell_size[a] = _cell_size[a] > 0 ? 1 / _cell_size[a] : 0;
+
+    // Cell ranges overlapped by each object
+    const int cells = _resolution[0] * _resolution[1] * _resolution[2];
+    std::vector<int> first(3 * boxes.size()), last(3 * boxes.size());
+    for (size_t i = 0; i < boxes.size(); ++i)
+    {
+        for (int a = 0; a < 3; ++a)
+        {
+            int lo = static_cast<int>((boxes[i].min()[a] - _bounds.min()[a]) * _inv_cell_size[a]);
+            int hi = static_cast<int>((boxes[i].max()[a] - _bounds.min()[a]) * _inv_cell_size[a]);
+            first[3 * i + a] = std::max(0, std::min(lo, _resolution[a] - 1));
+            last[3 * i + a] = std::max(0, std::min(hi, _resolution[a] - 1));
+        }
+    }
+
+    // Count, prefix sum and fill the compressed cell lists
+    _cell_offsets.assign(cells + 1, 0);
+    for (size_t i = 0; i < boxes.size(); ++i)
+        for (int z = first[3 * i + 2]; z <= last[3 * i + 2]; ++z)
+            for (int y = first[3 * i + 1]; y <= last[3 * i + 1]; ++y)
+                for (int x = first[3 * i]; x <= last[3 * i]; ++x)
+                    ++_cell_offsets[cell_index(x, y, z) + 1];
+
+    for (int c = 0; c < cells; ++c)
+        _cell_offsets[c + 1] += _cell_offsets[c];
+
+    _cell_objects.resize(_cell_offsets[cells]);
+    std::vector<int> fill(_cell_offsets.begin(), _cell_offsets.end() - 1);
+    for (size_t i = 0; i < boxes.size(); ++i)
+        for (int z = first[3 * i + 2]; z <= last[3 * i + 2]; ++z)
+            for (int y = first[3 * i + 1]; y <= last[3 * i + 1]; ++y)
+                for (int x = first[3 * i]; x <= last[3 * i]; ++x)
+                    _cell_objects[fill[cell_index(x, y, z)]++] = static_cast<int>(i);
+}
+
+// State of a 3D-DDA walk through the cells along a ray
+struct UniformGrid::DDA
+{
+    int cell[3], step[3], out[3];
+    number_t next_crossing[3], delta[3];
+    number_t t_exit;
+
+    int next_axis() const
+    {
+        return next_crossing[0] < next_crossing[1]
+                   ? (next_crossing[0] < next_crossing[2] ? 0 : 2)
+                   : (next_crossing[1] < next_crossing[2] ? 1 : 2);
+    }
+
+    // Step into the neighbour across axis, false once the ray leaves the grid
+    bool advance(int axis)
+    {
+        cell[axis] += step[axis];
+        if (cell[axis] == out[axis])
+            return false;
+        next_crossing[axis] += delta[axis];
+        return true;
+    }
+};
+
+bool UniformGrid::begin_dda(const Ray &r, number_t t_min, number_t t_max, DDA &dda) const
+{
+    // Clip the ray against the grid bounds
+    Point3 origin = r.origin();
+    Vector3 direction = r.direction();
+    number_t t_enter = t_min;
+    dda.t_exit = t_max;
+    for (int a = 0; a < 3; ++a)
+    {
+        number_t inv_d = 1 / direction[a];
+        number_t t0 = (_bounds.min()[a] - origin[a]) * inv_d;
+        number_t t1 = (_bounds.max()[a] - origin[a]) * inv_d;
+        if (inv_d < 0)
+            std::swap(t0, t1);
+        t_enter = t0 > t_enter ? t0 : t_enter;
+        dda.t_exit = t1 < dda.t_exit ? t1 : dda.t_exit;
+        if (dda.t_exit < t_enter)
+            return false;
+    }
+
+    // Set up the 3D-DDA at the entry point
+    Point3 p = r.at(t_enter);
+    for (int a = 0; a < 3; ++a)
+    {
+        int c = static_cast<int>((p[a] - _bounds.min()[a]) * _inv_cell_size[a]);
+        dda.cell[a] = std::max(0, std::min(c, _resolution[a] - 1));
+
+        if (direction[a] > 0)
+        {
+            number_t plane = _bounds.min()[a] + (dda.cell[a] + 1) * _cell_size[a];
+            dda.next_crossing[a] = (plane - origin[a]) / direction[a];
+            dda.delta[a] = _cell_size[a] / direction[a];
+            dda.step[a] = 1;
+            dda.out[a] = _resolution[a];
+        }
+        else if (direction[a] < 0)
+        {
+            number_t plane = _bounds.min()[a] + dda.cell[a] * _cell_size[a];
+            dda.next_crossing[a] = (plane - origin[a]) / direction[a];
+            dda.delta[a] = -_cell_size[a] / direction[a];
+            dda.step[a] = -1;
+            dda.out[a] = -1;
+        }
+        else
+        {
+            dda.next_crossing[a] = infinity;
+            dda.delta[a] = infinity;
+            dda.step[a] = 0;
+            dda.out[a] = -1;
+        }
+    }
+
+    return true;
+}
+
+bool UniformGrid::intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
+{
+    bool hit_anything = false;
+    auto closest_so_far = t_max;
+
+    for (const auto &object : _overflow)
+    {
+        if (dispatch_intersect(*object, r, t_min, closest_so_far, rec))
+        {
+            hit_anything = true;
+            closest_so_far = rec.t;
+        }
+    }
+
+    DDA dda;
+    if (_objects.empty() || !begin_dda(r, t_min, closest_so_far, dda))
+        return hit_anything;
+
+    while (true)
+    {
+        int c = cell_index(dda.cell[0], dda.cell[1], dda.cell[2]);
+        for (int k = _cell_offsets[c]; k < _cell_offsets[c + 1]; ++k)
+        {
+            if (dispatch_intersect(*_objects[_cell_objects[k]], r, t_min, closest_so_far, rec))
+            {
+                hit_anything = true;
+                closest_so_far = rec.t;
+            }
+        }
+
+        int axis = dda.next_axis();
+
+        // Hits inside the current cell cannot be beaten by later cells.
+        if (closest_so_far <= dda.next_crossing[axis] || dda.next_crossing[axis] > dda.t_exit)
+            break;
+
+        if (!dda.advance(axis))
+            break;
+    }
+
+    return hit_anything;
+}
+
+bool UniformGrid::occluded(const Ray &r, number_t t_min, number_t t_max) const
+{
+    for (const auto &object : _overflow)
+        if (dispatch_occluded(*object, r, t_min, t_max))
+            return true;
+
+    DDA dda;
+    if (_objects.empty() || !begin_dda(r, t_min, t_max, dda))
+        return false;
+
+    while (true)
+    {
+        int c = cell_index(dda.cell[0], dda.cell[1], dda.cell[2]);
+        for (int k = _cell_offsets[c]; k < _cell_offsets[c + 1]; ++k)
+            if (dispatch_occluded(*_objects[_cell_objects[k]], r, t_min, t_max))
+                return true;
+
+        int axis = dda.next_axis();
+        if (dda.next_crossing[axis] > dda.t_exit || !dda.advance(axis))
+            return false;
+    }
+}
+
+bool UniformGrid::bounding_box(AABB &output_box) const
+{
+    output_box = _bounds;
+
+    AABB temp_box;
+    for (const auto &object : _overflow)
+    {
+        if (!object->bounding_box(temp_box))
+            return false;
+        output_box.extend(temp_box);
+    }
+
+    return !output_box.is_empty();
+}
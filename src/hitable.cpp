@@ -0,0 +1,40 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <raytracing/hitable.h>
+#include <raytracing/material.h>
+
+void Hitable::complete(const Ray &r, HitRecord &rec)
+{
+    // An instance finishes the record of its object in object space.
+    const Hitable *owner = rec.instance ? rec.instance : rec.object;
+    owner->compute_interaction(r, rec);
+    if (rec.material && rec.material->needs_uv())
+        owner->compute_uv(r, rec);
+}
+
+void Hitable::hit_batch(
+    const Ray *rays, int count, number_t t_min, number_t t_max, HitRecord *recs, bool *hits) const
+{
+#pragma omp parallel for schedule(dynamic, 256)
+    for (int k = 0; k < count; ++k)
+        hits[k] = hit(rays[k], t_min, t_max, recs[k]);
+}
@@ -0,0 +1,77 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <raytracing/instance.h>
+
+bool Instance::intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
+{
+    if (!_transform.invertible())
+        return false;
+
+    Ray local = _transform.inverse_ray(r);
+    if (!_object->intersect(local, t_min, t_max, rec))
+        return false;
+
+    // Only one level of instancing is deferred, an instance within this one
+    // is evaluated right away and leaves no object to complete.
+    if (rec.instance)
+    {
+        rec.instance->compute_interaction(local, rec);
+        rec.instance->compute_uv(local, rec);
+        rec.object = NULL;
+    }
+    rec.instance = this;
+
+    return true;
+}
+
+void Instance::compute_interaction(const Ray &r, HitRecord &rec) const
+{
+    if (rec.object)
+        rec.object->compute_interaction(_transform.inverse_ray(r), rec);
+
+    // The face orientation is invariant under the transformation.
+    rec.error = _transform.point_error(rec.p, rec.error);
+    rec.p = _transform.point(rec.p);
+    rec.normal = normalize_Vector3(_transform.normal(rec.normal));
+    if (_material)
+        rec.material = _material.get();
+}
+
+void Instance::compute_uv(const Ray &r, HitRecord &rec) const
+{
+    if (rec.object)
+        rec.object->compute_uv(_transform.inverse_ray(r), rec);
+}
+
+bool Instance::occluded(const Ray &r, number_t t_min, number_t t_max) const
+{
+    if (!_transform.invertible())
+        return false;
+
+    return _object->occluded(_transform.inverse_ray(r), t_min, t_max);
+}
+
+bool Instance::bounding_box(AABB &output_box) const
+{
+    output_box = _bounds;
+    return _has_bounds;
+}
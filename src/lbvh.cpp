@@ -0,0 +1,340 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <cstdint>
+#include <omp.h>
+#include <raytracing/bvh.h>
+
+struct MortonPrimitive
+{
+    uint64_t code;
+    int index;
+};
+
+static uint64_t expand_bits(uint64_t x)
+{
+    // Insert two zero bits after each of the lower 21 bits of x.
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffffull;
+    x = (x | x << 16) & 0x1f0000ff0000ffull;
+    x = (x | x << 8) & 0x100f00f00f00f00full;
+    x = (x | x << 4) & 0x10c30c30c30c30c3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+    return x;
+}
+
+static uint64_t morton_code(const Point3 &p, const AABB &box, int bits_per_axis)
+{
+    // Bit 3k + a of the code is bit k of the quantized coordinate along axis a.
+    const number_t scale = static_cast<number_t>(uint64_t(1) << bits_per_axis);
+    const uint64_t max = (uint64_t(1) << bits_per_axis) - 1;
+    Vector3 extent = box.extent();
+    uint64_t code = 0;
+
+    for (int a = 0; a < 3; ++a)
+    {
+        number_t f = extent[a] > 0 ? (p[a] - box.min()[a]) / extent[a] : 0;
+        uint64_t q = static_cast<uint64_t>(f * scale);
+        code |= expand_bits(q < max ? q : max) << a;
+    }
+    return code;
+}
+
+static void radix_sort(std::vector<MortonPrimitive> &primitives, int bits)
+{
+    // Parallel LSD radix sort: every thread histograms its own chunk, a prefix sum
+    // over (digit, thread) yields stable scatter offsets for each chunk.
+    const int digit_bits = 8;
+    const int buckets = 1 << digit_bits;
+    const size_t n = primitives.size();
+
+    std::vector<MortonPrimitive> temp(n);
+    std::vector<size_t> histogram(buckets * omp_get_max_threads());
+
+    for (int shift = 0; shift < bits; shift += digit_bits)
+    {
+#pragma omp parallel
+        {
+            int threads = omp_get_num_threads();
+            int thread = omp_get_thread_num();
+            size_t begin = n * thread / threads;
+            size_t end = n * (thread + 1) / threads;
+            size_t *local = &histogram[thread * buckets];
+
+            std::fill(local, local + buckets, 0);
+            for (size_t i = begin; i < end; ++i)
+                ++local[(primitives[i].code >> shift) & (buckets - 1)];
+
+#pragma omp barrier
+#pragma omp single
+            {
+                size_t offset = 0;
+                for (int d = 0; d < buckets; ++d)
+                {
+                    for (int t = 0; t < threads; ++t)
+                    {
+                        size_t c = histogram[t * buckets + d];
+                        histogram[t * buckets + d] = offset;
+                        offset += c;
+                    }
+                }
+            }
+
+            for (size_t i = begin; i < end; ++i)
+                temp[local[(primitives[i].code >> shift) & (buckets - 1)]++] = primitives[i];
+        }
+
+        primitives.swap(temp);
+    }
+}
+
+static AABB emit_lbvh(
+    const std::vector<MortonPrimitive> &primitives, const std::vector<AABB> &bounds,
+    int begin, int end, int bit, const BVHBuildOptions &options, std::vector<BVHNode> &nodes)
+{
+    int count = end - begin;
+
+    // Skip the bit planes along which this range does not split.
+    while (bit >= 0 && count > options.max_leaf_size)
+    {
+        uint64_t mask = uint64_t(1) << bit;
+        if ((primitives[begin].code & mask) != (primitives[end - 1].code & mask))
+            break;
+        --bit;
+    }
+
+    int index = static_cast<int>(nodes.size());
+    nodes.push_back(BVHNode());
+
+    if (count <= options.max_leaf_size)
+    {
+        AABB box;
+        for (int i = begin; i < end; ++i)
+            box.extend(bounds[primitives[i].index]);
+
+        nodes[index].bounds = box;
+        nodes[index].offset = begin;
+        nodes[index].count = count;
+        nodes[index].axis = 0;
+        return box;
+    }
+
+    int mid, axis;
+    if (bit < 0)
+    {
+        // Identical codes, split in the middle to honour the leaf size.
+        mid = (begin + end) / 2;
+        axis = 0;
+    }
+    else
+    {
+        uint64_t mask = uint64_t(1) << bit;
+        auto it = std::partition_point(
+            primitives.begin() + begin, primitives.begin() + end,
+            [mask](const MortonPrimitive &p)
+            { return (p.code & mask) == 0; });
+        mid = static_cast<int>(it - primitives.begin());
+        axis = bit % 3;
+    }
+
+    AABB box = emit_lbvh(primitives, bounds, begin, mid, bit - 1, options, nodes);
+    int second = static_cast<int>(nodes.size());
+    box.extend(emit_lbvh(primitives, bounds, mid, end, bit - 1, options, nodes));
+
+    nodes[index].bounds = box;
+    nodes[index].offset = second;
+    nodes[index].count = 0;
+    nodes[index].axis = axis;
+    return box;
+}
+
+static AABB emit_top_levels(
+    const std::vector<uint64_t> &prefixes, const std::vector<AABB> &treelet_bounds,
+    int begin, int end, int bit, std::vector<BVHNode> &nodes)
+{
+    // Morton splits over the treelet prefixes, one treelet per leaf.
+    int index = static_cast<int>(nodes.size());
+    nodes.push_back(BVHNode());
+
+    if (end - begin == 1)
+    {
+        nodes[index].bounds = treelet_bounds[begin];
+        nodes[index].offset = begin;
+        nodes[index].count = 1;
+        nodes[index].axis = 0;
+        return treelet_bounds[begin];
+    }
+
+    while ((prefixes[begin] & (uint64_t(1) << bit)) == (prefixes[end - 1] & (uint64_t(1) << bit)))
+        --bit;
+
+    uint64_t mask = uint64_t(1) << bit;
+    int mid = static_cast<int>(
+        std::partition_point(
+            prefixes.begin() + begin, prefixes.begin() + end,
+            [mask](uint64_t p)
+            { return (p & mask) == 0; }) -
+        prefixes.begin());
+
+    AABB box = emit_top_levels(prefixes, treelet_bounds, begin, mid, bit - 1, nodes);
+    int second = static_cast<int>(nodes.size());
+    box.extend(emit_top_levels(prefixes, treelet_bounds, mid, end, bit - 1, nodes));
+
+    nodes[index].bounds = box;
+    nodes[index].offset = second;
+    nodes[index].count = 0;
+    nodes[index].axis = 0;
+    return box;
+}
+
+static int splice_treelets(
+    const std::vector<BVHNode> &top_nodes, const std::vector<int> &top_order, int top_index,
+    const std::vector<std::vector<BVHNode>> &treelets, std::vector<int> &treelet_base,
+    std::vector<BVHNode> &nodes)
+{
+    // Lay out the top levels depth-first and reserve a contiguous block for every
+    // treelet where its top-level leaf used to be.
+    const BVHNode &top = top_nodes[top_index];
+    int index = static_cast<int>(nodes.size());
+
+    if (top.is_leaf())
+    {
+        int t = top_order[top.offset];
+        treelet_base[t] = index;
+        nodes.resize(nodes.size() + treelets[t].size());
+        return index;
+    }
+
+    nodes.push_back(top);
+    splice_treelets(top_nodes, top_order, top_index + 1, treelets, treelet_base, nodes);
+    nodes[index].offset = splice_treelets(top_nodes, top_order, top.offset, treelets, treelet_base, nodes);
+    return index;
+}
+
+void build_bvh_lbvh(
+    const std::vector<AABB> &bounds, const BVHBuildOptions &options,
+    std::vector<BVHNode> &nodes, std::vector<int> &order)
+{
+    nodes.clear();
+    order.clear();
+    if (bounds.empty())
+        return;
+
+    const int count = static_cast<int>(bounds.size());
+    const int bits_per_axis = options.morton_bits > 30 ? 20 : 10;
+    const int bits = 3 * bits_per_axis;
+    const int treelet_bits = std::max(0, std::min(options.treelet_bits, bits));
+
+    // Bounds of the primitive centroids
+    AABB centroid_bounds;
+#pragma omp parallel
+    {
+        AABB local;
+#pragma omp for nowait
+        for (int i = 0; i < count; ++i)
+            local.extend(bounds[i].centroid());
+#pragma omp critical
+        centroid_bounds.extend(local);
+    }
+
+    // Morton codes, sorted along the curve
+    std::vector<MortonPrimitive> primitives(count);
+#pragma omp parallel for
+    for (int i = 0; i < count; ++i)
+    {
+        primitives[i].code = morton_code(bounds[i].centroid(), centroid_bounds, bits_per_axis);
+        primitives[i].index = i;
+    }
+
+    radix_sort(primitives, bits);
+
+    // Treelets share the leading treelet_bits of their codes
+    std::vector<int> treelet_begin;
+    std::vector<uint64_t> prefixes;
+    for (int i = 0; i < count; ++i)
+    {
+        uint64_t prefix = primitives[i].code >> (bits - treelet_bits);
+        if (i == 0 || prefix != prefixes.back())
+        {
+            treelet_begin.push_back(i);
+            prefixes.push_back(prefix);
+        }
+    }
+    treelet_begin.push_back(count);
+
+    const int treelet_count = static_cast<int>(prefixes.size());
+    std::vector<std::vector<BVHNode>> treelets(treelet_count);
+    std::vector<AABB> treelet_bounds(treelet_count);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < treelet_count; ++t)
+    {
+        int size = treelet_begin[t + 1] - treelet_begin[t];
+        treelets[t].reserve(2 * size);
+        treelet_bounds[t] = emit_lbvh(
+            primitives, bounds, treelet_begin[t], treelet_begin[t + 1],
+            bits - treelet_bits - 1, options, treelets[t]);
+    }
+
+    // Join the treelets
+    std::vector<BVHNode> top_nodes;
+    std::vector<int> top_order;
+    if (options.sah_top_levels)
+    {
+        BVHBuildOptions top_options = options;
+        top_options.max_leaf_size = 1;
+        build_bvh_sah(treelet_bounds, top_options, top_nodes, top_order);
+    }
+    else
+    {
+        emit_top_levels(prefixes, treelet_bounds, 0, treelet_count, treelet_bits - 1, top_nodes);
+        top_order.resize(treelet_count);
+        for (int t = 0; t < treelet_count; ++t)
+            top_order[t] = t;
+    }
+
+    size_t total = top_nodes.size();
+    for (const auto &treelet : treelets)
+        total += treelet.size();
+    nodes.reserve(total);
+
+    std::vector<int> treelet_base(treelet_count);
+    splice_treelets(top_nodes, top_order, 0, treelets, treelet_base, nodes);
+
+#pragma omp parallel for schedule(dynamic)
+    for (int t = 0; t < treelet_count; ++t)
+    {
+        int base = treelet_base[t];
+        for (size_t i = 0; i < treelets[t].size(); ++i)
+        {
+            BVHNode node = treelets[t][i];
+            if (!node.is_leaf())
+                node.offset += base;
+            nodes[base + i] = node;
+        }
+    }
+
+    order.resize(count);
+#pragma omp parallel for
+    for (int i = 0; i < count; ++i)
+        order[i] = primitives[i].index;
+}
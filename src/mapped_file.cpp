@@ -0,0 +1,138 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <raytracing/mapped_file.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MAPPED_FILE_MMAP
+#endif
+
+MappedFile::MappedFile(const std::string &path) : _data(NULL), _size(0), _mapped(false)
+{
+#ifdef MAPPED_FILE_MMAP
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return;
+
+    struct stat status;
+    if (fstat(fd, &status) == 0 && status.st_size > 0)
+    {
+        void *data = mmap(NULL, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED)
+        {
+            _data = static_cast<const char *>(data);
+            _size = static_cast<size_t>(status.st_size);
+            _mapped = true;
+        }
+    }
+    close(fd);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file)
+        return;
+
+    _buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (!_buffer.empty())
+    {
+        _data = _buffer.data();
+        _size = _buffer.size();
+    }
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef MAPPED_FILE_MMAP
+    if (_mapped)
+        munmap(const_cast<char *>(_data), _size);
+#endif
+}
+
+void MappedFile::advise_sequential() const
+{
+#ifdef MAPPED_FILE_MMAP
+    // The advice values are not flags, each needs its own call
+    if (_mapped)
+    {
+        madvise(const_cast<char *>(_data), _size, MADV_SEQUENTIAL);
+        madvise(const_cast<char *>(_data), _size, MADV_WILLNEED);
+    }
+#endif
+}
+
+void MappedFile::advise_random() const
+{
+#ifdef MAPPED_FILE_MMAP
+    if (_mapped)
+        madvise(const_cast<char *>(_data), _size, MADV_RANDOM);
+#endif
+}
+
+void MappedFile::prefetch(size_t offset, size_t size) const
+{
+#ifdef MAPPED_FILE_MMAP
+    if (!_mapped || offset >= _size)
+        return;
+
+    // The start has to be page aligned
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = offset / page * page;
+    size_t end = std::min(offset + size, _size);
+    madvise(const_cast<char *>(_data) + begin, end - begin, MADV_WILLNEED);
+#endif
+}
+
+void MappedFile::release(size_t offset, size_t size) const
+{
+#ifdef MAPPED_FILE_MMAP
+    if (!_mapped || offset >= _size)
+        return;
+
+    // Only pages entirely inside the range, a neighbour may still use the others
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t begin = (offset + page - 1) / page * page;
+    size_t end = std::min(offset + size, _size);
+    end = end == _size ? (end + page - 1) / page * page : end / page * page;
+    if (begin < end)
+        madvise(const_cast<char *>(_data) + begin, end - begin, MADV_DONTNEED);
+#endif
+}
+
+std::string temporary_path(const std::string &path)
+{
+    static std::atomic<unsigned> counter(0);
+    std::ostringstream temporary;
+    temporary << path << ".";
+#ifdef MAPPED_FILE_MMAP
+    temporary << getpid() << ".";
+#endif
+    temporary << counter++ << ".tmp";
+    return temporary.str();
+}
@@ -21,6 +21,7 @@
 // SOFTWARE.
 #include <raytracing/vector3.h>
 #include <raytracing/material.h>
+#include <raytracing/warp.h>
 
 Vector3 reflect(const Vector3 &v, const Vector3 &n)
 {
@@ -30,9 +31,9 @@ Vector3 reflect(const Vector3 &v, const Vector3 &n)
 
 Vector3 refract(const Vector3 &uv, const Vector3 &n, number_t etai_over_etat)
 {
-    auto cos_theta = fmin(-uv.dot(n), 1.0);
+    number_t cos_theta = std::fmin(-uv.dot(n), number_t(1));
     Vector3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
-    Vector3 r_out_parallel = -sqrt(fabs(1.0 - r_out_perp.length_squared())) * n;
+    Vector3 r_out_parallel = -std::sqrt(std::fabs(1 - r_out_perp.length_squared())) * n;
     return r_out_perp + r_out_parallel;
 }
 
@@ -41,51 +42,51 @@ static number_t reflectance(number_t cosine, number_t ref_idx)
     // Use Schlick's approximation for reflectance.
     auto r0 = (1 - ref_idx) / (1 + ref_idx);
     r0 = r0 * r0;
-    return r0 + (1 - r0) * pow((1 - cosine), 5);
+    return r0 + (1 - r0) * std::pow(1 - cosine, 5);
 }
 
 bool Lambertian::scatter(
-    const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered) const
+    const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered, Sampler &sampler) const
 {
-    auto scatter_direction = rec.normal + norm_random_in_unit_sphere();
-
-    // Catch degenerate scatter direction
-    if (scatter_direction.is_near_zero())
-        scatter_direction = rec.normal;
-
-    scattered = Ray(rec.p, scatter_direction);
-    attenuation = _albedo->value(rec.u, rec.v, rec.p);
+    // Cosine weighted around the normal
+    const number_t u = random_number_t(sampler);
+    const number_t v = random_number_t(sampler);
+    scattered = rec.spawn_ray(local_to_world(cosine_hemisphere(u, v), rec.normal));
+    attenuation = dispatch_value(*_albedo, rec.u, rec.v, rec.p);
     return true;
 }
 
 bool Metal::scatter(
-    const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered) const
+    const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered, Sampler &sampler) const
 {
     Vector3 reflected = reflect(normalize_Vector3(r_in.direction()), rec.normal);
     // scattered = Ray(rec.p, reflected);
-    scattered = Ray(rec.p, reflected + _fuzz * random_in_unit_sphere());
+    const number_t u = random_number_t(sampler);
+    const number_t v = random_number_t(sampler);
+    const number_t w = random_number_t(sampler);
+    scattered = rec.spawn_ray(reflected + _fuzz * uniform_ball(u, v, w));
     attenuation = _albedo;
     return scattered.direction().dot(rec.normal) > 0;
 }
 
 bool Dielectric::scatter(
-    const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered) const
+    const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered, Sampler &sampler) const
 {
     attenuation = Color{1};
-    number_t refraction_ratio = rec.front_face ? (1.0 / _ir) : _ir;
+    number_t refraction_ratio = rec.front_face ? (1 / _ir) : _ir;
 
     Vector3 unit_direction = normalize_Vector3(r_in.direction());
-    number_t cos_theta = fmin(-unit_direction.dot(rec.normal), 1.0);
-    number_t sin_theta = sqrt(1.0 - cos_theta * cos_theta);
+    number_t cos_theta = std::fmin(-unit_direction.dot(rec.normal), number_t(1));
+    number_t sin_theta = std::sqrt(1 - cos_theta * cos_theta);
 
-    bool cannot_refract = refraction_ratio * sin_theta > 1.0;
+    bool cannot_refract = refraction_ratio * sin_theta > 1;
     Vector3 direction;
 
-    if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_number_t())
+    if (cannot_refract || reflectance(cos_theta, refraction_ratio) > random_number_t(sampler))
         direction = reflect(unit_direction, rec.normal);
     else
         direction = refract(unit_direction, rec.normal, refraction_ratio);
 
-    scattered = Ray(rec.p, direction);
+    scattered = rec.spawn_ray(direction);
     return true;
 }
\ No newline at end of file
@@ -0,0 +1,802 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <vector>
+#include <omp.h>
+#include <raytracing/mesh_loader.h>
+#include <raytracing/mapped_file.h>
+
+// Faces per parallel PLY chunk, and the smallest OBJ chunk in bytes
+#define MESH_LOADER_FACE_CHUNK (1 << 16)
+#define MESH_LOADER_OBJ_CHUNK (1 << 20)
+
+static std::shared_ptr<TriangleMesh> make_mesh(
+    std::vector<Point3> &vertices, std::vector<int> &indices, std::vector<Vector3> &normals,
+    std::vector<number_t> &uvs, const std::vector<AABB> &bounds, MaterialPtr material,
+    const BVHBuildOptions &options, size_t bytes, double start, MeshLoadStats *stats)
+{
+    double parsed = omp_get_wtime();
+    auto mesh = std::make_shared<TriangleMesh>(
+        std::move(vertices), std::move(indices), material, std::move(normals), std::move(uvs), bounds, options);
+
+    if (stats)
+    {
+        stats->bytes = bytes;
+        stats->parse_time = parsed - start;
+        stats->build_time = omp_get_wtime() - parsed;
+    }
+    return mesh;
+}
+
+// PLY
+
+enum class PLYType
+{
+    Int8,
+    UInt8,
+    Int16,
+    UInt16,
+    Int32,
+    UInt32,
+    Float32,
+    Float64,
+    Invalid
+};
+
+struct PLYProperty
+{
+    std::string name;
+    PLYType type;       // of the values
+    PLYType count_type; // of the list length, Invalid for scalars
+};
+
+struct PLYElement
+{
+    std::string name;
+    size_t count;
+    std::vector<PLYProperty> properties;
+};
+
+static PLYType ply_type(const std::string &name)
+{
+    if (name == "char" || name == "int8")
+        return PLYType::Int8;
+    if (name == "uchar" || name == "uint8")
+        return PLYType::UInt8;
+    if (name == "short" || name == "int16")
+        return PLYType::Int16;
+    if (name == "ushort" || name == "uint16")
+        return PLYType::UInt16;
+    if (name == "int" || name == "int32")
+        return PLYType::Int32;
+    if (name == "uint" || name == "uint32")
+        return PLYType::UInt32;
+    if (name == "float" || name == "float32")
+        return PLYType::Float32;
+    if (name == "double" || name == "float64")
+        return PLYType::Float64;
+    return PLYType::Invalid;
+}
+
+static int ply_size(PLYType type)
+{
+    switch (type)
+    {
+    case PLYType::Int8:
+    case PLYType::UInt8:
+        return 1;
+    case PLYType::Int16:
+    case PLYType::UInt16:
+        return 2;
+    case PLYType::Int32:
+    case PLYType::UInt32:
+    case PLYType::Float32:
+        return 4;
+    case PLYType::Float64:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+template <class T>
+static T read_scalar(const char *p, bool swap)
+{
+    char bytes[sizeof(T)];
+    memcpy(bytes, p, sizeof(T));
+    if (swap)
+        std::reverse(bytes, bytes + sizeof(T));
+    T value;
+    memcpy(&value, bytes, sizeof(T));
+    return value;
+}
+
+static double read_ply_value(const char *p, PLYType type, bool swap)
+{
+    switch (type)
+    {
+    case PLYType::Int8:
+        return read_scalar<int8_t>(p, swap);
+    case PLYType::UInt8:
+        return read_scalar<uint8_t>(p, swap);
+    case PLYType::Int16:
+        return read_scalar<int16_t>(p, swap);
+    case PLYType::UInt16:
+        return read_scalar<uint16_t>(p, swap);
+    case PLYType::Int32:
+        return read_scalar<int32_t>(p, swap);
+    case PLYType::UInt32:
+        return read_scalar<uint32_t>(p, swap);
+    case PLYType::Float32:
+        return read_scalar<float>(p, swap);
+    case PLYType::Float64:
+        return read_scalar<double>(p, swap);
+    default:
+        return 0;
+    }
+}
+
+static int64_t read_ply_integer(const char *p, PLYType type, bool swap)
+{
+    switch (type)
+    {
+    case PLYType::Int8:
+        return read_scalar<int8_t>(p, swap);
+    case PLYType::UInt8:
+        return read_scalar<uint8_t>(p, swap);
+    case PLYType::Int16:
+        return read_scalar<int16_t>(p, swap);
+    case PLYType::UInt16:
+        return read_scalar<uint16_t>(p, swap);
+    case PLYType::Int32:
+        return read_scalar<int32_t>(p, swap);
+    case PLYType::UInt32:
+        return read_scalar<uint32_t>(p, swap);
+    default:
+        return static_cast<int64_t>(read_ply_value(p, type, swap));
+    }
+}
+
+static bool parse_ply_header(const MappedFile &file, std::vector<PLYElement> &elements, bool &little_endian,
+                             size_t &data_offset)
+{
+    const char *data = file.data();
+    const char *end = data + file.size();
+    const char *marker = "end_header";
+    const char *header_end = std::search(data, end, marker, marker + strlen(marker));
+    if (file.size() < 4 || memcmp(data, "ply", 3) != 0 || header_end == end)
+        return false;
+
+    const char *newline = static_cast<const char *>(memchr(header_end, '\n', end - header_end));
+    if (!newline)
+        return false;
+    data_offset = newline + 1 - data;
+
+    std::istringstream header(std::string(data, header_end));
+    std::string line;
+    bool has_format = false;
+    while (std::getline(header, line))
+    {
+        std::istringstream tokens(line);
+        std::string keyword;
+        tokens >> keyword;
+
+        if (keyword == "format")
+        {
+            std::string format;
+            tokens >> format;
+            if (format != "binary_little_endian" && format != "binary_big_endian")
+                return false;
+            little_endian = format == "binary_little_endian";
+            has_format = true;
+        }
+        else if (keyword == "element")
+        {
+            PLYElement element;
+            tokens >> element.name >> element.count;
+            elements.push_back(element);
+        }
+        else if (keyword == "property" && !elements.empty())
+        {
+            PLYProperty property;
+            std::string type;
+            tokens >> type;
+            if (type == "list")
+            {
+                std::string count_type, value_type;
+                tokens >> count_type >> value_type;
+                property.count_type = ply_type(count_type);
+                property.type = ply_type(value_type);
+                if (property.count_type == PLYType::Invalid)
+                    return false;
+            }
+            else
+            {
+                property.count_type = PLYType::Invalid;
+                property.type = ply_type(type);
+            }
+            tokens >> property.name;
+            if (property.type == PLYType::Invalid)
+                return false;
+            elements.back().properties.push_back(property);
+        }
+    }
+
+    return has_format;
+}
+
+// Bytes of a record without list properties, 0 if it has any
+static size_t ply_record_size(const PLYElement &element)
+{
+    size_t size = 0;
+    for (const auto &property : element.properties)
+    {
+        if (property.count_type != PLYType::Invalid)
+            return 0;
+        size += ply_size(property.type);
+    }
+    return size;
+}
+
+std::shared_ptr<TriangleMesh> load_ply(
+    const std::string &path, MaterialPtr material, const BVHBuildOptions &options, MeshLoadStats *stats)
+{
+    double start = omp_get_wtime();
+    MappedFile file(path);
+    if (!file.is_open())
+        return NULL;
+
+    std::vector<PLYElement> elements;
+    bool little_endian = true;
+    size_t offset = 0;
+    if (!parse_ply_header(file, elements, little_endian, offset))
+        return NULL;
+
+    const uint16_t probe = 1;
+    const bool swap = little_endian != (*reinterpret_cast<const uint8_t *>(&probe) == 1);
+    const char *data = file.data();
+
+    std::vector<Point3> vertices;
+    std::vector<Vector3> normals;
+    std::vector<number_t> uvs;
+    std::vector<int> indices;
+    std::vector<AABB> bounds;
+    bool has_vertices = false;
+
+    for (const auto &element : elements)
+    {
+        if (element.name == "vertex")
+        {
+            // Fixed size records: every vertex is parsed independently
+            size_t size = ply_record_size(element);
+            if (size == 0 || offset + size * element.count > file.size())
+                return NULL;
+
+            // Byte offsets and types of x y z, nx ny nz, u v
+            int at[8] = {-1, -1, -1, -1, -1, -1, -1, -1};
+            PLYType types[8];
+            static const char *names[8][4] = {{"x"}, {"y"}, {"z"}, {"nx"}, {"ny"}, {"nz"},
+                                              {"u", "s", "texture_u", "texture_s"},
+                                              {"v", "t", "texture_v", "texture_t"}};
+            int record_offset = 0;
+            for (const auto &property : element.properties)
+            {
+                for (int k = 0; k < 8; ++k)
+                    for (int n = 0; n < 4 && names[k][n]; ++n)
+                        if (property.name == names[k][n])
+                        {
+                            at[k] = record_offset;
+                            types[k] = property.type;
+                        }
+                record_offset += ply_size(property.type);
+            }
+            if (at[0] < 0 || at[1] < 0 || at[2] < 0)
+                return NULL;
+
+            const bool with_normals = at[3] >= 0 && at[4] >= 0 && at[5] >= 0;
+            const bool with_uvs = at[6] >= 0 && at[7] >= 0;
+            const long count = static_cast<long>(element.count);
+            vertices.resize(count);
+            if (with_normals)
+                normals.resize(count);
+            if (with_uvs)
+                uvs.resize(2 * count);
+
+            const char *records = data + offset;
+#pragma omp parallel for schedule(static)
+            for (long i = 0; i < count; ++i)
+            {
+                const char *record = records + i * size;
+                vertices[i] = Point3(read_ply_value(record + at[0], types[0], swap),
+                                     read_ply_value(record + at[1], types[1], swap),
+                                     read_ply_value(record + at[2], types[2], swap));
+                if (with_normals)
+                    normals[i] = Vector3(read_ply_value(record + at[3], types[3], swap),
+                                         read_ply_value(record + at[4], types[4], swap),
+                                         read_ply_value(record + at[5], types[5], swap));
+                if (with_uvs)
+                {
+                    uvs[2 * i] = read_ply_value(record + at[6], types[6], swap);
+                    uvs[2 * i + 1] = read_ply_value(record + at[7], types[7], swap);
+                }
+            }
+
+            offset += size * element.count;
+            has_vertices = true;
+        }
+        else if (element.name == "face")
+        {
+            if (!has_vertices)
+                return NULL;
+
+            // One list of vertex indices, other properties must be scalars
+            size_t before = 0, after = 0;
+            const PLYProperty *list = NULL;
+            for (const auto &property : element.properties)
+            {
+                if (property.count_type != PLYType::Invalid)
+                {
+                    if (list || (property.name != "vertex_indices" && property.name != "vertex_index"))
+                        return NULL;
+                    list = &property;
+                }
+                else
+                {
+                    (list ? after : before) += ply_size(property.type);
+                }
+            }
+            if (!list)
+                return NULL;
+
+            // Records vary in size: find the chunk starts and triangle counts
+            // sequentially, reading only the list lengths.
+            const int count_size = ply_size(list->count_type), index_size = ply_size(list->type);
+            const size_t chunks = (element.count + MESH_LOADER_FACE_CHUNK - 1) / MESH_LOADER_FACE_CHUNK;
+            std::vector<size_t> chunk_offset(chunks + 1), chunk_triangles(chunks + 1, 0);
+            size_t position = offset, triangles = 0;
+            for (size_t f = 0; f < element.count; ++f)
+            {
+                if (f % MESH_LOADER_FACE_CHUNK == 0)
+                {
+                    chunk_offset[f / MESH_LOADER_FACE_CHUNK] = position;
+                    chunk_triangles[f / MESH_LOADER_FACE_CHUNK] = triangles;
+                }
+                if (position + before + count_size > file.size())
+                    return NULL;
+                int64_t corners = read_ply_integer(data + position + before, list->count_type, swap);
+                if (corners < 0)
+                    return NULL;
+                triangles += corners > 2 ? corners - 2 : 0;
+                position += before + count_size + corners * index_size + after;
+            }
+            if (position > file.size())
+                return NULL;
+            chunk_offset[chunks] = position;
+            chunk_triangles[chunks] = triangles;
+
+            indices.resize(3 * triangles);
+            bounds.resize(triangles);
+            const int64_t vertex_count = static_cast<int64_t>(vertices.size());
+            int bad_index = 0;
+
+#pragma omp parallel for schedule(dynamic) reduction(| : bad_index)
+            for (long c = 0; c < static_cast<long>(chunks); ++c)
+            {
+                const char *record = data + chunk_offset[c];
+                const char *record_end = data + chunk_offset[c + 1];
+                size_t t = chunk_triangles[c];
+
+                while (record < record_end)
+                {
+                    int64_t corners = read_ply_integer(record + before, list->count_type, swap);
+                    const char *values = record + before + count_size;
+                    int64_t first = read_ply_integer(values, list->type, swap);
+                    int64_t previous = corners > 1 ? read_ply_integer(values + index_size, list->type, swap) : 0;
+
+                    for (int64_t k = 2; k < corners; ++k, ++t)
+                    {
+                        int64_t next = read_ply_integer(values + k * index_size, list->type, swap);
+                        bad_index |= first < 0 || first >= vertex_count || previous < 0 || previous >= vertex_count ||
+                                     next < 0 || next >= vertex_count;
+                        if (bad_index)
+                            break;
+
+                        indices[3 * t] = static_cast<int>(first);
+                        indices[3 * t + 1] = static_cast<int>(previous);
+                        indices[3 * t + 2] = static_cast<int>(next);
+                        bounds[t] = TriangleMesh::triangle_bounds(vertices[first], vertices[previous], vertices[next]);
+                        previous = next;
+                    }
+                    if (bad_index)
+                        break;
+
+                    record = values + corners * index_size + after;
+                }
+            }
+
+            if (bad_index)
+                return NULL;
+            return make_mesh(vertices, indices, normals, uvs, bounds, material, options, file.size(), start, stats);
+        }
+        else
+        {
+            size_t size = ply_record_size(element);
+            if (size == 0 && !element.properties.empty())
+                return NULL;
+            offset += size * element.count;
+        }
+
+        if (offset > file.size())
+            return NULL;
+    }
+
+    return NULL;
+}
+
+// OBJ
+
+static inline bool is_digit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+static inline const char *skip_spaces(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t'))
+        ++p;
+    return p;
+}
+
+static inline const char *next_line(const char *p, const char *end)
+{
+    const char *newline = static_cast<const char *>(memchr(p, '\n', end - p));
+    return newline ? newline + 1 : end;
+}
+
+// Decimal number with optional fraction and exponent. Exact for up to 15
+// significant digits and small exponents, which covers all exporter output;
+// everything else goes through strtod.
+static const char *parse_number(const char *p, const char *end, number_t &value)
+{
+    static const double powers[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int digits = 0, exponent = 0;
+    bool any = false;
+    for (; p < end && is_digit(*p); ++p, any = true)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        }
+        else
+            ++exponent;
+    }
+    if (p < end && *p == '.')
+    {
+        for (++p; p < end && is_digit(*p); ++p, any = true)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                --exponent;
+            }
+        }
+    }
+    if (any && p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *q = p + 1;
+        bool negative_exponent = false;
+        if (q < end && (*q == '-' || *q == '+'))
+            negative_exponent = *q++ == '-';
+        if (q < end && is_digit(*q))
+        {
+            int e = 0;
+            for (; q < end && is_digit(*q); ++q)
+                e = e < 10000 ? e * 10 + (*q - '0') : e;
+            exponent += negative_exponent ? -e : e;
+            p = q;
+        }
+    }
+
+    if (!any || digits > 15 || exponent < -22 || exponent > 22)
+    {
+        // Rare cases: many digits, huge exponents, inf and nan
+        char buffer[64];
+        size_t length = std::min<size_t>(sizeof(buffer) - 1, end - start);
+        memcpy(buffer, start, length);
+        buffer[length] = 0;
+        char *stop;
+        value = strtod(buffer, &stop);
+        return start + (stop - buffer);
+    }
+
+    // In double, so a float result is rounded only once
+    double result = static_cast<double>(mantissa);
+    result = exponent < 0 ? result / powers[-exponent] : result * powers[exponent];
+    value = static_cast<number_t>(negative ? -result : result);
+    return p;
+}
+
+static inline const char *parse_integer(const char *p, const char *end, long &value, bool &ok)
+{
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    ok = p < end && is_digit(*p);
+    value = 0;
+    for (; p < end && is_digit(*p); ++p)
+        value = value * 10 + (*p - '0');
+    if (negative)
+        value = -value;
+    return p;
+}
+
+struct OBJChunk
+{
+    const char *begin, *end;
+    long vertices, uvs, normals, triangles; // counts, then offsets
+    bool bad, attributes_differ;
+};
+
+// Statement of an OBJ line: 1 v, 2 vt, 3 vn, 4 f, 0 anything else
+static inline int obj_statement(const char *&p, const char *end)
+{
+    p = skip_spaces(p, end);
+    if (p + 1 >= end)
+        return 0;
+    if (p[0] == 'v')
+    {
+        if (p[1] == ' ' || p[1] == '\t')
+            return p += 1, 1;
+        if (p + 2 < end && (p[2] == ' ' || p[2] == '\t'))
+        {
+            if (p[1] == 't')
+                return p += 2, 2;
+            if (p[1] == 'n')
+                return p += 2, 3;
+        }
+    }
+    else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+    {
+        return p += 1, 4;
+    }
+    return 0;
+}
+
+static inline bool at_line_end(const char *p, const char *end)
+{
+    return p >= end || *p == '\n' || *p == '\r' || *p == '#';
+}
+
+// Resolves a 1-based or negative OBJ index, -1 if out of range
+static inline long obj_index(long index, long defined, long total)
+{
+    long resolved = index > 0 ? index - 1 : defined + index;
+    return index != 0 && resolved >= 0 && resolved < total ? resolved : -1;
+}
+
+static void count_obj_chunk(OBJChunk &chunk)
+{
+    chunk.vertices = chunk.uvs = chunk.normals = chunk.triangles = 0;
+    for (const char *p = chunk.begin; p < chunk.end; p = next_line(p, chunk.end))
+    {
+        const char *q = p;
+        switch (obj_statement(q, chunk.end))
+        {
+        case 1:
+            ++chunk.vertices;
+            break;
+        case 2:
+            ++chunk.uvs;
+            break;
+        case 3:
+            ++chunk.normals;
+            break;
+        case 4:
+        {
+            long corners = 0;
+            for (q = skip_spaces(q, chunk.end); !at_line_end(q, chunk.end); q = skip_spaces(q, chunk.end))
+            {
+                ++corners;
+                while (q < chunk.end && !at_line_end(q, chunk.end) && *q != ' ' && *q != '\t')
+                    ++q;
+            }
+            chunk.triangles += corners > 2 ? corners - 2 : 0;
+            break;
+        }
+        }
+    }
+}
+
+static void parse_obj_chunk(OBJChunk &chunk, long vertex_total, long uv_total, long normal_total,
+                            std::vector<Point3> &vertices, std::vector<number_t> &uvs,
+                            std::vector<Vector3> &normals, std::vector<int> &indices)
+{
+    long v = chunk.vertices, vt = chunk.uvs, vn = chunk.normals, t = chunk.triangles;
+    chunk.bad = chunk.attributes_differ = false;
+
+    for (const char *p = chunk.begin; p < chunk.end && !chunk.bad; p = next_line(p, chunk.end))
+    {
+        const char *q = p;
+        int statement = obj_statement(q, chunk.end);
+        if (statement == 0)
+            continue;
+
+        if (statement != 4)
+        {
+            number_t x[3] = {0, 0, 0};
+            int components = statement == 2 ? 2 : 3;
+            for (int k = 0; k < components; ++k)
+                q = parse_number(skip_spaces(q, chunk.end), chunk.end, x[k]);
+
+            if (statement == 1)
+                vertices[v++] = Point3{x[0], x[1], x[2]};
+            else if (statement == 2)
+            {
+                uvs[2 * vt] = x[0];
+                uvs[2 * vt++ + 1] = x[1];
+            }
+            else
+                normals[vn++] = Vector3{x[0], x[1], x[2]};
+            continue;
+        }
+
+        // Face: corners v, v/vt, v//vn or v/vt/vn, split into a fan
+        long first = -1, previous = -1, corners = 0;
+        for (q = skip_spaces(q, chunk.end); !at_line_end(q, chunk.end); q = skip_spaces(q, chunk.end))
+        {
+            long index, attribute;
+            bool ok;
+            q = parse_integer(q, chunk.end, index, ok);
+            long corner = ok ? obj_index(index, v, vertex_total) : -1;
+            if (corner < 0)
+            {
+                chunk.bad = true;
+                break;
+            }
+
+            for (int a = 0; a < 2 && q < chunk.end && *q == '/'; ++a)
+            {
+                ++q;
+                if (q < chunk.end && *q == '/')
+                    continue;
+                q = parse_integer(q, chunk.end, attribute, ok);
+                long resolved = ok ? obj_index(attribute, a == 0 ? vt : vn, a == 0 ? uv_total : normal_total) : -1;
+                chunk.attributes_differ |= resolved != corner;
+            }
+            while (q < chunk.end && !at_line_end(q, chunk.end) && *q != ' ' && *q != '\t')
+                ++q;
+
+            if (corners == 0)
+                first = corner;
+            else if (corners >= 2)
+            {
+                indices[3 * t] = static_cast<int>(first);
+                indices[3 * t + 1] = static_cast<int>(previous);
+                indices[3 * t + 2] = static_cast<int>(corner);
+                ++t;
+            }
+            previous = corner;
+            ++corners;
+        }
+    }
+}
+
+std::shared_ptr<TriangleMesh> load_obj(
+    const std::string &path, MaterialPtr material, const BVHBuildOptions &options, MeshLoadStats *stats)
+{
+    double start = omp_get_wtime();
+    MappedFile file(path);
+    if (!file.is_open())
+        return NULL;
+    file.advise_sequential();
+
+    // Chunks of whole lines
+    const char *data = file.data(), *end = data + file.size();
+    size_t chunk_size = std::max<size_t>(MESH_LOADER_OBJ_CHUNK, file.size() / (16 * omp_get_max_threads()) + 1);
+    std::vector<OBJChunk> chunks;
+    for (const char *p = data; p < end;)
+    {
+        OBJChunk chunk;
+        chunk.begin = p;
+        chunk.end = file.size() - (p - data) > chunk_size ? next_line(p + chunk_size, end) : end;
+        chunks.push_back(chunk);
+        p = chunk.end;
+    }
+    const long chunk_count = static_cast<long>(chunks.size());
+
+#pragma omp parallel for schedule(dynamic)
+    for (long c = 0; c < chunk_count; ++c)
+        count_obj_chunk(chunks[c]);
+
+    // Counts to offsets
+    long vertex_total = 0, uv_total = 0, normal_total = 0, triangle_total = 0;
+    for (auto &chunk : chunks)
+    {
+        long counts[4] = {chunk.vertices, chunk.uvs, chunk.normals, chunk.triangles};
+        chunk.vertices = vertex_total;
+        chunk.uvs = uv_total;
+        chunk.normals = normal_total;
+        chunk.triangles = triangle_total;
+        vertex_total += counts[0];
+        uv_total += counts[1];
+        normal_total += counts[2];
+        triangle_total += counts[3];
+    }
+
+    std::vector<Point3> vertices(vertex_total);
+    std::vector<number_t> uvs(2 * uv_total);
+    std::vector<Vector3> normals(normal_total);
+    std::vector<int> indices(3 * triangle_total);
+
+#pragma omp parallel for schedule(dynamic)
+    for (long c = 0; c < chunk_count; ++c)
+        parse_obj_chunk(chunks[c], vertex_total, uv_total, normal_total, vertices, uvs, normals, indices);
+
+    bool attributes_differ = false;
+    for (const auto &chunk : chunks)
+    {
+        if (chunk.bad)
+            return NULL;
+        attributes_differ |= chunk.attributes_differ;
+    }
+    if (attributes_differ || uv_total != vertex_total)
+        std::vector<number_t>().swap(uvs);
+    if (attributes_differ || normal_total != vertex_total)
+        std::vector<Vector3>().swap(normals);
+
+    // Faces may use vertices of later chunks, so the bounds follow the parse
+    std::vector<AABB> bounds(triangle_total);
+
+#pragma omp parallel for schedule(static)
+    for (long t = 0; t < triangle_total; ++t)
+        bounds[t] = TriangleMesh::triangle_bounds(
+            vertices[indices[3 * t]], vertices[indices[3 * t + 1]], vertices[indices[3 * t + 2]]);
+
+    return make_mesh(vertices, indices, normals, uvs, bounds, material, options, file.size(), start, stats);
+}
+
+std::shared_ptr<TriangleMesh> load_mesh(
+    const std::string &path, MaterialPtr material, const BVHBuildOptions &options, MeshLoadStats *stats)
+{
+    std::string extension = path.substr(path.find_last_of('.') + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+    if (extension == "ply")
+        return load_ply(path, material, options, stats);
+    if (extension == "obj")
+        return load_obj(path, material, options, stats);
+    return NULL;
+}
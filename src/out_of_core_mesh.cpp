@@ -0,0 +1,701 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <omp.h>
+#include <raytracing/out_of_core_mesh.h>
+
+// Clusters start on page boundaries so they can be released one by one
+#define OUT_OF_CORE_PAGE 4096
+
+struct OutOfCoreHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t number_size; // sizeof(number_t)
+    uint32_t node_size;   // sizeof(BVHNode), nodes are stored as in memory
+    uint32_t width;       // TRIANGLE_MESH_WIDTH
+    uint32_t has_normals;
+    uint32_t has_uvs;
+    uint64_t triangle_count;
+    uint64_t node_count; // resident levels
+    uint64_t cluster_count;
+};
+
+struct OutOfCoreCluster
+{
+    uint64_t offset;
+    uint64_t size;
+    int32_t first;      // first triangle slot
+    int32_t node_count;
+    int32_t slot_count; // whole SIMD blocks
+    int32_t padding;
+};
+
+static const char out_of_core_magic[8] = {'R', 'T', 'O', 'O', 'C', 'M', 'S', 0};
+
+static size_t align_up(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+// Offsets of the arrays of a cluster relative to its start
+struct OutOfCoreLayout
+{
+    size_t positions, normals, uvs, size;
+
+    OutOfCoreLayout(int node_count, int slot_count, bool has_normals, bool has_uvs)
+    {
+        positions = align_up(sizeof(BVHNode) * node_count, 64);
+        normals = positions + 9 * sizeof(number_t) * slot_count;
+        uvs = normals + (has_normals ? 9 * sizeof(number_t) * slot_count : 0);
+        size = uvs + (has_uvs ? 6 * sizeof(number_t) * slot_count : 0);
+    }
+};
+
+// Whether nodes form a tree as the traversals here expect: the first child of
+// an interior node follows it and the second comes later, leaves start at a
+// multiple of leaf_alignment and end by leaf_limit, and no path is deeper than
+// the traversal stacks. Children follow their parents, so one forward pass
+// gives the depth of every node.
+static bool valid_nodes(const BVHNode *nodes, int node_count, int64_t leaf_limit, int leaf_alignment)
+{
+    std::vector<int> depth(node_count, 0);
+    if (node_count > 0)
+        depth[0] = 1;
+
+    for (int i = 0; i < node_count; ++i)
+    {
+        const BVHNode &node = nodes[i];
+        if (node.count < 0 || depth[i] > BVH_MAX_DEPTH)
+            return false;
+        if (node.is_leaf())
+        {
+            if (node.offset < 0 || node.offset % leaf_alignment != 0 ||
+                static_cast<int64_t>(node.offset) + node.count > leaf_limit)
+                return false;
+        }
+        else
+        {
+            if (node.offset <= i + 1 || node.offset >= node_count || node.axis < 0 || node.axis > 2)
+                return false;
+            depth[i + 1] = std::max(depth[i + 1], depth[i] + 1);
+            depth[node.offset] = std::max(depth[node.offset], depth[i] + 1);
+        }
+    }
+    return true;
+}
+
+// Copies the top of the tree down to the cluster roots into top, whose leaves
+// then name clusters. Returns the index of node in top.
+static int split_clusters(const std::vector<BVHNode> &nodes, const std::vector<int> &slots, int node,
+                          int cluster_triangles, std::vector<BVHNode> &top, std::vector<int> &roots)
+{
+    int index = static_cast<int>(top.size());
+    top.push_back(nodes[node]);
+
+    if (nodes[node].is_leaf() || slots[node] <= cluster_triangles)
+    {
+        top[index].offset = static_cast<int>(roots.size());
+        top[index].count = 1;
+        roots.push_back(node);
+    }
+    else
+    {
+        // top grows during the calls, assign afterwards
+        split_clusters(nodes, slots, node + 1, cluster_triangles, top, roots);
+        int second = split_clusters(nodes, slots, nodes[node].offset, cluster_triangles, top, roots);
+        top[index].offset = second;
+    }
+
+    return index;
+}
+
+bool OutOfCoreMesh::write(const std::string &path, const TriangleMesh &mesh, int cluster_triangles)
+{
+    const int W = TRIANGLE_MESH_WIDTH;
+    const std::vector<BVHNode> &nodes = mesh.nodes();
+    const std::vector<Point3> &vertices = mesh.vertices();
+    const std::vector<int> &indices = mesh.indices();
+    const std::vector<Vector3> &normals = mesh.normals();
+    const std::vector<number_t> &uvs = mesh.uvs();
+    const int node_count = static_cast<int>(nodes.size());
+
+    // Padded triangle slots and nodes of every subtree; the first child of a
+    // node follows it and subtrees are contiguous, so one backward pass works.
+    std::vector<int> slots(node_count), sizes(node_count);
+    for (int i = node_count - 1; i >= 0; --i)
+    {
+        if (nodes[i].is_leaf())
+        {
+            slots[i] = static_cast<int>(align_up(nodes[i].count, W));
+            sizes[i] = 1;
+        }
+        else
+        {
+            slots[i] = slots[i + 1] + slots[nodes[i].offset];
+            sizes[i] = 1 + sizes[i + 1] + sizes[nodes[i].offset];
+        }
+    }
+
+    std::vector<BVHNode> top;
+    std::vector<int> roots;
+    if (node_count > 0)
+        split_clusters(nodes, slots, 0, std::max(cluster_triangles, W), top, roots);
+
+    OutOfCoreHeader header;
+    memcpy(header.magic, out_of_core_magic, sizeof(header.magic));
+    header.version = OUT_OF_CORE_VERSION;
+    header.number_size = sizeof(number_t);
+    header.node_size = sizeof(BVHNode);
+    header.width = W;
+    header.has_normals = !normals.empty();
+    header.has_uvs = !uvs.empty();
+    header.triangle_count = mesh.triangle_count();
+    header.node_count = top.size();
+    header.cluster_count = roots.size();
+
+    std::vector<OutOfCoreCluster> table(roots.size());
+    size_t offset = align_up(sizeof(header) + sizeof(BVHNode) * top.size() + sizeof(OutOfCoreCluster) * table.size(),
+                             OUT_OF_CORE_PAGE);
+    for (size_t c = 0; c < roots.size(); ++c)
+    {
+        // Leaves are laid out in node order, the leftmost leaf of a subtree holds its first slot
+        int leftmost = roots[c];
+        while (!nodes[leftmost].is_leaf())
+            ++leftmost;
+
+        table[c].offset = offset;
+        table[c].first = nodes[leftmost].offset;
+        table[c].node_count = sizes[roots[c]];
+        table[c].slot_count = slots[roots[c]];
+        table[c].padding = 0;
+        table[c].size = OutOfCoreLayout(table[c].node_count, table[c].slot_count, header.has_normals,
+                                        header.has_uvs).size;
+        offset = align_up(offset + table[c].size, OUT_OF_CORE_PAGE);
+    }
+
+    std::string temporary = temporary_path(path);
+    std::ofstream file(temporary, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(top.data()), sizeof(BVHNode) * top.size());
+    file.write(reinterpret_cast<const char *>(table.data()), sizeof(OutOfCoreCluster) * table.size());
+
+    std::vector<char> buffer;
+    for (size_t c = 0; c < roots.size(); ++c)
+    {
+        const OutOfCoreCluster &cluster = table[c];
+        OutOfCoreLayout layout(cluster.node_count, cluster.slot_count, header.has_normals, header.has_uvs);
+        buffer.assign(cluster.offset - static_cast<size_t>(file.tellp()) + cluster.size, 0); // leading padding
+        char *data = buffer.data() + buffer.size() - cluster.size;
+
+        // Nodes relative to the cluster root and its first slot
+        BVHNode *local = reinterpret_cast<BVHNode *>(data);
+        for (int i = 0; i < cluster.node_count; ++i)
+        {
+            local[i] = nodes[roots[c] + i];
+            local[i].offset -= local[i].is_leaf() ? cluster.first : roots[c];
+        }
+
+        // Triangles de-indexed, so a cluster needs nothing else
+        number_t *positions = reinterpret_cast<number_t *>(data + layout.positions);
+        number_t *normal = reinterpret_cast<number_t *>(data + layout.normals);
+        number_t *uv = reinterpret_cast<number_t *>(data + layout.uvs);
+        for (int s = 0; s < cluster.slot_count; ++s)
+        {
+            const int *v = &indices[3 * (cluster.first + s)];
+            number_t *block = positions + 9 * W * (s / W) + s % W;
+            for (int corner = 0; corner < 3; ++corner)
+            {
+                for (int k = 0; k < 3; ++k)
+                {
+                    block[(3 * corner + k) * W] = vertices[v[corner]][k];
+                    if (header.has_normals)
+                        normal[9 * s + 3 * corner + k] = normals[v[corner]][k];
+                }
+                if (header.has_uvs)
+                {
+                    uv[6 * s + 2 * corner] = uvs[2 * v[corner]];
+                    uv[6 * s + 2 * corner + 1] = uvs[2 * v[corner] + 1];
+                }
+            }
+        }
+
+        file.write(buffer.data(), buffer.size());
+    }
+    file.close();
+
+    if (!file)
+    {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+OutOfCoreMesh::OutOfCoreMesh(const std::string &path, MaterialPtr material, size_t memory_cap)
+    : _material(material), _triangle_count(0), _memory_cap(memory_cap), _clock(0), _resident(0), _page_ins(0)
+{
+    std::unique_ptr<MappedFile> file(new MappedFile(path));
+    if (!file->is_open() || file->size() < sizeof(OutOfCoreHeader))
+        return;
+
+    OutOfCoreHeader header;
+    memcpy(&header, file->data(), sizeof(header));
+    if (memcmp(header.magic, out_of_core_magic, sizeof(header.magic)) != 0 || header.version != OUT_OF_CORE_VERSION ||
+        header.number_size != sizeof(number_t) || header.node_size != sizeof(BVHNode) ||
+        header.width != TRIANGLE_MESH_WIDTH)
+        return;
+
+    // Counts are bounded by the file size first, so the sizes cannot overflow
+    const int W = TRIANGLE_MESH_WIDTH;
+    if (header.node_count > file->size() / sizeof(BVHNode) ||
+        header.cluster_count > file->size() / sizeof(OutOfCoreCluster) || header.triangle_count > INT32_MAX)
+        return;
+    const size_t tables = sizeof(header) + sizeof(BVHNode) * header.node_count +
+                          sizeof(OutOfCoreCluster) * header.cluster_count;
+    if (file->size() < tables)
+        return;
+
+    std::vector<BVHNode> nodes(header.node_count);
+    std::vector<OutOfCoreCluster> table(header.cluster_count);
+    memcpy(nodes.data(), file->data() + sizeof(header), sizeof(BVHNode) * nodes.size());
+    memcpy(table.data(), file->data() + sizeof(header) + sizeof(BVHNode) * nodes.size(),
+           sizeof(OutOfCoreCluster) * table.size());
+
+    // A truncated or damaged file must not lead to reads outside the mapping
+    if (!valid_nodes(nodes.data(), static_cast<int>(nodes.size()), static_cast<int64_t>(table.size()), 1))
+        return;
+
+    std::vector<Cluster> clusters(table.size());
+    for (size_t c = 0; c < table.size(); ++c)
+    {
+        const OutOfCoreCluster &entry = table[c];
+        if (entry.offset % OUT_OF_CORE_PAGE != 0 || entry.offset > file->size() ||
+            entry.size > file->size() - entry.offset || entry.node_count <= 0 || entry.slot_count < 0 ||
+            entry.slot_count % W != 0 || entry.first < 0 ||
+            static_cast<int64_t>(entry.first) + entry.slot_count > INT32_MAX)
+            return;
+
+        OutOfCoreLayout layout(entry.node_count, entry.slot_count, header.has_normals, header.has_uvs);
+        const char *data = file->data() + entry.offset;
+        if (layout.size != entry.size ||
+            !valid_nodes(reinterpret_cast<const BVHNode *>(data), entry.node_count, entry.slot_count, W))
+            return;
+
+        // Checking the nodes paged them in, drop them until a ray needs the
+        // cluster so the memory cap accounts for them
+        file->release(entry.offset, layout.positions);
+
+        clusters[c].offset = entry.offset;
+        clusters[c].size = entry.size;
+        clusters[c].first = entry.first;
+        clusters[c].nodes = reinterpret_cast<const BVHNode *>(data);
+        clusters[c].positions = reinterpret_cast<const number_t *>(data + layout.positions);
+        clusters[c].normals = header.has_normals ? reinterpret_cast<const number_t *>(data + layout.normals) : NULL;
+        clusters[c].uvs = header.has_uvs ? reinterpret_cast<const number_t *>(data + layout.uvs) : NULL;
+    }
+
+    // Clusters are reached in no particular order, read-ahead would only
+    // page in neighbours nobody asked for.
+    file->advise_random();
+
+    _file.swap(file);
+    _triangle_count = static_cast<int>(header.triangle_count);
+    _nodes.swap(nodes);
+    _clusters.swap(clusters);
+    if (!_nodes.empty())
+        _bounds = _nodes[0].bounds;
+
+    _firsts.resize(_clusters.size());
+    _last_use.reset(new std::atomic<uint64_t>[_clusters.size()]);
+    for (size_t c = 0; c < _clusters.size(); ++c)
+    {
+        _firsts[c] = _clusters[c].first;
+        _last_use[c] = 0;
+    }
+}
+
+size_t OutOfCoreMesh::memory() const
+{
+    return sizeof(BVHNode) * _nodes.size() + (sizeof(Cluster) + sizeof(int) + sizeof(uint64_t)) * _clusters.size();
+}
+
+void OutOfCoreMesh::touch(int cluster) const
+{
+    // Rays of all threads pass here, so only write when the clock moved on
+    uint64_t now = _clock.load(std::memory_order_relaxed);
+    uint64_t last = _last_use[cluster].load(std::memory_order_relaxed);
+    if (last == 0)
+        page_in(cluster);
+    else if (last != now)
+        _last_use[cluster].compare_exchange_weak(last, now, std::memory_order_relaxed);
+}
+
+void OutOfCoreMesh::page_in(int cluster) const
+{
+    uint64_t expected = 0;
+    if (!_last_use[cluster].compare_exchange_strong(expected, ++_clock))
+        return; // another thread was first
+
+    // One read for the whole cluster instead of a fault per page
+    const Cluster &c = _clusters[cluster];
+    _file->prefetch(c.offset, c.size);
+    ++_page_ins;
+
+    if ((_resident += c.size) > _memory_cap && _memory_cap > 0)
+        release(cluster);
+}
+
+void OutOfCoreMesh::release(int keep) const
+{
+    std::lock_guard<std::mutex> lock(_release_mutex);
+    if (_resident <= _memory_cap)
+        return;
+
+    std::vector<std::pair<uint64_t, int>> resident;
+    for (int c = 0; c < cluster_count(); ++c)
+    {
+        uint64_t last = _last_use[c].load(std::memory_order_relaxed);
+        if (last != 0 && c != keep)
+            resident.push_back(std::make_pair(last, c));
+    }
+    std::sort(resident.begin(), resident.end());
+
+    // Down to three quarters of the cap, so the next page-ins do not release again.
+    // Rays still inside a released cluster fault its pages back in from the file.
+    for (const auto &entry : resident)
+    {
+        if (4 * _resident <= 3 * _memory_cap)
+            break;
+
+        const Cluster &c = _clusters[entry.second];
+        if (_last_use[entry.second].exchange(0) != 0)
+        {
+            _file->release(c.offset, c.size);
+            _resident -= c.size;
+        }
+    }
+}
+
+int OutOfCoreMesh::cluster_of(int slot) const
+{
+    return static_cast<int>(std::upper_bound(_firsts.begin(), _firsts.end(), slot) - _firsts.begin()) - 1;
+}
+
+struct OutOfCoreMesh::TraversalRay
+{
+    ShearedRay sheared;
+    Point3 origin;
+    Vector3 inv_direction;
+    bool dir_is_neg[3];
+
+    TraversalRay(const Ray &r) : sheared(r), origin(r.origin()), inv_direction(1 / r.direction())
+    {
+        for (int a = 0; a < 3; ++a)
+            dir_is_neg[a] = inv_direction[a] < 0;
+    }
+};
+
+int OutOfCoreMesh::hit_cluster(int cluster, const TraversalRay &ray, number_t t_min, number_t &t_max,
+                               number_t *barycentric, bool any_hit) const
+{
+    // Same traversal and triangle test as TriangleMesh, on the mapped nodes
+    // and vertex blocks of one cluster. Returns the slot hit or -1.
+    const int W = TRIANGLE_MESH_WIDTH;
+    const Cluster &c = _clusters[cluster];
+    const ShearedRay &sheared = ray.sheared;
+    const int axes[3] = {sheared.kx, sheared.ky, sheared.kz};
+    int best = -1;
+
+    traverse_bvh(c.nodes, 0, ray.origin, ray.inv_direction, ray.dir_is_neg, t_min, t_max,
+                 [&](const BVHNode &node) -> bool
+                 {
+                     for (int first = node.offset; first < node.offset + node.count; first += W)
+                     {
+                         // Padding slots are degenerate triangles, which never hit
+                         const number_t *block = c.positions + 9 * first;
+                         alignas(64) number_t p[9][W];
+                         for (int corner = 0; corner < 3; ++corner)
+                             for (int k = 0; k < 3; ++k)
+                                 for (int l = 0; l < W; ++l)
+                                     p[3 * corner + k][l] = block[(3 * corner + axes[k]) * W + l] - sheared.origin[k];
+
+                         int lane = hit_triangle_lanes(p, (1 << W) - 1, sheared, t_min, t_max, barycentric);
+                         if (lane >= 0)
+                         {
+                             best = c.first + first + lane;
+                             if (any_hit)
+                                 return true;
+                         }
+                     }
+                     return false;
+                 });
+
+    return best;
+}
+
+void OutOfCoreMesh::record_hit(int slot, number_t t, const number_t *barycentric, HitRecord &rec) const
+{
+    // Barycentrics as kept by TriangleMesh, in p for compute_interaction()
+    // and in u, v for compute_uv().
+    rec.t = t;
+    rec.object = this;
+    rec.instance = NULL;
+    rec.primitive = slot;
+    rec.p = Point3(barycentric[0], barycentric[1], barycentric[2]);
+    rec.u = barycentric[1];
+    rec.v = barycentric[2];
+}
+
+bool OutOfCoreMesh::intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
+{
+    if (_nodes.empty())
+        return false;
+
+    TraversalRay ray(r);
+    number_t barycentric[3];
+    int best = -1;
+
+    traverse_bvh(_nodes.data(), 0, ray.origin, ray.inv_direction, ray.dir_is_neg, t_min, t_max,
+                 [&](const BVHNode &node) -> bool
+                 {
+                     touch(node.offset);
+                     int k = hit_cluster(node.offset, ray, t_min, t_max, barycentric, false);
+                     if (k >= 0)
+                         best = k;
+                     return false;
+                 });
+
+    if (best < 0)
+        return false;
+
+    record_hit(best, t_max, barycentric, rec);
+    return true;
+}
+
+bool OutOfCoreMesh::occluded(const Ray &r, number_t t_min, number_t t_max) const
+{
+    if (_nodes.empty())
+        return false;
+
+    TraversalRay ray(r);
+    number_t barycentric[3];
+
+    bool blocked = false;
+    traverse_bvh(_nodes.data(), 0, ray.origin, ray.inv_direction, nullptr, t_min, t_max,
+                 [&](const BVHNode &node) -> bool
+                 {
+                     touch(node.offset);
+                     number_t t = t_max;
+                     blocked = hit_cluster(node.offset, ray, t_min, t, barycentric, true) >= 0;
+                     return blocked;
+                 });
+
+    return blocked;
+}
+
+// Sorts the pairs (cluster, ray) by cluster: queue[start[c], start[c + 1]) are the rays of cluster c.
+static void bucket_by_cluster(const std::vector<std::pair<int, int>> &pairs, int cluster_count,
+                              std::vector<int> &start, std::vector<int> &queue)
+{
+    start.assign(cluster_count + 1, 0);
+    for (const auto &pair : pairs)
+        ++start[pair.first + 1];
+    for (int c = 0; c < cluster_count; ++c)
+        start[c + 1] += start[c];
+
+    std::vector<int> cursor(start.begin(), start.end() - 1);
+    queue.resize(pairs.size());
+    for (const auto &pair : pairs)
+        queue[cursor[pair.first]++] = pair.second;
+}
+
+void OutOfCoreMesh::hit_batch(
+    const Ray *rays, int count, number_t t_min, number_t t_max, HitRecord *recs, bool *hits) const
+{
+    if (_nodes.empty())
+    {
+        std::fill(hits, hits + count, false);
+        return;
+    }
+
+    // The resident levels: the clusters each ray enters, sorted by distance.
+    // Ray k owns entries[owner[k]][next[k], end[k]).
+    typedef std::pair<number_t, int> Entry; // where the ray enters, cluster
+    std::vector<std::vector<Entry>> entries(omp_get_max_threads());
+    std::vector<int> owner(count), next(count), end(count);
+
+#pragma omp parallel
+    {
+        std::vector<Entry> &local = entries[omp_get_thread_num()];
+
+#pragma omp for schedule(dynamic, 256)
+        for (int k = 0; k < count; ++k)
+        {
+            const Point3 origin = rays[k].origin();
+            const Vector3 inv_direction = 1 / rays[k].direction();
+            const size_t first = local.size();
+
+            traverse_bvh(_nodes.data(), 0, origin, inv_direction, nullptr, t_min, t_max,
+                         [&](const BVHNode &node) -> bool
+                         {
+                             // The leaf was entered, only its entry distance is missing
+                             number_t t_enter = t_min;
+                             node.bounds.hit(origin, inv_direction, t_min, t_max, t_enter);
+                             local.push_back(Entry(t_enter, node.offset));
+                             return false;
+                         });
+
+            std::sort(local.begin() + first, local.end());
+            owner[k] = omp_get_thread_num();
+            next[k] = static_cast<int>(first);
+            end[k] = static_cast<int>(local.size());
+        }
+    }
+
+    // Rounds in which every ray visits its nearest cluster not visited yet,
+    // all rays of a cluster together. Rays stop once their hit is nearer
+    // than the next cluster, as they would traced one by one.
+    const int cluster_count = static_cast<int>(_clusters.size());
+    std::vector<number_t> nearest(count, t_max);
+    std::vector<number_t> barycentric(3 * count);
+    std::vector<int> best(count, -1);
+    std::vector<std::pair<int, int>> pairs;
+    std::vector<int> start, queue;
+
+    while (true)
+    {
+        pairs.clear();
+        for (int k = 0; k < count; ++k)
+        {
+            if (next[k] < end[k] && entries[owner[k]][next[k]].first <= nearest[k])
+                pairs.push_back(std::make_pair(entries[owner[k]][next[k]++].second, k));
+        }
+        if (pairs.empty())
+            break;
+
+        bucket_by_cluster(pairs, cluster_count, start, queue);
+        for (int c = 0; c < cluster_count; ++c)
+        {
+            const int queue_size = start[c + 1] - start[c];
+            if (queue_size == 0)
+                continue;
+
+            touch(c);
+
+#pragma omp parallel for schedule(dynamic, 64) if (queue_size > 256)
+            for (int q = start[c]; q < start[c + 1]; ++q)
+            {
+                const int k = queue[q];
+                int slot = hit_cluster(c, TraversalRay(rays[k]), t_min, nearest[k], &barycentric[3 * k], false);
+                if (slot >= 0)
+                    best[k] = slot;
+            }
+        }
+    }
+
+    // Complete the hits cluster by cluster too, they read normals and texture coordinates
+    pairs.clear();
+    for (int k = 0; k < count; ++k)
+    {
+        hits[k] = best[k] >= 0;
+        if (hits[k])
+            pairs.push_back(std::make_pair(cluster_of(best[k]), k));
+    }
+    bucket_by_cluster(pairs, cluster_count, start, queue);
+
+    for (int c = 0; c < cluster_count; ++c)
+    {
+        const int queue_size = start[c + 1] - start[c];
+        if (queue_size == 0)
+            continue;
+
+        touch(c);
+
+#pragma omp parallel for schedule(static) if (queue_size > 256)
+        for (int q = start[c]; q < start[c + 1]; ++q)
+        {
+            const int k = queue[q];
+            record_hit(best[k], nearest[k], &barycentric[3 * k], recs[k]);
+            complete(rays[k], recs[k]);
+        }
+    }
+}
+
+void OutOfCoreMesh::compute_interaction(const Ray &r, HitRecord &rec) const
+{
+    const int W = TRIANGLE_MESH_WIDTH;
+    const int index = cluster_of(rec.primitive);
+    const Cluster &cluster = _clusters[index];
+    touch(index);
+
+    const int slot = rec.primitive - cluster.first;
+    const number_t *block = cluster.positions + 9 * W * (slot / W) + slot % W;
+    Point3 vertex[3];
+    for (int corner = 0; corner < 3; ++corner)
+        vertex[corner] = Point3(block[(3 * corner) * W], block[(3 * corner + 1) * W], block[(3 * corner + 2) * W]);
+    const Point3 &a = vertex[0], &b = vertex[1], &c = vertex[2];
+
+    number_t barycentric[3] = {rec.p[0], rec.p[1], rec.p[2]};
+    rec.p = barycentric[0] * a + barycentric[1] * b + barycentric[2] * c;
+    rec.error = 0;
+    for (int k = 0; k < 3; ++k)
+        rec.error = std::fmax(rec.error, error_gamma(7) * (std::fabs(barycentric[0] * a[k]) +
+                                                           std::fabs(barycentric[1] * b[k]) +
+                                                           std::fabs(barycentric[2] * c[k])));
+
+    Vector3 outward_normal;
+    if (cluster.normals)
+    {
+        const number_t *n = cluster.normals + 9 * slot;
+        outward_normal = barycentric[0] * Vector3(n[0], n[1], n[2]) + barycentric[1] * Vector3(n[3], n[4], n[5]) +
+                         barycentric[2] * Vector3(n[6], n[7], n[8]);
+    }
+    else
+    {
+        outward_normal = cross_Vector3(b - a, c - a);
+    }
+    rec.set_face_normal(r, normalize_Vector3(outward_normal));
+    rec.material = _material.get();
+}
+
+void OutOfCoreMesh::compute_uv(const Ray & /*r*/, HitRecord &rec) const
+{
+    const Cluster &c = _clusters[cluster_of(rec.primitive)];
+    if (!c.uvs)
+        return;
+
+    number_t barycentric[3] = {1 - rec.u - rec.v, rec.u, rec.v};
+    const number_t *uv = c.uvs + 6 * (rec.primitive - c.first);
+    rec.u = barycentric[0] * uv[0] + barycentric[1] * uv[2] + barycentric[2] * uv[4];
+    rec.v = barycentric[0] * uv[1] + barycentric[1] * uv[3] + barycentric[2] * uv[5];
+}
+
+bool OutOfCoreMesh::bounding_box(AABB &output_box) const
+{
+    output_box = _bounds;
+    return !_nodes.empty();
+}
@@ -0,0 +1,213 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <raytracing/sampler.h>
+
+#define BLUE_NOISE_SIZE 64
+
+static std::atomic<uint64_t> thread_sampler_seed{0};
+
+uint64_t next_thread_sampler_seed()
+{
+    return thread_sampler_seed++;
+}
+
+namespace
+{
+uint32_t reverse_bits(uint32_t x)
+{
+    x = __builtin_bswap32(x);
+    x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+    x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+    return ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+}
+
+// Hash in which every bit depends only on the bits below it (Laine and
+// Karras, with the constants of Burley)
+uint32_t laine_karras(uint32_t x, uint32_t seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+// Owen scrambling of a fraction of 2^32, each bit flipped depending on the
+// bits above it. Applied to a sample index it shuffles the sample order,
+// keeping every aligned block of 2^m indices together.
+uint32_t owen_scramble(uint32_t x, uint32_t seed)
+{
+    return reverse_bits(laine_karras(reverse_bits(x), seed));
+}
+
+// Second dimension of the Sobol sequence as a fraction of 2^32, with its bits
+// reversed; the first one is the index itself. Its direction numbers are the
+// rows of Pascal's triangle mod 2, so bit i is the XOR of the index bits k
+// with i a subset of k, a transform of five butterfly steps.
+uint32_t sobol_second_reversed(uint32_t index)
+{
+    index ^= (index >> 1) & 0x55555555u;
+    index ^= (index >> 2) & 0x33333333u;
+    index ^= (index >> 4) & 0x0f0f0f0fu;
+    index ^= (index >> 8) & 0x00ff00ffu;
+    index ^= (index >> 16) & 0x0000ffffu;
+    return index;
+}
+
+// Radical inverse in base 3 as a fraction of 2^32, of indices below 3^16.
+// Each digit is mapped by one of the six permutations of {0, 1, 2}, chosen by
+// the base 6 digits of the two halves of permutations, and the result is
+// placed uniformly within its cell of width 3^-16 by a hash of them.
+uint32_t permuted_radical_inverse_3(uint32_t index, uint64_t permutations)
+{
+    static const unsigned char digit[6][3] = {{0, 1, 2}, {0, 2, 1}, {1, 0, 2}, {1, 2, 0}, {2, 0, 1}, {2, 1, 0}};
+    uint32_t digits = 0;
+    for (int half = 0; half < 2; ++half)
+    {
+        uint32_t p = static_cast<uint32_t>(permutations >> (32 * half));
+        for (int k = 0; k < 8; ++k, index /= 3, p /= 6)
+            digits = 3 * digits + digit[p % 6][index % 3];
+    }
+    const double tail = static_cast<double>((permutations * 0x9e3779b97f4a7c15ull) >> 40) / 16777216.0;
+    return static_cast<uint32_t>((digits + tail) * (4294967296.0 / 43046721.0));
+}
+
+// Tileable mask with the ranks 0 to BLUE_NOISE_SIZE^2 - 1. Each pixel in turn
+// takes the next rank at the largest void of the pixels ranked before, the
+// minimum of their Gaussian energy on the torus (the void-and-cluster method
+// of Ulichney, grown from a single pixel), so that pixels of any range of
+// ranks are spread evenly.
+struct BlueNoiseMask
+{
+    uint16_t rank[BLUE_NOISE_SIZE * BLUE_NOISE_SIZE];
+
+    BlueNoiseMask()
+    {
+        const int n = BLUE_NOISE_SIZE * BLUE_NOISE_SIZE;
+        const double sigma = 1.5;
+        std::vector<double> weight(n), energy(n);
+        std::vector<char> ranked(n, 0);
+
+        for (int y = 0; y < BLUE_NOISE_SIZE; ++y)
+            for (int x = 0; x < BLUE_NOISE_SIZE; ++x)
+            {
+                const int dx = std::min(x, BLUE_NOISE_SIZE - x);
+                const int dy = std::min(y, BLUE_NOISE_SIZE - y);
+                weight[y * BLUE_NOISE_SIZE + x] = exp(-(dx * dx + dy * dy) / (2 * sigma * sigma));
+            }
+
+        // A tiny hashed energy breaks the ties of the first pixels, which
+        // would otherwise line up on a grid
+        for (int i = 0; i < n; ++i)
+            energy[i] = 1e-9 * static_cast<double>(((i + 1) * 0x9e3779b97f4a7c15ull) >> 11) / 9007199254740992.0;
+
+        for (int r = 0; r < n; ++r)
+        {
+            int best = -1;
+            for (int i = 0; i < n; ++i)
+                if (!ranked[i] && (best < 0 || energy[i] < energy[best]))
+                    best = i;
+
+            ranked[best] = 1;
+            rank[best] = static_cast<uint16_t>(r);
+
+            const int bx = best % BLUE_NOISE_SIZE, by = best / BLUE_NOISE_SIZE;
+            for (int y = 0; y < BLUE_NOISE_SIZE; ++y)
+                for (int x = 0; x < BLUE_NOISE_SIZE; ++x)
+                    energy[y * BLUE_NOISE_SIZE + x] +=
+                        weight[((y - by) & (BLUE_NOISE_SIZE - 1)) * BLUE_NOISE_SIZE + ((x - bx) & (BLUE_NOISE_SIZE - 1))];
+        }
+    }
+
+    // Centre of the rank interval of a pixel as a fraction of 2^32
+    uint32_t operator()(uint32_t x, uint32_t y) const
+    {
+        return (static_cast<uint32_t>(rank[(y % BLUE_NOISE_SIZE) * BLUE_NOISE_SIZE + x % BLUE_NOISE_SIZE]) << 20) |
+               0x80000u;
+    }
+};
+} // namespace
+
+uint32_t Sampler::next_low_discrepancy()
+{
+    const uint64_t counter = ++_counter;
+    if (counter == _second_counter)
+        return _second;
+
+    // Dimension 2k draws point s of the pair and keeps its second coordinate
+    // for dimension 2k + 1. The blue noise pattern shares its sample order
+    // across pixels and decorrelates them by the mask alone.
+    const uint32_t dimension = static_cast<uint32_t>(counter) - 1;
+    const uint64_t pair = ((counter >> 32) << 32) | (dimension >> 1);
+    const uint64_t key = mix((_pattern == SamplePattern::BlueNoise ? mix(_seed) : _pixel) + mix(pair));
+    const uint64_t key2 = key * 0x9e3779b97f4a7c15ull;
+    uint32_t x, y;
+
+    switch (_pattern)
+    {
+    case SamplePattern::Sobol:
+    {
+        // Owen scrambling of reversed coordinates is a Laine-Karras hash
+        const uint32_t index = owen_scramble(_sample, static_cast<uint32_t>(key));
+        x = reverse_bits(laine_karras(index, static_cast<uint32_t>(key >> 32)));
+        y = reverse_bits(laine_karras(sobol_second_reversed(index), static_cast<uint32_t>(key2 >> 32)));
+        break;
+    }
+    case SamplePattern::Halton:
+    {
+        // Shuffled within the first 2^24 points, which keeps the 2^m first
+        // samples a run of 2^m consecutive Halton points
+        const uint32_t index = owen_scramble(_sample, static_cast<uint32_t>(key >> 32)) & 0xffffffu;
+        x = reverse_bits(index) ^ static_cast<uint32_t>(key);
+        y = permuted_radical_inverse_3(index, mix(key2));
+        break;
+    }
+    case SamplePattern::BlueNoise:
+    {
+        // Rank-1 lattice sequence with generator (1, 493), the one with the
+        // largest minimum distance between the first 2^2 to 2^14 points,
+        // shifted per pixel by the mask at offsets chosen per pair
+        static const BlueNoiseMask mask;
+        const uint32_t index = owen_scramble(_sample, static_cast<uint32_t>(key));
+        const uint32_t phi = reverse_bits(index);
+        const uint32_t shift = static_cast<uint32_t>(key >> 32);
+        x = phi + mask(_mask_x + shift, _mask_y + (shift >> 8));
+        y = phi * 493u + mask(_mask_x + (shift >> 16), _mask_y + (shift >> 24));
+        break;
+    }
+    default:
+        return static_cast<uint32_t>(mix(_stream + 0x9e3779b97f4a7c15ull * counter) >> 32);
+    }
+
+    // An odd dimension after a number that did not come from the pattern
+    if (dimension & 1)
+        return y;
+
+    _second_counter = counter + 1;
+    _second = y;
+    return x;
+}
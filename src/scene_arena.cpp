@@ -0,0 +1,74 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <cstdlib>
+#include <raytracing/scene_arena.h>
+
+SceneArena::SceneArena(size_t block_size)
+    : _block_size(block_size), _current(NULL), _end(NULL), _used(0), _reserved(0)
+{
+}
+
+SceneArena::~SceneArena()
+{
+    if (!_blocks.empty())
+        _blocks.back().second = _current;
+
+    for (const auto &block : _blocks)
+    {
+        char *record = align(block.first, alignof(Destructor));
+        while (record < block.second)
+        {
+            record = (*reinterpret_cast<Destructor *>(record))(record);
+            record = align(record, alignof(Destructor));
+        }
+        std::free(block.first);
+    }
+}
+
+char *SceneArena::allocate(size_t size, size_t alignment, Destructor destructor)
+{
+    char *record = align(_current, alignof(Destructor));
+    char *object = align(record + sizeof(Destructor), alignment);
+    if (!_current || object + size > _end)
+    {
+        // Objects larger than a block get a block of their own
+        size_t block_size = std::max(_block_size, sizeof(Destructor) + alignment + size);
+        char *block = static_cast<char *>(std::malloc(block_size));
+        if (!block)
+            throw std::bad_alloc();
+
+        if (!_blocks.empty())
+            _blocks.back().second = _current;
+        _blocks.push_back(std::make_pair(block, block + block_size));
+        _reserved += block_size;
+
+        record = align(block, alignof(Destructor));
+        object = align(record + sizeof(Destructor), alignment);
+        _end = block + block_size;
+    }
+
+    *reinterpret_cast<Destructor *>(record) = destructor;
+    _used += object + size - record;
+    _current = object + size;
+    return record;
+}
@@ -0,0 +1,90 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <vector>
+#include <raytracing/scene_builder.h>
+#include <raytracing/sphere.h>
+#include <raytracing/plane.h>
+
+int substitute_ground_spheres(HitableList &world, number_t min_ratio)
+{
+    const std::vector<HitablePtr> objects = world.objects();
+    const int count = static_cast<int>(objects.size());
+
+    // Largest spheres first: each one whose radius exceeds min_ratio times the
+    // extent of the objects not yet classified is ground, unless those lie
+    // inside it (a sky dome). Classified objects leave the extent.
+    enum { UNDECIDED, GROUND, KEPT };
+    std::vector<AABB> bounds(count);
+    std::vector<char> bounded(count), state(count, UNDECIDED);
+    for (int i = 0; i < count; ++i)
+        bounded[i] = objects[i]->bounding_box(bounds[i]);
+
+    std::vector<Point3> tangent_toward(count);
+    while (true)
+    {
+        int largest = -1;
+        number_t largest_radius = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            if (state[i] != UNDECIDED || objects[i]->type() != HitableType::Sphere)
+                continue;
+            number_t radius = static_cast<const Sphere &>(*objects[i]).radius();
+            if (radius > largest_radius)
+            {
+                largest = i;
+                largest_radius = radius;
+            }
+        }
+        if (largest < 0)
+            break;
+
+        AABB others;
+        for (int i = 0; i < count; ++i)
+            if (bounded[i] && state[i] == UNDECIDED && i != largest)
+                others.extend(bounds[i]);
+        if (others.is_empty() || largest_radius < min_ratio * others.extent().length())
+            break;
+
+        const Sphere &sphere = static_cast<const Sphere &>(*objects[largest]);
+        bool outside = (others.centroid() - sphere.center()).length() > largest_radius;
+        state[largest] = outside ? GROUND : KEPT;
+        tangent_toward[largest] = others.centroid();
+    }
+
+    int replaced = 0;
+    world.clear();
+    for (int i = 0; i < count; ++i)
+    {
+        if (state[i] != GROUND)
+        {
+            world.add(objects[i]);
+            continue;
+        }
+
+        const Sphere &sphere = static_cast<const Sphere &>(*objects[i]);
+        Vector3 normal = normalize_Vector3(tangent_toward[i] - sphere.center());
+        world.add(std::make_shared<Plane>(sphere.center() + sphere.radius() * normal, normal, sphere.material()));
+        ++replaced;
+    }
+
+    return replaced;
+}
@@ -0,0 +1,367 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <cmath>
+#include <limits>
+#include <raytracing/sphere_set.h>
+
+
+SphereSet::SphereSet(const std::vector<std::shared_ptr<Sphere>> &spheres) : _count(0)
+{
+    for (const auto &sphere : spheres)
+        add(*sphere);
+}
+
+void SphereSet::push(const Point3 &center, number_t radius, MaterialHandle material_id)
+{
+    _center_x.push_back(center.x());
+    _center_y.push_back(center.y());
+    _center_z.push_back(center.z());
+    _radius.push_back(radius);
+    _material_ids.push_back(material_id);
+}
+
+void SphereSet::pad()
+{
+    while (_radius.size() % SPHERE_SET_WIDTH != 0)
+        push(Point3{0}, std::numeric_limits<number_t>::quiet_NaN(), NO_MATERIAL);
+}
+
+void SphereSet::add(const Point3 &center, number_t radius, MaterialPtr material)
+{
+    // Back to a flat layout, drop the trailing padding
+    _nodes.clear();
+    while (!_radius.empty() && std::isnan(_radius.back()))
+    {
+        _center_x.pop_back();
+        _center_y.pop_back();
+        _center_z.pop_back();
+        _radius.pop_back();
+        _material_ids.pop_back();
+    }
+
+    push(center, radius, _materials.add(material));
+    pad();
+    ++_count;
+
+    auto r = Vector3{std::fabs(radius)};
+    _bounds.extend(AABB(center - r, center + r));
+}
+
+void SphereSet::build()
+{
+    BVHBuildOptions options;
+    options.max_leaf_size = SPHERE_SET_WIDTH;
+    options.intersect_cost = 1.0 / SPHERE_SET_WIDTH;
+    build(options);
+}
+
+void SphereSet::build(const BVHBuildOptions &options)
+{
+    // Gather the spheres without padding
+    std::vector<int> spheres;
+    std::vector<AABB> bounds;
+    spheres.reserve(_count);
+    bounds.reserve(_count);
+    for (int i = 0; i < static_cast<int>(_radius.size()); ++i)
+    {
+        if (std::isnan(_radius[i]))
+            continue;
+        auto r = Vector3{std::fabs(_radius[i])};
+        Point3 center{_center_x[i], _center_y[i], _center_z[i]};
+        spheres.push_back(i);
+        bounds.push_back(AABB(center - r, center + r));
+    }
+
+    std::vector<int> order;
+    build_bvh_sah(bounds, options, _nodes, order);
+
+    // Lay the leaves out one after another, each padded to whole blocks
+    SphereSet sorted;
+    for (auto &node : _nodes)
+    {
+        if (!node.is_leaf())
+            continue;
+
+        int offset = static_cast<int>(sorted._radius.size());
+        for (int k = node.offset; k < node.offset + node.count; ++k)
+        {
+            int i = spheres[order[k]];
+            sorted.push(Point3{_center_x[i], _center_y[i], _center_z[i]}, _radius[i], _material_ids[i]);
+        }
+        sorted.pad();
+        node.offset = offset;
+    }
+
+    _center_x.swap(sorted._center_x);
+    _center_y.swap(sorted._center_y);
+    _center_z.swap(sorted._center_z);
+    _radius.swap(sorted._radius);
+    _material_ids.swap(sorted._material_ids);
+}
+
+int SphereSet::hit_block(int first, const Point3 &origin, const Vector3 &direction, number_t a,
+                         number_t t_min, number_t &t_max) const
+{
+    // Nearest root in [t_min, t_max] of the spheres [first, first + SPHERE_SET_WIDTH),
+    // same arithmetic as Sphere::intersect_roots. Returns the winner and shrinks t_max, or -1.
+#if defined(__AVX512F__)
+    simd512_t ocx = MM512(sub)(MM512(set1)(origin.x()), MM512(loadu)(&_center_x[first]));
+    simd512_t ocy = MM512(sub)(MM512(set1)(origin.y()), MM512(loadu)(&_center_y[first]));
+    simd512_t ocz = MM512(sub)(MM512(set1)(origin.z()), MM512(loadu)(&_center_z[first]));
+    simd512_t radius = MM512(loadu)(&_radius[first]);
+    simd512_t dx = MM512(set1)(direction.x()), dy = MM512(set1)(direction.y()), dz = MM512(set1)(direction.z());
+    simd512_t va = MM512(set1)(a), zero = MM512(setzero)();
+
+    simd512_t half_b = MM512(mul)(ocx, dx);
+    half_b = MM512(add)(half_b, MM512(mul)(ocy, dy));
+    half_b = MM512(add)(half_b, MM512(mul)(ocz, dz));
+    simd512_t c = MM512(add)(MM512(add)(MM512(mul)(ocx, ocx), MM512(mul)(ocy, ocy)), MM512(mul)(ocz, ocz));
+    c = MM512(sub)(c, MM512(mul)(radius, radius));
+
+    simd512_t scale = MM512(div)(half_b, va);
+    simd512_t fx = MM512(sub)(ocx, MM512(mul)(scale, dx));
+    simd512_t fy = MM512(sub)(ocy, MM512(mul)(scale, dy));
+    simd512_t fz = MM512(sub)(ocz, MM512(mul)(scale, dz));
+    simd512_t f2 = MM512(add)(MM512(add)(MM512(mul)(fx, fx), MM512(mul)(fy, fy)), MM512(mul)(fz, fz));
+    simd512_t discriminant = MM512(mul)(va, MM512(sub)(MM512(mul)(radius, radius), f2));
+    simd512_mask_t valid = MM512_CMP_MASK(discriminant, zero, _CMP_GE_OQ);
+    if (!valid)
+        return -1;
+
+    simd512_t sqrtd = MM512(sqrt)(discriminant);
+    simd512_t signed_sqrtd =
+        MM512(mask_blend)(MM512_CMP_MASK(half_b, zero, _CMP_LT_OQ), sqrtd, MM512(sub)(zero, sqrtd));
+    simd512_t q = MM512(sub)(zero, MM512(add)(half_b, signed_sqrtd));
+    simd512_t t0 = MM512(div)(q, va), t1 = MM512(div)(c, q);
+    simd512_t near = MM512(min)(t0, t1), far = MM512(max)(t0, t1);
+    simd512_t lo = MM512(set1)(t_min), hi = MM512(set1)(t_max);
+
+    simd512_mask_t near_ok = valid & MM512_CMP_MASK(near, lo, _CMP_GE_OQ) & MM512_CMP_MASK(near, hi, _CMP_LE_OQ);
+    simd512_mask_t far_ok = valid & MM512_CMP_MASK(far, lo, _CMP_GE_OQ) & MM512_CMP_MASK(far, hi, _CMP_LE_OQ);
+    simd512_mask_t hits = near_ok | far_ok;
+    if (!hits)
+        return -1;
+
+    simd512_t t = MM512(mask_blend)(near_ok, far, near);
+    t = MM512(mask_blend)(hits, MM512(set1)(infinity), t);
+    number_t t_best = MM512(reduce_min)(t);
+    int lane = __builtin_ctz(MM512_CMP_MASK(t, MM512(set1)(t_best), _CMP_EQ_OQ));
+    t_max = t_best;
+    return first + lane;
+#elif defined(__AVX__)
+    simd256_t ocx = MM256(sub)(MM256(set1)(origin.x()), MM256(loadu)(&_center_x[first]));
+    simd256_t ocy = MM256(sub)(MM256(set1)(origin.y()), MM256(loadu)(&_center_y[first]));
+    simd256_t ocz = MM256(sub)(MM256(set1)(origin.z()), MM256(loadu)(&_center_z[first]));
+    simd256_t radius = MM256(loadu)(&_radius[first]);
+    simd256_t dx = MM256(set1)(direction.x()), dy = MM256(set1)(direction.y()), dz = MM256(set1)(direction.z());
+    simd256_t va = MM256(set1)(a), zero = MM256(setzero)();
+
+    simd256_t half_b = MM256(mul)(ocx, dx);
+    half_b = MM256(add)(half_b, MM256(mul)(ocy, dy));
+    half_b = MM256(add)(half_b, MM256(mul)(ocz, dz));
+    simd256_t c = MM256(add)(MM256(add)(MM256(mul)(ocx, ocx), MM256(mul)(ocy, ocy)), MM256(mul)(ocz, ocz));
+    c = MM256(sub)(c, MM256(mul)(radius, radius));
+
+    simd256_t scale = MM256(div)(half_b, va);
+    simd256_t fx = MM256(sub)(ocx, MM256(mul)(scale, dx));
+    simd256_t fy = MM256(sub)(ocy, MM256(mul)(scale, dy));
+    simd256_t fz = MM256(sub)(ocz, MM256(mul)(scale, dz));
+    simd256_t f2 = MM256(add)(MM256(add)(MM256(mul)(fx, fx), MM256(mul)(fy, fy)), MM256(mul)(fz, fz));
+    simd256_t discriminant = MM256(mul)(va, MM256(sub)(MM256(mul)(radius, radius), f2));
+    simd256_t valid = MM256(cmp)(discriminant, zero, _CMP_GE_OQ);
+    if (!MM256(movemask)(valid))
+        return -1;
+
+    simd256_t sqrtd = MM256(sqrt)(discriminant);
+    simd256_t signed_sqrtd = MM256(blendv)(sqrtd, MM256(sub)(zero, sqrtd), MM256(cmp)(half_b, zero, _CMP_LT_OQ));
+    simd256_t q = MM256(sub)(zero, MM256(add)(half_b, signed_sqrtd));
+    simd256_t t0 = MM256(div)(q, va), t1 = MM256(div)(c, q);
+    simd256_t near = MM256(min)(t0, t1), far = MM256(max)(t0, t1);
+    simd256_t lo = MM256(set1)(t_min), hi = MM256(set1)(t_max);
+
+    simd256_t near_ok = MM256(and)(valid, MM256(and)(MM256(cmp)(near, lo, _CMP_GE_OQ), MM256(cmp)(near, hi, _CMP_LE_OQ)));
+    simd256_t far_ok = MM256(and)(valid, MM256(and)(MM256(cmp)(far, lo, _CMP_GE_OQ), MM256(cmp)(far, hi, _CMP_LE_OQ)));
+    simd256_t hits = MM256(or)(near_ok, far_ok);
+    if (!MM256(movemask)(hits))
+        return -1;
+
+    simd256_t t = MM256(blendv)(far, near, near_ok);
+
+    alignas(32) number_t lanes[SPHERE_SET_WIDTH];
+    MM256(store)(lanes, t);
+    int mask = MM256(movemask)(hits);
+    int best = -1;
+    for (int k = 0; k < SPHERE_SET_WIDTH; ++k)
+        if (((mask >> k) & 1) && (best < 0 || lanes[k] < lanes[best]))
+            best = k;
+    t_max = lanes[best];
+    return first + best;
+#else
+    int best = -1;
+    for (int i = first; i < first + SPHERE_SET_WIDTH; ++i)
+    {
+        number_t ocx = origin.x() - _center_x[i];
+        number_t ocy = origin.y() - _center_y[i];
+        number_t ocz = origin.z() - _center_z[i];
+        number_t half_b = ocx * direction.x() + ocy * direction.y() + ocz * direction.z();
+        number_t c = ocx * ocx + ocy * ocy + ocz * ocz - _radius[i] * _radius[i];
+
+        number_t scale = half_b / a;
+        number_t fx = ocx - scale * direction.x();
+        number_t fy = ocy - scale * direction.y();
+        number_t fz = ocz - scale * direction.z();
+        number_t discriminant = a * (_radius[i] * _radius[i] - (fx * fx + fy * fy + fz * fz));
+        if (!(discriminant >= 0))
+            continue;
+        number_t sqrtd = std::sqrt(discriminant);
+
+        number_t q = -(half_b + (half_b < 0 ? -sqrtd : sqrtd));
+        number_t t0 = q / a, t1 = c / q;
+        number_t root = t0 < t1 ? t0 : t1;
+        if (!(t_min <= root && root <= t_max))
+        {
+            root = t0 > t1 ? t0 : t1;
+            if (!(t_min <= root && root <= t_max))
+                continue;
+        }
+
+        t_max = root;
+        best = i;
+    }
+    return best;
+#endif
+}
+
+bool SphereSet::occluded_block(int first, const Point3 &origin, const Vector3 &direction, number_t a,
+                               number_t t_min, number_t t_max) const
+{
+    number_t t = t_max;
+    return hit_block(first, origin, direction, a, t_min, t) >= 0;
+}
+
+int SphereSet::hit_range(int first, int count, const Point3 &origin, const Vector3 &direction, number_t a,
+                         number_t t_min, number_t &t_max) const
+{
+    int best = -1;
+    for (int block = first; block < first + count; block += SPHERE_SET_WIDTH)
+    {
+        int k = hit_block(block, origin, direction, a, t_min, t_max);
+        if (k >= 0)
+            best = k;
+    }
+    return best;
+}
+
+bool SphereSet::intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
+{
+    Point3 origin = r.origin();
+    Vector3 direction = r.direction();
+    number_t a = direction.length_squared();
+    int best = -1;
+
+    if (_nodes.empty())
+    {
+        best = hit_range(0, static_cast<int>(_radius.size()), origin, direction, a, t_min, t_max);
+    }
+    else
+    {
+        Vector3 inv_direction = 1 / direction;
+        bool dir_is_neg[3] = {inv_direction[0] < 0, inv_direction[1] < 0, inv_direction[2] < 0};
+
+        traverse_bvh(_nodes.data(), 0, origin, inv_direction, dir_is_neg, t_min, t_max,
+                     [&](const BVHNode &node) -> bool
+                     {
+                         int k = hit_range(node.offset, node.count, origin, direction, a, t_min, t_max);
+                         if (k >= 0)
+                             best = k;
+                         return false;
+                     });
+    }
+
+    if (best < 0)
+        return false;
+
+    rec.t = t_max;
+    rec.object = this;
+    rec.instance = NULL;
+    rec.primitive = best;
+
+    return true;
+}
+
+void SphereSet::compute_interaction(const Ray &r, HitRecord &rec) const
+{
+    int i = rec.primitive;
+    Point3 center{_center_x[i], _center_y[i], _center_z[i]};
+    rec.p = Sphere::project_to_surface(r.at(rec.t), center, _radius[i], rec.error);
+
+    Vector3 outward_normal = (rec.p - center) / _radius[i];
+    rec.set_face_normal(r, outward_normal);
+    rec.material = _materials.get(_material_ids[i]);
+}
+
+void SphereSet::compute_uv(const Ray &r, HitRecord &rec) const
+{
+    int i = rec.primitive;
+    Vector3 outward_normal = normalize_Vector3(r.at(rec.t) - Point3{_center_x[i], _center_y[i], _center_z[i]});
+    if (_radius[i] < 0)
+        outward_normal = -outward_normal;
+    Sphere::get_sphere_uv(outward_normal, rec.u, rec.v);
+}
+
+bool SphereSet::occluded(const Ray &r, number_t t_min, number_t t_max) const
+{
+    Point3 origin = r.origin();
+    Vector3 direction = r.direction();
+    number_t a = direction.length_squared();
+
+    if (_nodes.empty())
+    {
+        for (int block = 0; block < static_cast<int>(_radius.size()); block += SPHERE_SET_WIDTH)
+            if (occluded_block(block, origin, direction, a, t_min, t_max))
+                return true;
+        return false;
+    }
+
+    Vector3 inv_direction = 1 / direction;
+
+    bool blocked = false;
+    traverse_bvh(_nodes.data(), 0, origin, inv_direction, nullptr, t_min, t_max,
+                 [&](const BVHNode &node) -> bool
+                 {
+                     for (int block = node.offset; block < node.offset + node.count; block += SPHERE_SET_WIDTH)
+                         if (occluded_block(block, origin, direction, a, t_min, t_max))
+                         {
+                             blocked = true;
+                             break;
+                         }
+                     return blocked;
+                 });
+
+    return blocked;
+}
+
+bool SphereSet::bounding_box(AABB &output_box) const
+{
+    output_box = _bounds;
+    return _count > 0;
+}
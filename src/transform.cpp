@@ -0,0 +1,129 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <cmath>
+#include <raytracing/transform.h>
+
+Transform::Transform() : _invertible(true)
+{
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 4; ++j)
+            _m[i][j] = _inv[i][j] = (i == j) ? 1 : 0;
+}
+
+Transform::Transform(const number_t m[3][4])
+{
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 4; ++j)
+            _m[i][j] = m[i][j];
+
+    // Inverse of the linear part from its cofactors, then b' = -A^-1 b.
+    number_t c[3][3];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+        {
+            int i1 = (i + 1) % 3, i2 = (i + 2) % 3;
+            int j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+            c[j][i] = m[i1][j1] * m[i2][j2] - m[i1][j2] * m[i2][j1];
+        }
+
+    number_t det = m[0][0] * c[0][0] + m[0][1] * c[1][0] + m[0][2] * c[2][0];
+    _invertible = det != 0 && std::isfinite(1 / det);
+    number_t inv_det = _invertible ? 1 / det : 0;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+            _inv[i][j] = c[i][j] * inv_det;
+        _inv[i][3] = -(_inv[i][0] * m[0][3] + _inv[i][1] * m[1][3] + _inv[i][2] * m[2][3]);
+    }
+}
+
+Transform Transform::inverse() const
+{
+    Transform tmp;
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 4; ++j)
+        {
+            tmp._m[i][j] = _inv[i][j];
+            tmp._inv[i][j] = _m[i][j];
+        }
+    tmp._invertible = _invertible;
+    return tmp;
+}
+
+Transform Transform::operator*(const Transform &t) const
+{
+    number_t m[3][4];
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 4; ++j)
+            m[i][j] = _m[i][0] * t._m[0][j] + _m[i][1] * t._m[1][j] + _m[i][2] * t._m[2][j];
+        m[i][3] += _m[i][3];
+    }
+    return Transform(m);
+}
+
+AABB Transform::box(const AABB &b) const
+{
+    // Transformed bounds of all eight corners
+    AABB tmp;
+    for (int k = 0; k < 8; ++k)
+    {
+        Point3 corner{
+            (k & 1) ? b.max().x() : b.min().x(),
+            (k & 2) ? b.max().y() : b.min().y(),
+            (k & 4) ? b.max().z() : b.min().z()};
+        tmp.extend(point(corner));
+    }
+    return tmp;
+}
+
+Transform translate_Transform(const Vector3 &offset)
+{
+    number_t m[3][4] = {{1, 0, 0, offset[0]}, {0, 1, 0, offset[1]}, {0, 0, 1, offset[2]}};
+    return Transform(m);
+}
+
+Transform scale_Transform(const Vector3 &factors)
+{
+    number_t m[3][4] = {{factors[0], 0, 0, 0}, {0, factors[1], 0, 0}, {0, 0, factors[2], 0}};
+    return Transform(m);
+}
+
+Transform scale_Transform(const number_t factor)
+{
+    return scale_Transform(Vector3{factor});
+}
+
+Transform rotate_Transform(const Vector3 &axis, const number_t degrees)
+{
+    // Rodrigues' rotation formula
+    Vector3 a = normalize_Vector3(axis);
+    number_t s = sin(degrees_to_radians(degrees));
+    number_t c = cos(degrees_to_radians(degrees));
+
+    number_t m[3][4] = {
+        {a[0] * a[0] * (1 - c) + c, a[0] * a[1] * (1 - c) - a[2] * s, a[0] * a[2] * (1 - c) + a[1] * s, 0},
+        {a[1] * a[0] * (1 - c) + a[2] * s, a[1] * a[1] * (1 - c) + c, a[1] * a[2] * (1 - c) - a[0] * s, 0},
+        {a[2] * a[0] * (1 - c) - a[1] * s, a[2] * a[1] * (1 - c) + a[0] * s, a[2] * a[2] * (1 - c) + c, 0}};
+    return Transform(m);
+}
@@ -0,0 +1,424 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <raytracing/triangle_mesh.h>
+
+
+ShearedRay::ShearedRay(const Ray &r)
+{
+    Vector3 d = r.direction();
+    kz = fabs(d[0]) > fabs(d[1]) ? (fabs(d[0]) > fabs(d[2]) ? 0 : 2) : (fabs(d[1]) > fabs(d[2]) ? 1 : 2);
+    kx = (kz + 1) % 3;
+    ky = (kx + 1) % 3;
+    // Keep the winding of the triangles
+    if (d[kz] < 0)
+        std::swap(kx, ky);
+
+    sx = d[kx] / d[kz];
+    sy = d[ky] / d[kz];
+    sz = 1 / d[kz];
+
+    Point3 o = r.origin();
+    origin[0] = o[kx];
+    origin[1] = o[ky];
+    origin[2] = o[kz];
+}
+
+TriangleMesh::TriangleMesh(std::vector<Point3> vertices, std::vector<int> indices, MaterialPtr material,
+                           std::vector<Vector3> normals, std::vector<number_t> uvs,
+                           const BVHBuildOptions &options)
+    : _triangle_count(static_cast<int>(indices.size() / 3)), _material(material)
+{
+    _vertices.swap(vertices);
+    _indices.swap(indices);
+    _normals.swap(normals);
+    _uvs.swap(uvs);
+    build(options);
+}
+
+TriangleMesh::TriangleMesh(std::vector<Point3> vertices, std::vector<int> indices, MaterialPtr material,
+                           std::vector<Vector3> normals, std::vector<number_t> uvs,
+                           const std::vector<AABB> &triangle_bounds, const BVHBuildOptions &options)
+    : _triangle_count(static_cast<int>(indices.size() / 3)), _material(material)
+{
+    _vertices.swap(vertices);
+    _indices.swap(indices);
+    _normals.swap(normals);
+    _uvs.swap(uvs);
+
+    std::vector<int> triangles(_triangle_count);
+    for (int t = 0; t < _triangle_count; ++t)
+        triangles[t] = t;
+    layout(options, triangles, triangle_bounds);
+}
+
+BVHBuildOptions TriangleMesh::default_build_options()
+{
+    BVHBuildOptions options;
+    options.max_leaf_size = TRIANGLE_MESH_WIDTH;
+    options.intersect_cost = 1.0 / TRIANGLE_MESH_WIDTH;
+    return options;
+}
+
+AABB TriangleMesh::triangle_bounds(const Point3 &a, const Point3 &b, const Point3 &c)
+{
+    AABB bounds;
+    bounds.extend(a);
+    bounds.extend(b);
+    bounds.extend(c);
+
+    return bounds.padded();
+}
+
+void TriangleMesh::build(const BVHBuildOptions &options)
+{
+    // Triangles of the current layout, padding dropped
+    std::vector<int> triangles;
+    triangles.reserve(_triangle_count);
+    for (int t = 0; t < static_cast<int>(_indices.size() / 3); ++t)
+        if (_indices[3 * t] != _indices[3 * t + 1] || _indices[3 * t] != _indices[3 * t + 2])
+            triangles.push_back(t);
+    _triangle_count = static_cast<int>(triangles.size());
+
+    std::vector<AABB> bounds(_triangle_count);
+
+#pragma omp parallel for
+    for (int k = 0; k < _triangle_count; ++k)
+    {
+        const int *v = &_indices[3 * triangles[k]];
+        bounds[k] = triangle_bounds(_vertices[v[0]], _vertices[v[1]], _vertices[v[2]]);
+    }
+
+    layout(options, triangles, bounds);
+}
+
+void TriangleMesh::layout(const BVHBuildOptions &options, const std::vector<int> &triangles,
+                          const std::vector<AABB> &bounds)
+{
+    _bounds = AABB();
+    for (const auto &box : bounds)
+        _bounds.extend(box);
+
+    std::vector<int> order;
+    if (options.builder == BVHBuilder::LBVH)
+        build_bvh_lbvh(bounds, options, _nodes, order);
+    else
+        build_bvh_sah(bounds, options, _nodes, order);
+
+    // Lay the leaves out one after another, each padded to whole blocks
+    std::vector<int> indices;
+    indices.reserve(_indices.size() + 3 * TRIANGLE_MESH_WIDTH * _nodes.size() / 2);
+    for (auto &node : _nodes)
+    {
+        if (!node.is_leaf())
+            continue;
+
+        int offset = static_cast<int>(indices.size() / 3);
+        for (int k = node.offset; k < node.offset + node.count; ++k)
+        {
+            const int *v = &_indices[3 * triangles[order[k]]];
+            indices.insert(indices.end(), v, v + 3);
+        }
+        while ((indices.size() / 3) % TRIANGLE_MESH_WIDTH != 0)
+            indices.insert(indices.end(), 3, 0);
+        node.offset = offset;
+    }
+
+    _indices.swap(indices);
+}
+
+size_t TriangleMesh::memory() const
+{
+    return sizeof(Point3) * _vertices.size() + sizeof(Vector3) * _normals.size() +
+           sizeof(number_t) * _uvs.size() + sizeof(int) * _indices.size() + sizeof(BVHNode) * _nodes.size();
+}
+
+int TriangleMesh::hit_block(int first, const ShearedRay &ray, number_t t_min, number_t &t_max,
+                            number_t *barycentric) const
+{
+    // Watertight test of the triangles [first, first + TRIANGLE_MESH_WIDTH).
+    // Vertices are gathered into lanes, the test itself runs in SIMD. Returns
+    // the nearest hit in [t_min, t_max] and shrinks t_max, or -1.
+    const int W = TRIANGLE_MESH_WIDTH;
+    alignas(64) number_t p[9][W]; // ax, ay, az, bx, ..., cz relative to the origin, permuted
+    int lanes = 0;                // real triangles, padding has three equal indices
+    for (int l = 0; l < W; ++l)
+    {
+        const int *v = &_indices[3 * (first + l)];
+        lanes |= (v[0] != v[1] || v[0] != v[2]) << l;
+        for (int corner = 0; corner < 3; ++corner)
+        {
+            const Point3 &q = _vertices[v[corner]];
+            p[3 * corner + 0][l] = q[ray.kx] - ray.origin[0];
+            p[3 * corner + 1][l] = q[ray.ky] - ray.origin[1];
+            p[3 * corner + 2][l] = q[ray.kz] - ray.origin[2];
+        }
+    }
+
+    int lane = hit_triangle_lanes(p, lanes, ray, t_min, t_max, barycentric);
+    return lane < 0 ? -1 : first + lane;
+}
+
+int hit_triangle_lanes(const number_t (*p)[TRIANGLE_MESH_WIDTH], int lanes, const ShearedRay &ray, number_t t_min,
+                       number_t &t_max, number_t *barycentric)
+{
+    const int W = TRIANGLE_MESH_WIDTH;
+    alignas(64) number_t u[W], v[W], w[W], t[W];
+    int mask;
+
+#if defined(__AVX512F__)
+    simd512_t sx = MM512(set1)(ray.sx), sy = MM512(set1)(ray.sy), sz = MM512(set1)(ray.sz);
+    simd512_t az = MM512(load)(p[2]), bz = MM512(load)(p[5]), cz = MM512(load)(p[8]);
+    simd512_t ax = MM512(fnmadd)(sx, az, MM512(load)(p[0]));
+    simd512_t ay = MM512(fnmadd)(sy, az, MM512(load)(p[1]));
+    simd512_t bx = MM512(fnmadd)(sx, bz, MM512(load)(p[3]));
+    simd512_t by = MM512(fnmadd)(sy, bz, MM512(load)(p[4]));
+    simd512_t cx = MM512(fnmadd)(sx, cz, MM512(load)(p[6]));
+    simd512_t cy = MM512(fnmadd)(sy, cz, MM512(load)(p[7]));
+
+    simd512_t vu = MM512(sub)(MM512(mul)(cx, by), MM512(mul)(cy, bx));
+    simd512_t vv = MM512(sub)(MM512(mul)(ax, cy), MM512(mul)(ay, cx));
+    simd512_t vw = MM512(sub)(MM512(mul)(bx, ay), MM512(mul)(by, ax));
+
+    simd512_t zero = MM512(setzero)();
+    simd512_mask_t negative = MM512_CMP_MASK(vu, zero, _CMP_LT_OQ) | MM512_CMP_MASK(vv, zero, _CMP_LT_OQ) |
+                        MM512_CMP_MASK(vw, zero, _CMP_LT_OQ);
+    simd512_mask_t positive = MM512_CMP_MASK(vu, zero, _CMP_GT_OQ) | MM512_CMP_MASK(vv, zero, _CMP_GT_OQ) |
+                        MM512_CMP_MASK(vw, zero, _CMP_GT_OQ);
+    simd512_t det = MM512(add)(MM512(add)(vu, vv), vw);
+    simd512_mask_t valid = lanes & ~(negative & positive) & MM512_CMP_MASK(det, zero, _CMP_NEQ_OQ);
+    if (!valid)
+        return -1;
+
+    simd512_t vt = MM512(mul)(vu, az);
+    vt = MM512(fmadd)(vv, bz, vt);
+    vt = MM512(fmadd)(vw, cz, vt);
+    vt = MM512(div)(MM512(mul)(sz, vt), det);
+    valid &= MM512_CMP_MASK(vt, MM512(set1)(t_min), _CMP_GE_OQ) &
+             MM512_CMP_MASK(vt, MM512(set1)(t_max), _CMP_LE_OQ);
+    if (!valid)
+        return -1;
+
+    simd512_t inv_det = MM512(div)(MM512(set1)(1), det);
+    MM512(store)(u, MM512(mul)(vu, inv_det));
+    MM512(store)(v, MM512(mul)(vv, inv_det));
+    MM512(store)(w, MM512(mul)(vw, inv_det));
+    MM512(store)(t, vt);
+    mask = valid;
+#elif defined(__AVX__)
+    simd256_t sx = MM256(set1)(ray.sx), sy = MM256(set1)(ray.sy), sz = MM256(set1)(ray.sz);
+    simd256_t az = MM256(load)(p[2]), bz = MM256(load)(p[5]), cz = MM256(load)(p[8]);
+    simd256_t ax = MM256(sub)(MM256(load)(p[0]), MM256(mul)(sx, az));
+    simd256_t ay = MM256(sub)(MM256(load)(p[1]), MM256(mul)(sy, az));
+    simd256_t bx = MM256(sub)(MM256(load)(p[3]), MM256(mul)(sx, bz));
+    simd256_t by = MM256(sub)(MM256(load)(p[4]), MM256(mul)(sy, bz));
+    simd256_t cx = MM256(sub)(MM256(load)(p[6]), MM256(mul)(sx, cz));
+    simd256_t cy = MM256(sub)(MM256(load)(p[7]), MM256(mul)(sy, cz));
+
+    simd256_t vu = MM256(sub)(MM256(mul)(cx, by), MM256(mul)(cy, bx));
+    simd256_t vv = MM256(sub)(MM256(mul)(ax, cy), MM256(mul)(ay, cx));
+    simd256_t vw = MM256(sub)(MM256(mul)(bx, ay), MM256(mul)(by, ax));
+
+    simd256_t zero = MM256(setzero)();
+    simd256_t negative = MM256(or)(MM256(or)(MM256(cmp)(vu, zero, _CMP_LT_OQ), MM256(cmp)(vv, zero, _CMP_LT_OQ)),
+                                    MM256(cmp)(vw, zero, _CMP_LT_OQ));
+    simd256_t positive = MM256(or)(MM256(or)(MM256(cmp)(vu, zero, _CMP_GT_OQ), MM256(cmp)(vv, zero, _CMP_GT_OQ)),
+                                    MM256(cmp)(vw, zero, _CMP_GT_OQ));
+    simd256_t det = MM256(add)(MM256(add)(vu, vv), vw);
+    simd256_t valid = MM256(andnot)(MM256(and)(negative, positive), MM256(cmp)(det, zero, _CMP_NEQ_OQ));
+    if (!(MM256(movemask)(valid) & lanes))
+        return -1;
+
+    simd256_t vt = MM256(add)(MM256(add)(MM256(mul)(vu, az), MM256(mul)(vv, bz)), MM256(mul)(vw, cz));
+    vt = MM256(div)(MM256(mul)(sz, vt), det);
+    valid = MM256(and)(valid, MM256(and)(MM256(cmp)(vt, MM256(set1)(t_min), _CMP_GE_OQ),
+                                               MM256(cmp)(vt, MM256(set1)(t_max), _CMP_LE_OQ)));
+    mask = MM256(movemask)(valid) & lanes;
+    if (!mask)
+        return -1;
+
+    simd256_t inv_det = MM256(div)(MM256(set1)(1), det);
+    MM256(store)(u, MM256(mul)(vu, inv_det));
+    MM256(store)(v, MM256(mul)(vv, inv_det));
+    MM256(store)(w, MM256(mul)(vw, inv_det));
+    MM256(store)(t, vt);
+#else
+    mask = 0;
+    for (int l = 0; l < W; ++l)
+    {
+        if (!((lanes >> l) & 1))
+            continue;
+
+        number_t ax = p[0][l] - ray.sx * p[2][l], ay = p[1][l] - ray.sy * p[2][l];
+        number_t bx = p[3][l] - ray.sx * p[5][l], by = p[4][l] - ray.sy * p[5][l];
+        number_t cx = p[6][l] - ray.sx * p[8][l], cy = p[7][l] - ray.sy * p[8][l];
+
+        number_t eu = cx * by - cy * bx;
+        number_t ev = ax * cy - ay * cx;
+        number_t ew = bx * ay - by * ax;
+        if ((eu < 0 || ev < 0 || ew < 0) && (eu > 0 || ev > 0 || ew > 0))
+            continue;
+
+        number_t det = eu + ev + ew;
+        if (det == 0)
+            continue;
+
+        number_t et = ray.sz * (eu * p[2][l] + ev * p[5][l] + ew * p[8][l]) / det;
+        if (et < t_min || t_max < et)
+            continue;
+
+        u[l] = eu / det;
+        v[l] = ev / det;
+        w[l] = ew / det;
+        t[l] = et;
+        mask |= 1 << l;
+    }
+    if (!mask)
+        return -1;
+#endif
+
+    int best = -1;
+    for (int l = 0; l < W; ++l)
+        if (((mask >> l) & 1) && (best < 0 || t[l] < t[best]))
+            best = l;
+
+    t_max = t[best];
+    barycentric[0] = u[best];
+    barycentric[1] = v[best];
+    barycentric[2] = w[best];
+    return best;
+}
+
+int TriangleMesh::hit_range(int first, int count, const ShearedRay &ray, number_t t_min, number_t &t_max,
+                            number_t *barycentric) const
+{
+    int best = -1;
+    for (int block = first; block < first + count; block += TRIANGLE_MESH_WIDTH)
+    {
+        int k = hit_block(block, ray, t_min, t_max, barycentric);
+        if (k >= 0)
+            best = k;
+    }
+    return best;
+}
+
+bool TriangleMesh::intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
+{
+    if (_nodes.empty())
+        return false;
+
+    ShearedRay ray(r);
+    Point3 origin = r.origin();
+
+    Vector3 inv_direction = 1 / r.direction();
+    bool dir_is_neg[3] = {inv_direction[0] < 0, inv_direction[1] < 0, inv_direction[2] < 0};
+    number_t barycentric[3];
+    int best = -1;
+
+    traverse_bvh(_nodes.data(), 0, origin, inv_direction, dir_is_neg, t_min, t_max,
+                 [&](const BVHNode &node) -> bool
+                 {
+                     int k = hit_range(node.offset, node.count, ray, t_min, t_max, barycentric);
+                     if (k >= 0)
+                         best = k;
+                     return false;
+                 });
+
+    if (best < 0)
+        return false;
+
+    // barycentric holds the weights of the vertices a, b, c of the winner,
+    // kept in p for compute_interaction() and in u, v for compute_uv().
+    rec.t = t_max;
+    rec.object = this;
+    rec.instance = NULL;
+    rec.primitive = best;
+    rec.p = Point3(barycentric[0], barycentric[1], barycentric[2]);
+    rec.u = barycentric[1];
+    rec.v = barycentric[2];
+
+    return true;
+}
+
+void TriangleMesh::compute_interaction(const Ray &r, HitRecord &rec) const
+{
+    number_t barycentric[3] = {rec.p[0], rec.p[1], rec.p[2]};
+    const int *v = &_indices[3 * rec.primitive];
+    const Point3 &a = _vertices[v[0]], &b = _vertices[v[1]], &c = _vertices[v[2]];
+    rec.p = barycentric[0] * a + barycentric[1] * b + barycentric[2] * c;
+    rec.error = 0;
+    for (int k = 0; k < 3; ++k)
+        rec.error = std::fmax(rec.error, error_gamma(7) * (std::fabs(barycentric[0] * a[k]) +
+                                                           std::fabs(barycentric[1] * b[k]) +
+                                                           std::fabs(barycentric[2] * c[k])));
+
+    Vector3 outward_normal = _normals.empty()
+                                 ? cross_Vector3(b - a, c - a)
+                                 : barycentric[0] * _normals[v[0]] + barycentric[1] * _normals[v[1]] +
+                                       barycentric[2] * _normals[v[2]];
+    rec.set_face_normal(r, normalize_Vector3(outward_normal));
+    rec.material = _material.get();
+}
+
+void TriangleMesh::compute_uv(const Ray & /*r*/, HitRecord &rec) const
+{
+    // Without texture coordinates u and v stay the barycentrics of b and c.
+    if (_uvs.empty())
+        return;
+
+    number_t barycentric[3] = {1 - rec.u - rec.v, rec.u, rec.v};
+    const int *v = &_indices[3 * rec.primitive];
+    rec.u = barycentric[0] * _uvs[2 * v[0]] + barycentric[1] * _uvs[2 * v[1]] + barycentric[2] * _uvs[2 * v[2]];
+    rec.v = barycentric[0] * _uvs[2 * v[0] + 1] + barycentric[1] * _uvs[2 * v[1] + 1] +
+            barycentric[2] * _uvs[2 * v[2] + 1];
+}
+
+bool TriangleMesh::occluded(const Ray &r, number_t t_min, number_t t_max) const
+{
+    if (_nodes.empty())
+        return false;
+
+    ShearedRay ray(r);
+    Point3 origin = r.origin();
+
+    Vector3 inv_direction = 1 / r.direction();
+    number_t barycentric[3];
+
+    bool blocked = false;
+    traverse_bvh(_nodes.data(), 0, origin, inv_direction, nullptr, t_min, t_max,
+                 [&](const BVHNode &node) -> bool
+                 {
+                     number_t t = t_max;
+                     blocked = hit_range(node.offset, node.count, ray, t_min, t, barycentric) >= 0;
+                     return blocked;
+                 });
+
+    return blocked;
+}
+
+bool TriangleMesh::bounding_box(AABB &output_box) const
+{
+    output_box = _bounds;
+    return _triangle_count > 0;
+}
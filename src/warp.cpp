@@ -0,0 +1,43 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <raytracing/warp.h>
+
+void concentric_disk(int count, const number_t *u, const number_t *v, number_t *x, number_t *y)
+{
+#pragma omp simd
+    for (int i = 0; i < count; ++i)
+        concentric_disk(u[i], v[i], x[i], y[i]);
+}
+
+void uniform_sphere(int count, const number_t *u, const number_t *v, number_t *x, number_t *y, number_t *z)
+{
+#pragma omp simd
+    for (int i = 0; i < count; ++i)
+        uniform_sphere(u[i], v[i], x[i], y[i], z[i]);
+}
+
+void cosine_hemisphere(int count, const number_t *u, const number_t *v, number_t *x, number_t *y, number_t *z)
+{
+#pragma omp simd
+    for (int i = 0; i < count; ++i)
+        cosine_hemisphere(u[i], v[i], x[i], y[i], z[i]);
+}
@@ -0,0 +1,225 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <raytracing/wavefront.h>
+#include <raytracing/utils.h>
+
+// Qualified call, no virtual dispatch inside the shading loops
+template <class T>
+static inline bool scatter_as(
+    const Material *material, const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered,
+    Sampler &sampler)
+{
+    return static_cast<const T *>(material)->T::scatter(r_in, rec, attenuation, scattered, sampler);
+}
+
+template <>
+inline bool scatter_as<Material>(
+    const Material *material, const Ray &r_in, const HitRecord &rec, Color &attenuation, Ray &scattered,
+    Sampler &sampler)
+{
+    return material->scatter(r_in, rec, attenuation, scattered, sampler);
+}
+
+WavefrontIntegrator::WavefrontIntegrator(int size) : _size(size)
+{
+    for (int a = 0; a < 3; ++a)
+    {
+        _origin[a].resize(size);
+        _direction[a].resize(size);
+        _throughput[a].resize(size);
+    }
+    _pixel.assign(size, -1);
+    _depth.resize(size);
+    _alive.assign(size, 0);
+    _samplers.resize(size);
+    _rays.resize(size);
+    _records.resize(size);
+    _hits.reset(new bool[size]);
+    _active.reserve(size);
+    _fresh.reserve(size);
+}
+
+Color WavefrontIntegrator::background(const Ray &r)
+{
+    Vector3 unit_direction = normalize_Vector3(r.direction());
+    auto t = 0.5 * (unit_direction.y() + 1.0);
+    return (1.0 - t) * Color{1} + t * Color{0.5, 0.7, 1};
+}
+
+void WavefrontIntegrator::set_path_ray(int k, const Ray &r)
+{
+    Point3 origin = r.origin();
+    Vector3 direction = r.direction();
+    for (int a = 0; a < 3; ++a)
+    {
+        _origin[a][k] = origin[a];
+        _direction[a][k] = direction[a];
+    }
+}
+
+void WavefrontIntegrator::terminate_path(int k, const Color &radiance)
+{
+    for (int a = 0; a < 3; ++a)
+        _throughput[a][k] *= radiance[a];
+    _alive[k] = 0;
+}
+
+bool WavefrontIntegrator::regenerate(const Camera &camera, int image_width, int image_height, int samples_per_pixel,
+                                     int max_depth, long &next_sample, Color *pixel)
+{
+    // Finished paths are accumulated serially, as several slots may carry
+    // samples of the same pixel. Free slots get the next samples in pixel
+    // order, which keeps neighbouring camera rays in neighbouring slots.
+    const long sample_count = static_cast<long>(image_width) * image_height * samples_per_pixel;
+    std::vector<int> &fresh = _fresh;
+    fresh.clear();
+
+    for (int k = 0; k < _size; ++k)
+    {
+        if (_alive[k])
+            continue;
+
+        if (_pixel[k] >= 0)
+            pixel[_pixel[k]] += Color{_throughput[0][k], _throughput[1][k], _throughput[2][k]};
+
+        if (next_sample < sample_count)
+        {
+            _pixel[k] = static_cast<int>(next_sample / samples_per_pixel);
+            _samplers[k].start(_pixel[k], static_cast<uint32_t>(next_sample++ % samples_per_pixel));
+            fresh.push_back(k);
+        }
+        else
+        {
+            _pixel[k] = -1;
+        }
+    }
+
+    const int fresh_count = static_cast<int>(fresh.size());
+
+#pragma omp parallel for schedule(static)
+    for (int f = 0; f < fresh_count; ++f)
+    {
+        const int k = fresh[f];
+        const int i = _pixel[k] % image_width;
+        const int j = _pixel[k] / image_width;
+        Sampler &sampler = _samplers[k];
+        auto u = (i + random_number_t(sampler)) / (image_width - 1);
+        auto v = (j + random_number_t(sampler)) / (image_height - 1);
+
+        set_path_ray(k, camera.get_ray(u, v, sampler));
+        for (int a = 0; a < 3; ++a)
+            _throughput[a][k] = 1;
+        _depth[k] = max_depth;
+        _alive[k] = max_depth > 0;
+    }
+
+    _active.clear();
+    for (int k = 0; k < _size; ++k)
+        if (_alive[k])
+            _active.push_back(k);
+
+    // Paths started with max_depth <= 0 gather no light
+    for (int f = 0; f < fresh_count; ++f)
+        if (!_alive[fresh[f]])
+            terminate_path(fresh[f], Color{0});
+
+    return !_active.empty() || fresh_count > 0;
+}
+
+void WavefrontIntegrator::extend(const Hitable &world)
+{
+    const int active_count = static_cast<int>(_active.size());
+
+#pragma omp parallel for schedule(static)
+    for (int q = 0; q < active_count; ++q)
+        _rays[q] = path_ray(_active[q]);
+
+    // The whole wave at once, so out-of-core geometry can group the rays
+    world.hit_batch(_rays.data(), active_count, spawn_t_min, infinity, _records.data(), _hits.get());
+
+    // Bin the hit points by material type
+    for (int m = 0; m < MATERIAL_TYPE_COUNT; ++m)
+        _queues[m].clear();
+
+    for (int q = 0; q < active_count; ++q)
+    {
+        if (_hits[q])
+            _queues[static_cast<int>(_records[q].material->type())].push_back(q);
+        else
+            terminate_path(_active[q], background(_rays[q]));
+    }
+}
+
+template <class T>
+void WavefrontIntegrator::shade_queue(const std::vector<int> &queue)
+{
+    const int queue_size = static_cast<int>(queue.size());
+
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < queue_size; ++i)
+    {
+        const int q = queue[i];
+        const int k = _active[q];
+        Ray scattered;
+        Color attenuation;
+
+        _samplers[k].next_bounce();
+        if (!scatter_as<T>(_records[q].material, _rays[q], _records[q], attenuation, scattered, _samplers[k]) ||
+            --_depth[k] <= 0)
+        {
+            terminate_path(k, Color{0});
+            continue;
+        }
+
+        set_path_ray(k, scattered);
+        for (int a = 0; a < 3; ++a)
+            _throughput[a][k] *= attenuation[a];
+    }
+}
+
+void WavefrontIntegrator::shade()
+{
+    shade_queue<Lambertian>(_queues[static_cast<int>(MaterialType::Lambertian)]);
+    shade_queue<Metal>(_queues[static_cast<int>(MaterialType::Metal)]);
+    shade_queue<Dielectric>(_queues[static_cast<int>(MaterialType::Dielectric)]);
+    shade_queue<Material>(_queues[static_cast<int>(MaterialType::Other)]);
+}
+
+void WavefrontIntegrator::render(const Hitable &world, const Camera &camera, int image_width, int image_height,
+                                 int samples_per_pixel, int max_depth, Color *pixel, uint64_t seed,
+                                 SamplePattern pattern)
+{
+    for (int i = 0; i < image_width * image_height; ++i)
+        pixel[i] = Color{0, 0, 0};
+
+    std::fill(_pixel.begin(), _pixel.end(), -1);
+    std::fill(_alive.begin(), _alive.end(), 0);
+    std::fill(_samplers.begin(), _samplers.end(), Sampler{seed, pattern, static_cast<uint32_t>(image_width)});
+
+    long next_sample = 0;
+    while (regenerate(camera, image_width, image_height, samples_per_pixel, max_depth, next_sample, pixel))
+    {
+        extend(world);
+        shade();
+    }
+}
@@ -0,0 +1,388 @@
+// MIT License
+
+// Copyright (c) 2021 Florian Eigentler
+
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+#include <algorithm>
+#include <cfloat>
+#include <raytracing/wide_bvh.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <immintrin.h>
+#define WIDE_BVH_SSE
+#endif
+
+struct WideRay
+{
+    float origin[3];
+    float inv_direction[3];
+    float t_min;
+    float t_max;
+};
+
+struct WideStackEntry
+{
+    int child;
+    int count;
+    float t;
+};
+
+static float round_down(number_t x)
+{
+    float f = static_cast<float>(x);
+    return f > x ? std::nextafter(f, -FLT_MAX) : f;
+}
+
+static float round_up(number_t x)
+{
+    float f = static_cast<float>(x);
+    return f < x ? std::nextafter(f, FLT_MAX) : f;
+}
+
+// Slab test of one ray against lanes [offset, offset + width) of a node. Writes
+// the entry distances to t_near and returns the hit mask of these lanes.
+template <int N>
+static int slab_test_scalar(const WideBVHNode<N> &node, const WideRay &ray, int offset, int width, float *t_near)
+{
+    const float *lo[3] = {node.min_x, node.min_y, node.min_z};
+    const float *hi[3] = {node.max_x, node.max_y, node.max_z};
+    int mask = 0;
+
+    for (int i = offset; i < offset + width; ++i)
+    {
+        float t0 = ray.t_min;
+        float t1 = ray.t_max;
+        for (int a = 0; a < 3; ++a)
+        {
+            float ta = (lo[a][i] - ray.origin[a]) * ray.inv_direction[a];
+            float tb = (hi[a][i] - ray.origin[a]) * ray.inv_direction[a];
+            t0 = std::max(t0, std::min(ta, tb));
+            t1 = std::min(t1, std::max(ta, tb));
+        }
+        t_near[i] = t0;
+        mask |= (t0 <= t1) << (i - offset);
+    }
+    return mask;
+}
+
+#ifdef WIDE_BVH_SSE
+template <int N>
+static int slab_test_sse(const WideBVHNode<N> &node, const WideRay &ray, int offset, float *t_near)
+{
+    __m128 t0 = _mm_set1_ps(ray.t_min);
+    __m128 t1 = _mm_set1_ps(ray.t_max);
+    const float *lo[3] = {node.min_x, node.min_y, node.min_z};
+    const float *hi[3] = {node.max_x, node.max_y, node.max_z};
+
+    for (int a = 0; a < 3; ++a)
+    {
+        __m128 o = _mm_set1_ps(ray.origin[a]);
+        __m128 d = _mm_set1_ps(ray.inv_direction[a]);
+        __m128 ta = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(lo[a] + offset), o), d);
+        __m128 tb = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(hi[a] + offset), o), d);
+        t0 = _mm_max_ps(t0, _mm_min_ps(ta, tb));
+        t1 = _mm_min_ps(t1, _mm_max_ps(ta, tb));
+    }
+
+    _mm_storeu_ps(t_near + offset, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+}
+#endif
+
+#ifdef __AVX__
+static int slab_test_avx(const WideBVHNode<8> &node, const WideRay &ray, float *t_near)
+{
+    __m256 t0 = _mm256_set1_ps(ray.t_min);
+    __m256 t1 = _mm256_set1_ps(ray.t_max);
+    const float *lo[3] = {node.min_x, node.min_y, node.min_z};
+    const float *hi[3] = {node.max_x, node.max_y, node.max_z};
+
+    for (int a = 0; a < 3; ++a)
+    {
+        __m256 o = _mm256_set1_ps(ray.origin[a]);
+        __m256 d = _mm256_set1_ps(ray.inv_direction[a]);
+        __m256 ta = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(lo[a]), o), d);
+        __m256 tb = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(hi[a]), o), d);
+        t0 = _mm256_max_ps(t0, _mm256_min_ps(ta, tb));
+        t1 = _mm256_min_ps(t1, _mm256_max_ps(ta, tb));
+    }
+
+    _mm256_storeu_ps(t_near, t0);
+    return _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+}
+#endif
+
+template <int N>
+static int slab_test(const WideBVHNode<N> &node, const WideRay &ray, float *t_near)
+{
+#if defined(WIDE_BVH_SSE)
+    int mask = 0;
+    for (int offset = 0; offset < N; offset += 4)
+        mask |= slab_test_sse(node, ray, offset, t_near) << offset;
+    return mask;
+#else
+    return slab_test_scalar(node, ray, 0, N, t_near);
+#endif
+}
+
+#ifdef __AVX__
+// The eight children of a BVH8 node fill one AVX register
+template <>
+int slab_test<8>(const WideBVHNode<8> &node, const WideRay &ray, float *t_near)
+{
+    return slab_test_avx(node, ray, t_near);
+}
+#endif
+
+static WideRay make_wide_ray(const Ray &r, number_t t_min)
+{
+    WideRay ray;
+    Point3 origin = r.origin();
+    Vector3 direction = r.direction();
+    for (int a = 0; a < 3; ++a)
+    {
+        // Avoid 0 * inf = NaN in the slab test for axis-parallel rays
+        number_t d = fabs(direction[a]) > 1e-12 ? direction[a] : (direction[a] < 0 ? -1e-12 : 1e-12);
+        ray.origin[a] = static_cast<float>(origin[a]);
+        ray.inv_direction[a] = static_cast<float>(1 / d);
+    }
+    ray.t_min = static_cast<float>(t_min);
+    return ray;
+}
+
+template <int N>
+static int collapse_node(const std::vector<BVHNode> &binary, std::vector<int> children, std::vector<WideBVHNode<N>> &nodes)
+{
+    // Open the interior child with the largest surface area until N children are gathered.
+    while (static_cast<int>(children.size()) < N)
+    {
+        int best = -1;
+        number_t best_area = -1;
+        for (size_t i = 0; i < children.size(); ++i)
+        {
+            const BVHNode &node = binary[children[i]];
+            if (!node.is_leaf() && node.bounds.surface_area() > best_area)
+            {
+                best = static_cast<int>(i);
+                best_area = node.bounds.surface_area();
+            }
+        }
+        if (best < 0)
+            break;
+
+        int c = children[best];
+        children[best] = c + 1;
+        children.push_back(binary[c].offset);
+    }
+
+    int index = static_cast<int>(nodes.size());
+    nodes.push_back(WideBVHNode<N>());
+
+    for (int k = 0; k < N; ++k)
+    {
+        WideBVHNode<N> &node = nodes[index];
+        if (k >= static_cast<int>(children.size()))
+        {
+            // Empty slot, its slabs never overlap
+            node.min_x[k] = node.min_y[k] = node.min_z[k] = FLT_MAX;
+            node.max_x[k] = node.max_y[k] = node.max_z[k] = -FLT_MAX;
+            node.child[k] = 0;
+            node.count[k] = -1;
+            continue;
+        }
+
+        // Conservative single precision bounds, padded for the float traversal
+        const BVHNode &child = binary[children[k]];
+        Point3 lo = child.bounds.min(), hi = child.bounds.max();
+        number_t pad = 1e-6 * (1 + std::max(lo.length(), hi.length()));
+        node.min_x[k] = round_down(lo.x() - pad);
+        node.min_y[k] = round_down(lo.y() - pad);
+        node.min_z[k] = round_down(lo.z() - pad);
+        node.max_x[k] = round_up(hi.x() + pad);
+        node.max_y[k] = round_up(hi.y() + pad);
+        node.max_z[k] = round_up(hi.z() + pad);
+
+        if (child.is_leaf())
+        {
+            node.child[k] = child.offset;
+            node.count[k] = child.count;
+        }
+        else
+        {
+            int c = collapse_node(binary, std::vector<int>{children[k] + 1, child.offset}, nodes);
+            nodes[index].child[k] = c;
+            nodes[index].count[k] = 0;
+        }
+    }
+
+    return index;
+}
+
+template <int N>
+void WideBVH<N>::collapse(const BVH &bvh)
+{
+    const auto &binary = bvh.nodes();
+    _nodes.clear();
+    _objects = bvh.objects();
+    _unbounded = bvh.unbounded();
+    _bounds = AABB();
+
+    if (binary.empty())
+        return;
+
+    _bounds = binary[0].bounds;
+    if (binary[0].is_leaf())
+        collapse_node(binary, std::vector<int>{0}, _nodes);
+    else
+        collapse_node(binary, std::vector<int>{1, binary[0].offset}, _nodes);
+}
+
+template <int N>
+bool WideBVH<N>::intersect(const Ray &r, number_t t_min, number_t t_max, HitRecord &rec) const
+{
+    bool hit_anything = false;
+    auto closest_so_far = t_max;
+
+    for (const auto &object : _unbounded)
+    {
+        if (dispatch_intersect(*object, r, t_min, closest_so_far, rec))
+        {
+            hit_anything = true;
+            closest_so_far = rec.t;
+        }
+    }
+
+    if (_nodes.empty())
+        return hit_anything;
+
+    WideRay ray = make_wide_ray(r, t_min);
+
+    WideStackEntry stack[BVH_MAX_DEPTH * N];
+    int stack_size = 0;
+    stack[stack_size++] = WideStackEntry{0, 0, ray.t_min};
+
+    alignas(32) float t_near[N];
+    int order[N];
+
+    while (stack_size > 0)
+    {
+        WideStackEntry entry = stack[--stack_size];
+        if (entry.t > closest_so_far)
+            continue;
+
+        if (entry.count > 0)
+        {
+            for (int i = entry.child; i < entry.child + entry.count; ++i)
+            {
+                if (dispatch_intersect(*_objects[i], r, t_min, closest_so_far, rec))
+                {
+                    hit_anything = true;
+                    closest_so_far = rec.t;
+                }
+            }
+            continue;
+        }
+
+        const WideBVHNode<N> &node = _nodes[entry.child];
+        ray.t_max = static_cast<float>(closest_so_far) * (1 + 4 * FLT_EPSILON);
+        int mask = slab_test(node, ray, t_near);
+
+        // Sort the hit children by entry distance and push them far to near
+        int hits = 0;
+        for (int k = 0; k < N; ++k)
+        {
+            if (!(mask & (1 << k)) || node.count[k] < 0)
+                continue;
+
+            int j = hits++;
+            while (j > 0 && t_near[order[j - 1]] < t_near[k])
+            {
+                order[j] = order[j - 1];
+                --j;
+            }
+            order[j] = k;
+        }
+
+        for (int j = 0; j < hits; ++j)
+        {
+            int k = order[j];
+            stack[stack_size++] = WideStackEntry{node.child[k], node.count[k], t_near[k] * (1 - 4 * FLT_EPSILON)};
+        }
+    }
+
+    return hit_anything;
+}
+
+template <int N>
+bool WideBVH<N>::occluded(const Ray &r, number_t t_min, number_t t_max) const
+{
+    for (const auto &object : _unbounded)
+        if (dispatch_occluded(*object, r, t_min, t_max))
+            return true;
+
+    if (_nodes.empty())
+        return false;
+
+    WideRay ray = make_wide_ray(r, t_min);
+    ray.t_max = static_cast<float>(t_max) * (1 + 4 * FLT_EPSILON);
+
+    // Any hit will do, so children are pushed unsorted
+    int stack[BVH_MAX_DEPTH * N];
+    int stack_size = 0;
+    stack[stack_size++] = 0;
+
+    alignas(32) float t_near[N];
+
+    while (stack_size > 0)
+    {
+        const WideBVHNode<N> &node = _nodes[stack[--stack_size]];
+        int mask = slab_test(node, ray, t_near);
+
+        for (int k = 0; k < N; ++k)
+        {
+            if (!(mask & (1 << k)) || node.count[k] < 0)
+                continue;
+
+            if (node.count[k] == 0)
+            {
+                stack[stack_size++] = node.child[k];
+                continue;
+            }
+
+            for (int i = node.child[k]; i < node.child[k] + node.count[k]; ++i)
+                if (dispatch_occluded(*_objects[i], r, t_min, t_max))
+                    return true;
+        }
+    }
+
+    return false;
+}
+
+template <int N>
+bool WideBVH<N>::bounding_box(AABB &output_box) const
+{
+    if (_nodes.empty() || !_unbounded.empty())
+        return false;
+
+    output_box = _bounds;
+    return true;
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;